@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+#include "batch.h"
+#include "fat16.h"
+#include "ext2.h"
+#include "out.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+// Estado que se mantiene caliente entre órdenes: el sistema se detecta una sola vez
+typedef struct {
+    Image *img;
+    int jobs;
+    const Filesystem *fs;       // Sistema detectado al abrir la imagen
+    int is_ext2;
+    EXT2_GroupTable gt;         // Descriptores de grupo (EXT2)
+    FAT16_Table fat;            // FAT cargada (FAT16)
+    FAT16_DirCache cache;       // Índices de directorio reutilizados entre búsquedas
+} Session;
+
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static int open_session(Session *s, Image *img, const Filesystem *fs, int jobs) {
+    memset(s, 0, sizeof(*s));
+    s->img = img;
+    s->fs = fs;
+    s->jobs = jobs;
+
+    if (fs_is(fs, FS_EXT2)) {
+        s->is_ext2 = 1;
+        return read_group_descriptors(img, &s->gt, &fs->sb);
+    }
+    if (fs_is(fs, FS_FAT16)) {
+        if (load_FAT16_table(img, &fs->bpb, &s->fat) < 0) return -1;
+        if (init_FAT16_dircache(&s->cache) < 0) {
+            free_FAT16_table(&s->fat);
+            return -1;
+        }
+        return 0;
+    }
+    fprintf(stderr, "Not supported file system. Only FAT16 and EXT2 are supported.\n");
+    return -1;
+}
+
+static void close_session(Session *s) {
+    if (s->is_ext2) {
+        free(s->gt.desc);
+    } else {
+        free_FAT16_dircache(&s->cache);
+        free_FAT16_table(&s->fat);
+    }
+}
+
+static void reply_error(const char *msg, const char *arg) {
+    printf("ERR %s%s%s\n", msg, arg ? ": " : "", arg ? arg : "");
+}
+
+// Responde con un bloque de datos ya completo en memoria
+static void reply_data(const char *data, size_t len) {
+    printf("OK %zu\n", len);
+    fwrite(data, 1, len, stdout);
+}
+
+static void do_info(Session *s) {
+    char *data = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&data, &len);
+    if (!mem) {
+        reply_error("sin memoria", NULL);
+        return;
+    }
+    s->fs->drv->info(s->fs, mem);
+    fclose(mem);
+    reply_data(data, len);
+    free(data);
+}
+
+static void do_cache(Session *s) {
+    char *data = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&data, &len);
+    if (!mem) {
+        reply_error("sin memoria", NULL);
+        return;
+    }
+    if (s->img->cache) cache_print_stats(s->img->cache, mem);
+    else fprintf(mem, "Block cache: desactivada (usa --cache-mb)\n");
+    fclose(mem);
+    reply_data(data, len);
+    free(data);
+}
+
+static void do_tree(Session *s) {
+    OutWriter out;
+    if (out_init_mem(&out) < 0) {
+        reply_error("sin memoria", NULL);
+        return;
+    }
+    int ret = s->is_ext2 ? tree_EXT2(s->img, &s->fs->sb, &s->gt, s->jobs, &out)
+                         : tree_FAT16(s->img, &s->fs->bpb, &s->fat, s->jobs, &out);
+    if (ret < 0) reply_error("no se pudo recorrer el árbol", NULL);
+    else reply_data(out.buf, out.len);
+    out_free(&out);
+}
+
+static void do_stat(Session *s, const char *path) {
+    char *data = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&data, &len);
+    if (!mem) {
+        reply_error("sin memoria", NULL);
+        return;
+    }
+
+    int ret;
+    if (s->is_ext2) {
+        EXT2_Inode inode;
+        uint32_t ino;
+        ret = resolve_EXT2_path(s->img, &s->fs->sb, &s->gt, path, &inode, &ino);
+        if (ret == 0) print_EXT2_stat(path, ino, &inode, mem);
+    } else {
+        uint8_t entry[32];
+        ret = lookup_FAT16_stat(s->img, &s->fs->bpb, &s->fat, &s->cache, path, entry);
+        if (ret == 0) print_FAT16_stat(path, entry, mem);
+    }
+    fclose(mem);
+
+    if (ret < 0) reply_error("no encontrado", path);
+    else reply_data(data, len);
+    free(data);
+}
+
+// La cabecera lleva el tamaño exacto y el contenido se transfiere directamente a stdout.
+// Devuelve -1 si la trama queda a medias (el cliente no podría resincronizarse)
+static int do_cat(Session *s, const char *path) {
+    uint64_t size;
+    EXT2_Inode inode;
+    uint8_t entry[32];
+
+    if (s->is_ext2) {
+        if (resolve_EXT2_path(s->img, &s->fs->sb, &s->gt, path, &inode, NULL) < 0) {
+            reply_error("no encontrado", path);
+            return 0;
+        }
+        if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+            reply_error("es un directorio", path);
+            return 0;
+        }
+        size = EXT2_inode_size(&inode);
+    } else {
+        if (resolve_FAT16_path(s->img, &s->fs->bpb, &s->fat, &s->cache, path, entry) < 0) {
+            reply_error("no encontrado", path);
+            return 0;
+        }
+        if (entry[11] & ATTR_DIRECTORY) {
+            reply_error("es un directorio", path);
+            return 0;
+        }
+        size = entry[28] | (entry[29]<<8) | (entry[30]<<16) | ((uint32_t)entry[31]<<24);
+    }
+
+    printf("OK %llu\n", (unsigned long long)size);
+    fflush(stdout);
+
+    if (s->is_ext2) return dump_EXT2_inode(s->img, &s->fs->sb, &inode, STDOUT_FILENO);
+
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    int64_t done = dump_FAT16_file(s->img, &s->fs->bpb, &s->fat, cluster, (uint32_t)size, STDOUT_FILENO);
+    if (done < 0) return -1;
+    // Cadena más corta que el tamaño declarado: se rellena para respetar la trama
+    return image_write_zeros(STDOUT_FILENO, size - (uint64_t)done);
+}
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+int run_batch(Image *img, const Filesystem *fs, int jobs) {
+    Session s;
+    if (open_session(&s, img, fs, jobs) < 0) {
+        return 1;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int ret = 0;
+    while ((n = getline(&line, &cap, stdin)) > 0) {
+        // Quitar el salto de línea (y el \r de clientes Windows)
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if (n == 0) continue;
+
+        char *arg = strchr(line, ' ');
+        if (arg) {
+            *arg++ = '\0';
+            arg += strspn(arg, " ");
+        }
+
+        if (strcmp(line, "quit") == 0) {
+            break;
+        } else if (strcmp(line, "info") == 0) {
+            do_info(&s);
+        } else if (strcmp(line, "tree") == 0) {
+            do_tree(&s);
+        } else if (strcmp(line, "cache") == 0) {
+            do_cache(&s);
+        } else if (strcmp(line, "stat") == 0 && arg && *arg) {
+            do_stat(&s, arg);
+        } else if (strcmp(line, "cat") == 0 && arg && *arg) {
+            if (do_cat(&s, arg) < 0) {
+                ret = 1;
+                break;
+            }
+            continue;   // El contenido ya ha salido sin pasar por stdio
+        } else {
+            reply_error("orden no válida", line);
+        }
+        fflush(stdout);
+    }
+
+    free(line);
+    close_session(&s);
+    return ret;
+}
@@ -0,0 +1,13 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "image.h"
+#include "fs.h"
+
+
+// Modo servidor: lee órdenes por stdin (una por línea) sobre una imagen ya abierta
+// y responde por stdout con tramas "OK <bytes>\n<datos>" o "ERR <mensaje>\n".
+// Órdenes: info, tree, stat <ruta>, cat <ruta>, cache (estadísticas de la caché), quit
+int run_batch(Image *img, const Filesystem *fs, int jobs);
+
+#endif
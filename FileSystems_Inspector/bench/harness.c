@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Mide --info, --tree y --cat de program.exe sobre varias imágenes y escribe
+// los resultados en JSON por stdout (un objeto por imagen y opción):
+//   harness [--reps N] [--jobs N] <program> <nombre>=<imagen>[:<fichero_cat>] ...
+// Por cada medida: tiempo de pared (mínimo y mediana de N ejecuciones), pico de RSS,
+// fallos de página, bytes y llamadas de lectura/escritura (/proc/<pid>/io) y el
+// total de llamadas al sistema de una ejecución extra trazada con ptrace.
+
+
+#define MAX_REPS 100
+
+// Resultado de una ejecución
+typedef struct {
+    double wall_ms;
+    long maxrss_kb;
+    long minflt, majflt;
+    uint64_t rchar, wchar, syscr, syscw, read_bytes;
+} RunStats;
+
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Hijo: stdout a /dev/null y exec del programa
+static void exec_child(char *const argv[]) {
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(null);
+    }
+    execv(argv[0], argv);
+    _exit(127);
+}
+
+// Lee /proc/<pid>/io de un hijo terminado pero aún sin recoger
+static void read_proc_io(pid_t pid, RunStats *st) {
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long v;
+        if (sscanf(line, "rchar: %llu", &v) == 1) st->rchar = v;
+        else if (sscanf(line, "wchar: %llu", &v) == 1) st->wchar = v;
+        else if (sscanf(line, "syscr: %llu", &v) == 1) st->syscr = v;
+        else if (sscanf(line, "syscw: %llu", &v) == 1) st->syscw = v;
+        else if (sscanf(line, "read_bytes: %llu", &v) == 1) st->read_bytes = v;
+    }
+    fclose(f);
+}
+
+static int run_once(char *const argv[], RunStats *st) {
+    memset(st, 0, sizeof(*st));
+    double t0 = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) exec_child(argv);
+
+    // Esperar sin recoger para poder leer sus contadores de E/S
+    siginfo_t si;
+    if (waitid(P_PID, pid, &si, WEXITED | WNOWAIT) < 0) {
+        perror("waitid");
+        return -1;
+    }
+    st->wall_ms = now_ms() - t0;
+    read_proc_io(pid, st);
+
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        perror("wait4");
+        return -1;
+    }
+    st->maxrss_kb = ru.ru_maxrss;
+    st->minflt = ru.ru_minflt;
+    st->majflt = ru.ru_majflt;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Cuenta las llamadas al sistema de todos los hilos del programa (-1 si no se puede trazar)
+static long count_syscalls(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP);
+        exec_child(argv);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) return -1;
+    if (ptrace(PTRACE_SETOPTIONS, pid, NULL,
+               PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL) < 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+        return -1;
+    }
+
+    // Cada llamada produce una parada a la entrada y otra a la salida
+    long stops = 0;
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+    for (;;) {
+        pid_t tid = waitpid(-1, &status, __WALL);
+        if (tid < 0) break;
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            if (tid == pid) break;
+            continue;
+        }
+        int sig = 0;
+        if (WIFSTOPPED(status)) {
+            int s = WSTOPSIG(status);
+            if (s == (SIGTRAP | 0x80)) stops++;
+            else if (s != SIGTRAP && s != SIGSTOP) sig = s;    // Señal real: reenviarla
+        }
+        ptrace(PTRACE_SYSCALL, tid, NULL, (void *)(long)sig);
+    }
+    // exit_group no tiene parada de salida
+    return (stops + 1) / 2;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_option(const char *prog, const char *name, const char *image, const char *option,
+                         const char *cat_path, int reps, const char *jobs, int *first) {
+    char *argv[8];
+    int argc = 0;
+    argv[argc++] = (char *)prog;
+    argv[argc++] = (char *)option;
+    argv[argc++] = (char *)image;
+    if (cat_path) argv[argc++] = (char *)cat_path;
+    if (jobs) {
+        argv[argc++] = "--jobs";
+        argv[argc++] = (char *)jobs;
+    }
+    argv[argc] = NULL;
+
+    // Pico de RSS entre todas las ejecuciones; el resto de contadores no varía entre ellas
+    RunStats st, agg = { 0 };
+
+    // Una ejecución previa para calentar la caché de páginas
+    int rc = run_once(argv, &st);
+
+    double times[MAX_REPS];
+    for (int r = 0; r < reps; r++) {
+        rc = run_once(argv, &st);
+        times[r] = st.wall_ms;
+        if (st.maxrss_kb > agg.maxrss_kb) agg.maxrss_kb = st.maxrss_kb;
+        agg.minflt = st.minflt;
+        agg.majflt = st.majflt;
+        agg.rchar = st.rchar;
+        agg.wchar = st.wchar;
+        agg.syscr = st.syscr;
+        agg.syscw = st.syscw;
+        agg.read_bytes = st.read_bytes;
+    }
+    qsort(times, reps, sizeof(double), cmp_double);
+    long syscalls = count_syscalls(argv);
+
+    printf("%s\n  {\"image\": \"%s\", \"option\": \"%s\", \"jobs\": %s, \"reps\": %d, \"exit\": %d,\n"
+           "   \"wall_ms_min\": %.3f, \"wall_ms_median\": %.3f, \"peak_rss_kb\": %ld,\n"
+           "   \"syscalls\": %ld, \"read_syscalls\": %llu, \"write_syscalls\": %llu,\n"
+           "   \"bytes_read\": %llu, \"bytes_written\": %llu, \"storage_read_bytes\": %llu,\n"
+           "   \"minor_faults\": %ld, \"major_faults\": %ld}",
+           *first ? "[" : ",", name, option, jobs ? jobs : "1", reps, rc,
+           times[0], times[reps / 2], agg.maxrss_kb,
+           syscalls, (unsigned long long)agg.syscr, (unsigned long long)agg.syscw,
+           (unsigned long long)agg.rchar, (unsigned long long)agg.wchar,
+           (unsigned long long)agg.read_bytes, agg.minflt, agg.majflt);
+    fflush(stdout);
+    *first = 0;
+}
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+int main(int argc, char *argv[]) {
+    int reps = 5;
+    const char *jobs = NULL;
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+        if (i + 1 >= argc) break;
+        if (strcmp(argv[i], "--reps") == 0) reps = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--jobs") == 0) jobs = argv[i + 1];
+        else break;
+    }
+    if (i + 2 > argc || reps < 1 || reps > MAX_REPS) {
+        fprintf(stderr, "Uso: %s [--reps N] [--jobs N] <program> <nombre>=<imagen>[:<fichero_cat>] ...\n", argv[0]);
+        return 1;
+    }
+    const char *prog = argv[i++];
+
+    int first = 1;
+    for (; i < argc; i++) {
+        // nombre=imagen:fichero
+        char *spec = strdup(argv[i]);
+        char *eq = strchr(spec, '=');
+        if (!eq) {
+            fprintf(stderr, "Especificación no válida: %s\n", argv[i]);
+            free(spec);
+            return 1;
+        }
+        *eq = '\0';
+        char *image = eq + 1;
+        char *cat_path = strchr(image, ':');
+        if (cat_path) *cat_path++ = '\0';
+
+        bench_option(prog, spec, image, "--info", NULL, reps, NULL, &first);
+        bench_option(prog, spec, image, "--tree", NULL, reps, jobs, &first);
+        if (cat_path) bench_option(prog, spec, image, "--cat", cat_path, reps, NULL, &first);
+        free(spec);
+    }
+    printf(first ? "[]\n" : "\n]\n");
+    return 0;
+}
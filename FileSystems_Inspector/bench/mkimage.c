@@ -0,0 +1,871 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../fat16.h"
+#include "../ext2.h"
+
+// Generador de imágenes sintéticas FAT16/EXT2 para las pruebas de rendimiento.
+// Escribe la imagen directamente (sin mkfs) a partir de una descripción del árbol:
+//   mkimage fat16|ext2 <salida> [--files N] [--dirs N] [--depth N] [--min-size B]
+//           [--max-size B] [--big-file B] [--frag PCT] [--block-size 1024|2048|4096] [--seed N]
+// El contenido de cada fichero es determinista (depende de su número y del offset),
+// así que dos imágenes con los mismos parámetros son idénticas byte a byte.
+
+
+#define TIMESTAMP 1700000000u      // Fecha fija para que la imagen sea reproducible
+#define WRITE_BUFFER (1u << 20)
+
+
+// Parámetros del árbol a generar
+typedef struct {
+    uint32_t files;         // Ficheros normales repartidos entre los directorios
+    uint32_t dirs;          // Directorios además de la raíz
+    uint32_t depth;         // Profundidad máxima de directorios
+    uint64_t min_size, max_size;
+    uint64_t big_file;      // Tamaño de un fichero extra en la raíz (0 = ninguno)
+    uint32_t frag;          // Porcentaje de asignaciones que saltan a otra zona del disco
+    uint32_t block_size;    // Sólo EXT2
+    uint64_t seed;
+} Params;
+
+// Nodo del árbol: directorio o fichero
+typedef struct {
+    uint32_t parent;        // Índice del directorio padre
+    uint32_t index;         // Número de fichero/directorio (para el nombre y el contenido)
+    uint64_t size;          // Tamaño en bytes (sólo ficheros)
+    int is_dir;
+    uint32_t *children;     // Sólo directorios
+    uint32_t nchildren, cap;
+    uint32_t nsubdirs;
+    uint32_t first;         // Primer cluster (FAT16) o número de inodo (EXT2)
+} Node;
+
+typedef struct {
+    Node *nodes;
+    uint32_t count;
+} Tree;
+
+// Escritura agrupada: las escrituras contiguas se juntan en un único pwrite
+typedef struct {
+    int fd;
+    uint8_t *buf;
+    uint64_t off;
+    size_t len;
+} Writer;
+
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    rng_state = splitmix64(rng_state);
+    return rng_state;
+}
+
+// Rellena buf con el contenido del fichero id a partir del offset off (múltiplo de 8)
+static void fill_content(uint8_t *buf, size_t len, uint32_t id, uint64_t off) {
+    for (size_t i = 0; i < len; i += 8) {
+        uint64_t v = splitmix64(((uint64_t)id << 40) ^ ((off + i) >> 3));
+        size_t n = len - i < 8 ? len - i : 8;
+        memcpy(buf + i, &v, n);
+    }
+}
+
+static void writer_flush(Writer *w) {
+    size_t done = 0;
+    while (done < w->len) {
+        ssize_t n = pwrite(w->fd, w->buf + done, w->len - done, w->off + done);
+        if (n <= 0) {
+            perror("Error al escribir la imagen");
+            exit(1);
+        }
+        done += n;
+    }
+    w->off += w->len;
+    w->len = 0;
+}
+
+static void writer_put(Writer *w, uint64_t off, const void *data, size_t len) {
+    if (w->len > 0 && (off != w->off + w->len || w->len + len > WRITE_BUFFER)) {
+        writer_flush(w);
+    }
+    if (w->len == 0) w->off = off;
+    if (len > WRITE_BUFFER) {
+        // Bloques enormes (no ocurre con los tamaños usados) se escriben directamente
+        if (pwrite(w->fd, data, len, off) != (ssize_t)len) {
+            perror("Error al escribir la imagen");
+            exit(1);
+        }
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static void add_child(Tree *t, uint32_t dir, uint32_t child) {
+    Node *d = &t->nodes[dir];
+    if (d->nchildren == d->cap) {
+        d->cap = d->cap ? d->cap * 2 : 8;
+        d->children = realloc(d->children, d->cap * sizeof(uint32_t));
+    }
+    d->children[d->nchildren++] = child;
+    if (t->nodes[child].is_dir) d->nsubdirs++;
+}
+
+// Árbol: los directorios se reparten en cadenas de hasta depth niveles
+// y los ficheros se reparten por turnos entre los directorios
+static void build_tree(Tree *t, const Params *p) {
+    t->count = 1 + p->dirs + p->files + (p->big_file ? 1 : 0);
+    t->nodes = calloc(t->count, sizeof(Node));
+    t->nodes[0].is_dir = 1;
+
+    uint32_t *last_at = calloc(p->depth + 1, sizeof(uint32_t));    // Último directorio por nivel
+    uint32_t n = 1;
+    for (uint32_t i = 0; i < p->dirs; i++, n++) {
+        uint32_t level = (i % p->depth) + 1;
+        t->nodes[n].is_dir = 1;
+        t->nodes[n].index = i;
+        t->nodes[n].parent = last_at[level - 1];
+        last_at[level] = n;
+        add_child(t, t->nodes[n].parent, n);
+    }
+    free(last_at);
+
+    uint64_t span = p->max_size - p->min_size + 1;
+    for (uint32_t i = 0; i < p->files; i++, n++) {
+        t->nodes[n].index = i;
+        t->nodes[n].size = p->min_size + rng_next() % span;
+        t->nodes[n].parent = p->dirs ? 1 + (i % p->dirs) : 0;
+        add_child(t, t->nodes[n].parent, n);
+    }
+
+    if (p->big_file) {
+        t->nodes[n].index = p->files;
+        t->nodes[n].size = p->big_file;
+        add_child(t, 0, n);
+    }
+}
+
+// Orden de asignación de unidades libres: con frag > 0, ese porcentaje de posiciones
+// se intercambia con otra posterior al azar y las cadenas dejan de ser contiguas
+static void shuffle_free(uint32_t *units, uint32_t n, uint32_t frag) {
+    for (uint32_t i = 0; i + 1 < n; i++) {
+        if (rng_next() % 100 < frag) {
+            uint32_t j = i + 1 + rng_next() % (n - i - 1);
+            uint32_t tmp = units[i];
+            units[i] = units[j];
+            units[j] = tmp;
+        }
+    }
+}
+
+
+// --- FAT16 ---
+
+typedef struct {
+    uint16_t *fat;
+    uint32_t *order;        // Clusters libres en orden de asignación
+    uint32_t norder, next;
+    uint32_t spc, bps;
+    uint64_t data_off;      // Offset del cluster 2
+} FatGen;
+
+// Reserva una cadena de n clusters y devuelve el primero
+static uint32_t fat_alloc(FatGen *g, uint32_t n, uint32_t *chain) {
+    for (uint32_t i = 0; i < n; i++) {
+        chain[i] = g->order[g->next++];
+        if (i > 0) g->fat[chain[i - 1]] = chain[i];
+    }
+    g->fat[chain[n - 1]] = 0xFFFF;
+    return chain[0];
+}
+
+static void fat_entry(uint8_t e[32], const char *name, const char *ext, uint8_t attr, uint16_t cluster, uint32_t size) {
+    memset(e, 0, 32);
+    memset(e, ' ', 11);
+    memcpy(e, name, strlen(name));
+    memcpy(e + 8, ext, strlen(ext));
+    e[11] = attr;
+    e[22] = 0x00; e[23] = 0x60;     // 12:00:00
+    e[24] = 0x21; e[25] = 0x5A;     // 2025-01-01
+    e[26] = cluster & 0xFF; e[27] = cluster >> 8;
+    e[28] = size; e[29] = size >> 8; e[30] = size >> 16; e[31] = size >> 24;
+}
+
+static void fat_node_entry(const Tree *t, uint32_t i, uint8_t e[32]) {
+    const Node *nd = &t->nodes[i];
+    char name[16];
+    if (nd->is_dir) {
+        snprintf(name, sizeof(name), "D%07u", nd->index);
+        fat_entry(e, name, "", ATTR_DIRECTORY, nd->first, 0);
+    } else if (nd->parent == 0 && nd->index == t->count) {
+        fat_entry(e, "BIG", "DAT", 0x20, nd->first, nd->size);
+    } else {
+        snprintf(name, sizeof(name), "F%07u", nd->index);
+        fat_entry(e, name, "DAT", 0x20, nd->first, nd->size);
+    }
+}
+
+static uint64_t cluster_off(const FatGen *g, uint32_t c) {
+    return g->data_off + (uint64_t)(c - 2) * g->spc * g->bps;
+}
+
+static int make_fat16(const char *path, const Params *p, Tree *t) {
+    const uint32_t bps = 512, res = 4, nfats = 2, root_entries = 512;
+    const uint32_t root_sectors = root_entries * 32 / bps;
+    // El fichero grande se marca con index == count para darle nombre propio
+    if (p->big_file) t->nodes[t->count - 1].index = t->count;
+
+    if (t->nodes[0].nchildren > root_entries) {
+        fprintf(stderr, "La raíz FAT16 admite %u entradas (hay %u)\n", root_entries, t->nodes[0].nchildren);
+        return -1;
+    }
+
+    // Cluster más pequeño con el que todo cabe en 65524 clusters
+    uint32_t spc, count = 0;
+    for (spc = 1; spc <= 64; spc *= 2) {
+        uint64_t cl = (uint64_t)spc * bps;
+        uint64_t n = 0;
+        for (uint32_t i = 1; i < t->count; i++) {
+            const Node *nd = &t->nodes[i];
+            uint64_t bytes = nd->is_dir ? (uint64_t)(nd->nchildren + 2) * 32 : nd->size;
+            n += bytes ? (bytes + cl - 1) / cl : 0;
+        }
+        // Margen libre para que la fragmentación tenga dónde saltar
+        uint64_t total = n + n / 8 + 16;
+        if (total < 4096) total = 4096;
+        if (total <= 65524) {
+            count = total;
+            break;
+        }
+    }
+    if (spc > 64) {
+        fprintf(stderr, "Demasiados datos para FAT16\n");
+        return -1;
+    }
+
+    uint32_t fat_sectors = ((count + 2) * 2 + bps - 1) / bps;
+    uint64_t total_sectors = res + nfats * fat_sectors + root_sectors + (uint64_t)count * spc;
+
+    FatGen g = { 0 };
+    g.fat = calloc(count + 2, sizeof(uint16_t));
+    g.fat[0] = 0xFFF8;
+    g.fat[1] = 0xFFFF;
+    g.order = malloc(count * sizeof(uint32_t));
+    for (uint32_t c = 0; c < count; c++) g.order[c] = c + 2;
+    g.norder = count;
+    shuffle_free(g.order, count, p->frag);
+    g.spc = spc;
+    g.bps = bps;
+    g.data_off = (uint64_t)(res + nfats * fat_sectors + root_sectors) * bps;
+
+    // Asignar primero directorios y luego ficheros
+    uint32_t *chain = malloc(count * sizeof(uint32_t));
+    uint32_t **chains = calloc(t->count, sizeof(uint32_t *));
+    uint64_t cl = (uint64_t)spc * bps;
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 1; i < t->count; i++) {
+            Node *nd = &t->nodes[i];
+            if (nd->is_dir != (pass == 0)) continue;
+            uint64_t bytes = nd->is_dir ? (uint64_t)(nd->nchildren + 2) * 32 : nd->size;
+            uint32_t n = bytes ? (bytes + cl - 1) / cl : 0;
+            if (n == 0) continue;
+            nd->first = fat_alloc(&g, n, chain);
+            chains[i] = malloc(n * sizeof(uint32_t));
+            memcpy(chains[i], chain, n * sizeof(uint32_t));
+        }
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Error al crear la imagen");
+        return -1;
+    }
+    if (ftruncate(fd, total_sectors * bps) < 0) {
+        perror("Error al dimensionar la imagen");
+        close(fd);
+        return -1;
+    }
+    Writer w = { fd, malloc(WRITE_BUFFER), 0, 0 };
+
+    // Sector de arranque con el BPB
+    uint8_t boot[512] = { 0 };
+    FAT16_BPB bpb = { 0 };
+    memcpy(bpb.jmpBoot, "\xEB\x3C\x90", 3);
+    memcpy(bpb.OEMName, "MKIMAGE ", 8);
+    bpb.BytesPerSector = bps;
+    bpb.SectorsPerCluster = spc;
+    bpb.ReservedSectors = res;
+    bpb.NumFATs = nfats;
+    bpb.RootEntries = root_entries;
+    bpb.TotalSectors16 = total_sectors < 65536 ? total_sectors : 0;
+    bpb.TotalSectors32 = total_sectors < 65536 ? 0 : total_sectors;
+    bpb.Media = 0xF8;
+    bpb.FATSize16 = fat_sectors;
+    bpb.SectorsPerTrack = 32;
+    bpb.NumHeads = 2;
+    bpb.DriveNumber = 0x80;
+    bpb.BootSignature = 0x29;
+    bpb.VolumeID = (uint32_t)splitmix64(p->seed);
+    memcpy(bpb.VolumeLabel, "BENCH      ", 11);
+    memcpy(bpb.FileSystemType, "FAT16   ", 8);
+    memcpy(boot, &bpb, sizeof(bpb));
+    boot[510] = 0x55;
+    boot[511] = 0xAA;
+    writer_put(&w, 0, boot, sizeof(boot));
+
+    // Las dos copias de la FAT
+    for (uint32_t k = 0; k < nfats; k++) {
+        writer_put(&w, (uint64_t)(res + k * fat_sectors) * bps, g.fat, (count + 2) * 2);
+    }
+
+    // Directorios: la raíz en su zona fija y el resto en sus clusters
+    uint8_t *dirbuf = NULL;
+    for (uint32_t i = 0; i < t->count; i++) {
+        Node *nd = &t->nodes[i];
+        if (!nd->is_dir) continue;
+        uint32_t n = 0;
+        uint64_t bytes = i == 0 ? root_sectors * bps : ((uint64_t)(nd->nchildren + 2) * 32 + cl - 1) / cl * cl;
+        dirbuf = realloc(dirbuf, bytes);
+        memset(dirbuf, 0, bytes);
+        if (i != 0) {
+            fat_entry(dirbuf, ".", "", ATTR_DIRECTORY, nd->first, 0);
+            fat_entry(dirbuf + 32, "..", "", ATTR_DIRECTORY, nd->parent ? t->nodes[nd->parent].first : 0, 0);
+            n = 2;
+        }
+        for (uint32_t k = 0; k < nd->nchildren; k++, n++) {
+            fat_node_entry(t, nd->children[k], dirbuf + n * 32);
+        }
+        if (i == 0) {
+            writer_put(&w, (uint64_t)(res + nfats * fat_sectors) * bps, dirbuf, bytes);
+        } else {
+            for (uint32_t k = 0; k < bytes / cl; k++) {
+                writer_put(&w, cluster_off(&g, chains[i][k]), dirbuf + k * cl, cl);
+            }
+        }
+    }
+    free(dirbuf);
+
+    // Contenido de los ficheros cluster a cluster
+    uint8_t *clbuf = malloc(cl);
+    for (uint32_t i = 1; i < t->count; i++) {
+        Node *nd = &t->nodes[i];
+        if (nd->is_dir || nd->size == 0) continue;
+        uint32_t n = (nd->size + cl - 1) / cl;
+        for (uint32_t k = 0; k < n; k++) {
+            uint64_t off = (uint64_t)k * cl;
+            size_t len = nd->size - off < cl ? nd->size - off : cl;
+            fill_content(clbuf, len, i, off);
+            writer_put(&w, cluster_off(&g, chains[i][k]), clbuf, len);
+        }
+    }
+    writer_flush(&w);
+    free(clbuf);
+
+    for (uint32_t i = 0; i < t->count; i++) free(chains[i]);
+    free(chains);
+    free(chain);
+    free(g.fat);
+    free(g.order);
+    free(w.buf);
+    close(fd);
+
+    fprintf(stderr, "FAT16: %u clusters de %u bytes, %u usados\n", count, spc * bps, g.next);
+    return 0;
+}
+
+
+// --- EXT2 ---
+
+typedef struct {
+    uint32_t bs;            // Tamaño de bloque
+    uint32_t first_data;    // Primer bloque del grupo 0
+    uint32_t bpg, ipg;      // Bloques e inodos por grupo
+    uint32_t groups, gdt_blocks, itable_blocks;
+    uint32_t blocks;        // Total de bloques
+    uint32_t *order;        // Bloques libres en orden de asignación
+    uint32_t norder, next;
+    uint8_t *block_bitmap;  // Un bit por bloque de toda la imagen
+    uint8_t *inode_bitmap;  // Un bit por inodo de toda la imagen
+    uint32_t *group_dirs;   // Directorios por grupo
+    Writer *w;
+} ExtGen;
+
+// Contenido lógico de un inodo: devuelve el bloque lógico l en buf
+typedef void (*BlockFn)(void *ctx, uint64_t logical, uint8_t *buf);
+
+static uint32_t ext_alloc(ExtGen *g) {
+    uint32_t b = g->order[g->next++];
+    g->block_bitmap[b / 8] |= 1 << (b % 8);
+    return b;
+}
+
+// Bloques de indirección necesarios para nb bloques de datos
+static uint64_t indirect_blocks(uint64_t nb, uint32_t ptrs) {
+    uint64_t n = 0;
+    if (nb <= 12) return 0;
+    nb -= 12;
+    n += 1;                                             // Indirecto simple
+    if (nb <= ptrs) return n;
+    nb -= ptrs;
+    uint64_t pp = (uint64_t)ptrs * ptrs;
+    uint64_t d = nb < pp ? nb : pp;
+    n += 1 + (d + ptrs - 1) / ptrs;                     // Indirecto doble
+    if (nb <= pp) return n;
+    nb -= pp;
+    n += 1 + (nb + pp - 1) / pp + (nb + ptrs - 1) / ptrs; // Indirecto triple
+    return n;
+}
+
+typedef struct {
+    ExtGen *g;
+    BlockFn fn;
+    void *ctx;
+    uint64_t next_logical, nb;
+    uint8_t *buf;
+    uint64_t meta;          // Bloques de indirección usados
+} MapCtx;
+
+static uint32_t map_data(MapCtx *m) {
+    uint32_t b = ext_alloc(m->g);
+    m->fn(m->ctx, m->next_logical++, m->buf);
+    writer_put(m->g->w, (uint64_t)b * m->g->bs, m->buf, m->g->bs);
+    return b;
+}
+
+// Reserva un bloque de indirección de nivel level y lo rellena con sus hijos
+static uint32_t map_indirect(MapCtx *m, int level) {
+    uint32_t ptrs = m->g->bs / 4;
+    uint32_t blk = ext_alloc(m->g);
+    uint32_t *table = calloc(ptrs, sizeof(uint32_t));
+    m->meta++;
+    for (uint32_t i = 0; i < ptrs && m->next_logical < m->nb; i++) {
+        table[i] = level == 1 ? map_data(m) : map_indirect(m, level - 1);
+    }
+    writer_put(m->g->w, (uint64_t)blk * m->g->bs, table, m->g->bs);
+    free(table);
+    return blk;
+}
+
+// Asigna y escribe los nb bloques de un inodo, rellenando i_block e i_blocks
+static void map_inode(ExtGen *g, EXT2_Inode *inode, uint64_t nb, BlockFn fn, void *ctx) {
+    MapCtx m = { g, fn, ctx, 0, nb, malloc(g->bs), 0 };
+    for (int i = 0; i < 12 && m.next_logical < nb; i++) inode->block[i] = map_data(&m);
+    for (int level = 1; level <= 3 && m.next_logical < nb; level++) {
+        inode->block[11 + level] = map_indirect(&m, level);
+    }
+    inode->blocks = (nb + m.meta) * (g->bs / 512);
+    free(m.buf);
+}
+
+typedef struct {
+    uint32_t bs, id;
+    uint64_t size;
+} FileData;
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t bs;
+} DirData;
+
+static void content_block(void *ctx, uint64_t logical, uint8_t *buf) {
+    const FileData *f = ctx;
+    uint64_t off = logical * f->bs;
+    size_t len = f->size - off < f->bs ? f->size - off : f->bs;
+    memset(buf + len, 0, f->bs - len);
+    fill_content(buf, len, f->id, off);
+}
+
+static void dir_block(void *ctx, uint64_t logical, uint8_t *buf) {
+    const DirData *d = ctx;
+    memcpy(buf, d->data + logical * d->bs, d->bs);
+}
+
+static int ext_name(const Tree *t, uint32_t i, char *name, size_t cap) {
+    const Node *nd = &t->nodes[i];
+    if (nd->is_dir) return snprintf(name, cap, "dir%06u", nd->index);
+    if (nd->parent == 0 && nd->index == t->count) return snprintf(name, cap, "big.dat");
+    return snprintf(name, cap, "file%07u.dat", nd->index);
+}
+
+// Empaqueta las entradas de un directorio en bloques: la última de cada bloque
+// alarga su rec_len hasta el final del bloque
+typedef struct {
+    uint8_t *data;
+    uint32_t nblocks, bs;
+    uint32_t pos, last;
+} DirPack;
+
+static void pack_close(DirPack *d) {
+    uint16_t len = d->bs - (d->last % d->bs);
+    memcpy(d->data + d->last + 4, &len, 2);
+}
+
+static void pack_entry(DirPack *d, uint32_t ino, const char *name, uint8_t type) {
+    uint32_t nlen = strlen(name);
+    uint32_t rec = (8 + nlen + 3) & ~3u;
+    if (d->nblocks == 0 || d->pos + rec > d->nblocks * d->bs) {
+        // Cerrar el bloque actual alargando su última entrada y abrir otro
+        if (d->nblocks > 0) pack_close(d);
+        d->data = realloc(d->data, (size_t)(d->nblocks + 1) * d->bs);
+        memset(d->data + (size_t)d->nblocks * d->bs, 0, d->bs);
+        d->pos = d->nblocks * d->bs;
+        d->nblocks++;
+    }
+    uint8_t *e = d->data + d->pos;
+    uint16_t rec16 = rec;
+    memcpy(e, &ino, 4);
+    memcpy(e + 4, &rec16, 2);
+    e[6] = nlen;
+    e[7] = type;
+    memcpy(e + 8, name, nlen);
+    d->last = d->pos;
+    d->pos += rec;
+}
+
+static void mark_inode(ExtGen *g, uint32_t ino) {
+    g->inode_bitmap[(ino - 1) / 8] |= 1 << ((ino - 1) % 8);
+}
+
+static void write_inode(ExtGen *g, uint32_t ino, const EXT2_Inode *inode) {
+    uint32_t group = (ino - 1) / g->ipg;
+    uint32_t index = (ino - 1) % g->ipg;
+    uint64_t table = g->first_data + (uint64_t)group * g->bpg + 1 + g->gdt_blocks + 2;
+    writer_put(g->w, table * g->bs + (uint64_t)index * 128, inode, sizeof(*inode));
+}
+
+static void write_dir(ExtGen *g, const Tree *t, uint32_t i, uint32_t lost_found) {
+    const Node *nd = &t->nodes[i];
+    DirPack d = { NULL, 0, g->bs, 0, 0 };
+    char name[32];
+
+    pack_entry(&d, nd->first, ".", 2);
+    pack_entry(&d, i == 0 ? EXT2_ROOT_INO : t->nodes[nd->parent].first, "..", 2);
+    if (i == 0) pack_entry(&d, lost_found, "lost+found", 2);
+    for (uint32_t k = 0; k < nd->nchildren; k++) {
+        const Node *c = &t->nodes[nd->children[k]];
+        ext_name(t, nd->children[k], name, sizeof(name));
+        pack_entry(&d, c->first, name, c->is_dir ? 2 : 1);
+    }
+    pack_close(&d);
+
+    EXT2_Inode inode = { 0 };
+    inode.mode = EXT2_S_IFDIR | 0755;
+    inode.size = d.nblocks * g->bs;
+    inode.atime = inode.ctime = inode.mtime = TIMESTAMP;
+    inode.links_count = 2 + nd->nsubdirs + (i == 0 ? 1 : 0);
+    DirData dd = { d.data, g->bs };
+    map_inode(g, &inode, d.nblocks, dir_block, &dd);
+    write_inode(g, nd->first, &inode);
+    g->group_dirs[(nd->first - 1) / g->ipg]++;
+    free(d.data);
+}
+
+// Bloques de datos de un directorio, con el mismo empaquetado que write_dir
+static uint64_t dir_blocks(const Tree *t, uint32_t i, uint32_t bs) {
+    const Node *nd = &t->nodes[i];
+    uint64_t blocks = 1, used = 12 + 12 + (i == 0 ? 20 : 0);
+    char name[32];
+    for (uint32_t k = 0; k < nd->nchildren; k++) {
+        uint32_t rec = (8 + ext_name(t, nd->children[k], name, sizeof(name)) + 3) & ~3u;
+        if (used + rec > bs) {
+            blocks++;
+            used = 0;
+        }
+        used += rec;
+    }
+    return blocks;
+}
+
+static int make_ext2(const char *path, const Params *p, Tree *t) {
+    ExtGen g = { 0 };
+    g.bs = p->block_size;
+    g.first_data = g.bs == 1024 ? 1 : 0;
+    g.bpg = g.bs * 8;
+    uint32_t ptrs = g.bs / 4;
+    if (p->big_file) t->nodes[t->count - 1].index = t->count;
+
+    // Inodos: 1..10 reservados, 11 lost+found y uno por nodo (la raíz ya es el 2)
+    uint64_t inodes = 11 + (t->count - 1);
+    uint64_t data = 1;      // lost+found
+    for (uint32_t i = 0; i < t->count; i++) {
+        const Node *nd = &t->nodes[i];
+        uint64_t nb = nd->is_dir ? dir_blocks(t, i, g.bs) : (nd->size + g.bs - 1) / g.bs;
+        data += nb + indirect_blocks(nb, ptrs);
+    }
+
+    // Número de grupos: crecer hasta que quepan datos y metadatos
+    uint64_t avail;
+    for (g.groups = 1;; g.groups++) {
+        uint32_t per_block = g.bs / 128;
+        g.ipg = (inodes + g.groups - 1) / g.groups;
+        if (g.ipg < 16) g.ipg = 16;
+        g.ipg = (g.ipg + per_block - 1) / per_block * per_block;
+        g.ipg = (g.ipg + 7) / 8 * 8;
+        if (g.ipg > g.bpg) continue;
+        g.itable_blocks = g.ipg * 128 / g.bs;
+        g.gdt_blocks = (g.groups * sizeof(EXT2_GroupDesc) + g.bs - 1) / g.bs;
+        uint32_t overhead = 1 + g.gdt_blocks + 2 + g.itable_blocks;
+        if (overhead + 64 > g.bpg) continue;
+        // El último grupo puede ser parcial, pero con margen para no quedar diminuto
+        avail = (uint64_t)g.groups * (g.bpg - overhead);
+        uint64_t want = data + data / 8 + 64;
+        if (avail >= want) {
+            uint64_t spare = avail - want;
+            uint64_t trim = spare > g.bpg - overhead - 64 ? g.bpg - overhead - 64 : spare;
+            g.blocks = g.first_data + (uint64_t)g.groups * g.bpg - trim;
+            break;
+        }
+        if ((uint64_t)g.first_data + (uint64_t)(g.groups + 1) * g.bpg > 0xFFFFFFFFull) {
+            fprintf(stderr, "Demasiados datos para EXT2\n");
+            return -1;
+        }
+    }
+
+    g.block_bitmap = calloc((size_t)g.groups * g.bpg / 8 + 1, 1);
+    g.inode_bitmap = calloc((size_t)g.groups * g.ipg / 8 + 1, 1);
+    g.group_dirs = calloc(g.groups, sizeof(uint32_t));
+    g.order = malloc((size_t)g.blocks * sizeof(uint32_t));
+
+    // Metadatos de cada grupo ocupados; el resto de bloques entra en el orden de asignación
+    for (uint32_t grp = 0; grp < g.groups; grp++) {
+        uint64_t start = g.first_data + (uint64_t)grp * g.bpg;
+        uint64_t meta_end = start + 1 + g.gdt_blocks + 2 + g.itable_blocks;
+        uint64_t end = start + g.bpg < g.blocks ? start + g.bpg : g.blocks;
+        for (uint64_t b = start; b < end; b++) {
+            if (b < meta_end) g.block_bitmap[b / 8] |= 1 << (b % 8);
+            else g.order[g.norder++] = b;
+        }
+    }
+    if (g.first_data) g.block_bitmap[0] |= 1;  // Bloque de arranque (fuera de los grupos)
+    shuffle_free(g.order, g.norder, p->frag);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Error al crear la imagen");
+        return -1;
+    }
+    if (ftruncate(fd, (uint64_t)g.blocks * g.bs) < 0) {
+        perror("Error al dimensionar la imagen");
+        close(fd);
+        return -1;
+    }
+    Writer w = { fd, malloc(WRITE_BUFFER), 0, 0 };
+    g.w = &w;
+
+    // Números de inodo: raíz = 2, lost+found = 11, después directorios y ficheros
+    uint32_t next_ino = 12;
+    t->nodes[0].first = EXT2_ROOT_INO;
+    for (uint32_t i = 1; i < t->count; i++) t->nodes[i].first = next_ino++;
+    for (uint32_t ino = 1; ino < next_ino; ino++) mark_inode(&g, ino);
+    uint32_t lost_found = 11;
+
+    // Directorios primero (quedan juntos al principio) y luego ficheros
+    write_dir(&g, t, 0, lost_found);
+    {
+        DirPack d = { NULL, 0, g.bs, 0, 0 };
+        pack_entry(&d, lost_found, ".", 2);
+        pack_entry(&d, EXT2_ROOT_INO, "..", 2);
+        pack_close(&d);
+        EXT2_Inode inode = { 0 };
+        inode.mode = EXT2_S_IFDIR | 0700;
+        inode.size = g.bs;
+        inode.atime = inode.ctime = inode.mtime = TIMESTAMP;
+        inode.links_count = 2;
+        DirData dd = { d.data, g.bs };
+        map_inode(&g, &inode, 1, dir_block, &dd);
+        write_inode(&g, lost_found, &inode);
+        g.group_dirs[(lost_found - 1) / g.ipg]++;
+        free(d.data);
+    }
+    for (uint32_t i = 1; i < t->count; i++) {
+        if (t->nodes[i].is_dir) write_dir(&g, t, i, lost_found);
+    }
+    int large_file = 0;
+    for (uint32_t i = 1; i < t->count; i++) {
+        const Node *nd = &t->nodes[i];
+        if (nd->is_dir) continue;
+        EXT2_Inode inode = { 0 };
+        inode.mode = EXT2_S_IFREG | 0644;
+        inode.size = (uint32_t)nd->size;
+        inode.dir_acl = (uint32_t)(nd->size >> 32);
+        inode.atime = inode.ctime = inode.mtime = TIMESTAMP;
+        inode.links_count = 1;
+        FileData fd_ctx = { g.bs, i, nd->size };
+        map_inode(&g, &inode, (nd->size + g.bs - 1) / g.bs, content_block, &fd_ctx);
+        if (nd->size >> 31) large_file = 1;
+        write_inode(&g, nd->first, &inode);
+    }
+    uint32_t used_inodes = next_ino - 1;
+
+    // Descriptores de grupo con sus contadores
+    EXT2_GroupDesc *gd = calloc(g.gdt_blocks, g.bs);
+    uint64_t free_blocks = 0;
+    for (uint32_t grp = 0; grp < g.groups; grp++) {
+        uint64_t start = g.first_data + (uint64_t)grp * g.bpg;
+        uint64_t end = start + g.bpg < g.blocks ? start + g.bpg : g.blocks;
+        uint32_t nfree = 0, ifree = 0;
+        for (uint64_t b = start; b < end; b++) {
+            if (!(g.block_bitmap[b / 8] & (1 << (b % 8)))) nfree++;
+        }
+        for (uint32_t k = 0; k < g.ipg; k++) {
+            uint64_t bit = (uint64_t)grp * g.ipg + k;
+            if (!(g.inode_bitmap[bit / 8] & (1 << (bit % 8)))) ifree++;
+        }
+        gd[grp].bg_block_bitmap = start + 1 + g.gdt_blocks;
+        gd[grp].bg_inode_bitmap = start + 2 + g.gdt_blocks;
+        gd[grp].bg_inode_table = start + 3 + g.gdt_blocks;
+        gd[grp].bg_free_blocks_count = nfree;
+        gd[grp].bg_free_inodes_count = ifree;
+        gd[grp].bg_used_dirs_count = g.group_dirs[grp];
+        free_blocks += nfree;
+    }
+
+    EXT2_Superblock sb = { 0 };
+    sb.s_inodes_count = g.groups * g.ipg;
+    sb.s_blocks_count = g.blocks;
+    sb.s_free_blocks_count = free_blocks;
+    sb.s_free_inodes_count = sb.s_inodes_count - used_inodes;
+    sb.s_first_data_block = g.first_data;
+    sb.s_log_block_size = g.bs == 1024 ? 0 : g.bs == 2048 ? 1 : 2;
+    sb.s_log_frag_size = sb.s_log_block_size;
+    sb.s_blocks_per_group = g.bpg;
+    sb.s_frags_per_group = g.bpg;
+    sb.s_inodes_per_group = g.ipg;
+    sb.s_wtime = TIMESTAMP;
+    sb.s_max_mnt_count = 0xFFFF;
+    sb.s_magic = EXT2_SUPER_MAGIC;
+    sb.s_state = 1;
+    sb.s_errors = 1;
+    sb.s_lastcheck = TIMESTAMP;
+    sb.s_rev_level = 1;
+    sb.s_first_ino = 11;
+    sb.s_inode_size = 128;
+    sb.s_feature_incompat = 0x0002;     // filetype: las entradas guardan el tipo
+    if (large_file) sb.s_feature_ro_compat = 0x0002;    // Ficheros de 2 GiB o más
+    for (int k = 0; k < 16; k += 8) {
+        uint64_t v = splitmix64(p->seed + k);
+        memcpy(sb.s_uuid + k, &v, 8);
+    }
+    memcpy(sb.s_volume_name, "bench", 5);
+
+    // Superbloque y descriptores en todos los grupos (sin sparse_super)
+    uint8_t *sbblock = calloc(1, g.bs);
+    for (uint32_t grp = 0; grp < g.groups; grp++) {
+        uint64_t start = g.first_data + (uint64_t)grp * g.bpg;
+        sb.s_block_group_nr = grp;
+        memset(sbblock, 0, g.bs);
+        memcpy(sbblock, &sb, sizeof(sb));
+        // En el grupo 0 con bloques > 1K el superbloque va en el offset 1024 del bloque 0
+        uint64_t sb_off = grp == 0 ? 1024 : start * g.bs;
+        writer_put(&w, sb_off, sbblock, 1024);
+        writer_put(&w, (start + 1) * g.bs, gd, (size_t)g.gdt_blocks * g.bs);
+
+        // Mapas de bits: los bits más allá del final del grupo van a 1
+        uint64_t end = start + g.bpg < g.blocks ? start + g.bpg : g.blocks;
+        memset(sbblock, 0xFF, g.bs);
+        for (uint64_t b = start; b < end; b++) {
+            if (!(g.block_bitmap[b / 8] & (1 << (b % 8)))) sbblock[(b - start) / 8] &= ~(1 << ((b - start) % 8));
+        }
+        writer_put(&w, (start + 1 + g.gdt_blocks) * g.bs, sbblock, g.bs);
+        memset(sbblock, 0xFF, g.bs);
+        for (uint32_t k = 0; k < g.ipg; k++) {
+            uint64_t bit = (uint64_t)grp * g.ipg + k;
+            if (!(g.inode_bitmap[bit / 8] & (1 << (bit % 8)))) sbblock[k / 8] &= ~(1 << (k % 8));
+        }
+        writer_put(&w, (start + 2 + g.gdt_blocks) * g.bs, sbblock, g.bs);
+    }
+    writer_flush(&w);
+
+    free(sbblock);
+    free(gd);
+    free(g.block_bitmap);
+    free(g.inode_bitmap);
+    free(g.group_dirs);
+    free(g.order);
+    free(w.buf);
+    close(fd);
+
+    fprintf(stderr, "EXT2: %u grupos, %u bloques de %u bytes, %u inodos usados\n",
+            g.groups, g.blocks, g.bs, used_inodes);
+    return 0;
+}
+
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s fat16|ext2 <salida> [--files N] [--dirs N] [--depth N] [--min-size B]\n"
+                    "       [--max-size B] [--big-file B] [--frag PCT] [--block-size 1024|2048|4096] [--seed N]\n", prog);
+}
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Params p = { 1000, 50, 4, 0, 8192, 0, 0, 1024, 1 };
+    for (int i = 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        uint64_t v = strtoull(argv[i + 1], NULL, 0);
+        if (strcmp(argv[i], "--files") == 0) p.files = v;
+        else if (strcmp(argv[i], "--dirs") == 0) p.dirs = v;
+        else if (strcmp(argv[i], "--depth") == 0) p.depth = v;
+        else if (strcmp(argv[i], "--min-size") == 0) p.min_size = v;
+        else if (strcmp(argv[i], "--max-size") == 0) p.max_size = v;
+        else if (strcmp(argv[i], "--big-file") == 0) p.big_file = v;
+        else if (strcmp(argv[i], "--frag") == 0) p.frag = v;
+        else if (strcmp(argv[i], "--block-size") == 0) p.block_size = v;
+        else if (strcmp(argv[i], "--seed") == 0) p.seed = v;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (p.depth == 0 || p.max_size < p.min_size || p.frag > 100 ||
+        (p.block_size != 1024 && p.block_size != 2048 && p.block_size != 4096)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    rng_state = p.seed;
+    Tree t;
+    build_tree(&t, &p);
+
+    int ret;
+    if (strcmp(argv[1], "fat16") == 0) {
+        ret = make_fat16(argv[2], &p, &t);
+    } else if (strcmp(argv[1], "ext2") == 0) {
+        ret = make_ext2(argv[2], &p, &t);
+    } else {
+        usage(argv[0]);
+        ret = -1;
+    }
+
+    for (uint32_t i = 0; i < t.count; i++) free(t.nodes[i].children);
+    free(t.nodes);
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+#include "bitmap.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITMAP_X86 1
+#endif
+
+// Cuenta de bits de los mapas de bloques e inodos. El núcleo se elige una vez según la CPU:
+// AVX2 (tabla de nibbles con vpshufb), POPCNT por palabras de 64 bits o SWAR en C portable
+
+typedef uint64_t (*PopcountFn)(const uint8_t *buf, size_t len);
+
+static PopcountFn popcount_fn;
+static const char *popcount_name;
+static pthread_once_t popcount_once = PTHREAD_ONCE_INIT;
+
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static uint64_t load64(const uint8_t *p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+static uint64_t popcount64_swar(uint64_t x) {
+    x -= (x >> 1) & 0x5555555555555555ULL;
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+static uint64_t popcount_scalar(const uint8_t *buf, size_t len) {
+    uint64_t total = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) total += popcount64_swar(load64(buf + i));
+    for (; i < len; i++) total += popcount64_swar(buf[i]);
+    return total;
+}
+
+#ifdef BITMAP_X86
+__attribute__((target("popcnt")))
+static uint64_t popcount_popcnt(const uint8_t *buf, size_t len) {
+    uint64_t total = 0;
+    size_t i = 0;
+    // Cuatro acumuladores para no encadenar las latencias de popcnt
+    uint64_t a = 0, b = 0, c = 0, d = 0;
+    for (; i + 32 <= len; i += 32) {
+        a += (uint64_t)__builtin_popcountll(load64(buf + i));
+        b += (uint64_t)__builtin_popcountll(load64(buf + i + 8));
+        c += (uint64_t)__builtin_popcountll(load64(buf + i + 16));
+        d += (uint64_t)__builtin_popcountll(load64(buf + i + 24));
+    }
+    total = a + b + c + d;
+    for (; i + 8 <= len; i += 8) total += (uint64_t)__builtin_popcountll(load64(buf + i));
+    for (; i < len; i++) total += (uint64_t)__builtin_popcount(buf[i]);
+    return total;
+}
+
+// Cada byte se parte en dos nibbles que se cuentan con una tabla de 16 entradas (vpshufb).
+// Los contadores de 8 bits se vacían con vpsadbw antes de que puedan desbordarse
+__attribute__((target("avx2,popcnt")))
+static uint64_t popcount_avx2(const uint8_t *buf, size_t len) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+
+    while (i + 32 <= len) {
+        __m256i local = _mm256_setzero_si256();
+        // Como mucho 31 vueltas: 31 * 8 < 256
+        for (int k = 0; k < 31 && i + 32 <= len; k++, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+            __m256i lo = _mm256_and_si256(v, low_mask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(table, lo));
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(table, hi));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+
+    uint64_t sum = (uint64_t)_mm256_extract_epi64(total, 0) + (uint64_t)_mm256_extract_epi64(total, 1) +
+                   (uint64_t)_mm256_extract_epi64(total, 2) + (uint64_t)_mm256_extract_epi64(total, 3);
+    return sum + popcount_popcnt(buf + i, len - i);
+}
+#endif
+
+static void choose_kernel(void) {
+    popcount_fn = popcount_scalar;
+    popcount_name = "scalar";
+#ifdef BITMAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        popcount_fn = popcount_avx2;
+        popcount_name = "avx2";
+    } else if (__builtin_cpu_supports("popcnt")) {
+        popcount_fn = popcount_popcnt;
+        popcount_name = "popcnt";
+    }
+#endif
+}
+
+static int log2_floor(uint64_t x) {
+    return 63 - __builtin_clzll(x);
+}
+
+// Cierra un tramo libre de len bits: el primero es la cabecera, el resto son interiores
+static void close_run(BitmapExtents *ex, int *in_head, uint64_t len) {
+    if (*in_head) {
+        ex->head = len;
+        *in_head = 0;
+    } else if (len) {
+        bitmap_hist_add(ex->hist, &ex->largest, len);
+    }
+}
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Nombre del núcleo de cuenta elegido para esta CPU
+const char *bitmap_kernel_name(void) {
+    pthread_once(&popcount_once, choose_kernel);
+    return popcount_name;
+}
+
+// Número de bits a 1 entre los nbits primeros de buf
+uint64_t bitmap_count_set(const uint8_t *buf, uint64_t nbits) {
+    pthread_once(&popcount_once, choose_kernel);
+    uint64_t total = popcount_fn(buf, nbits / 8);
+    if (nbits % 8) total += popcount64_swar(buf[nbits / 8] & ((1u << (nbits % 8)) - 1));
+    return total;
+}
+
+// Suma un tramo libre al histograma
+void bitmap_hist_add(uint64_t *hist, uint64_t *largest, uint64_t len) {
+    if (!len) return;
+    int k = log2_floor(len);
+    if (k >= BITMAP_HIST_BUCKETS) k = BITMAP_HIST_BUCKETS - 1;
+    hist[k]++;
+    if (len > *largest) *largest = len;
+}
+
+// Recorre los tramos de bits a 0 de los nbits primeros de buf por palabras de 64 bits:
+// las palabras llenas o vacías se saltan enteras y en las mixtas se salta de borde en borde
+void bitmap_free_extents(const uint8_t *buf, uint64_t nbits, BitmapExtents *ex) {
+    memset(ex, 0, sizeof(*ex));
+    int in_head = 1;
+    uint64_t run = 0;
+
+    for (uint64_t pos = 0; pos < nbits; pos += 64) {
+        uint64_t valid = nbits - pos < 64 ? nbits - pos : 64;
+        uint64_t w;
+        if (valid == 64) {
+            w = load64(buf + pos / 8);
+        } else {
+            // Última palabra incompleta: los bits que sobran cuentan como usados
+            w = 0;
+            memcpy(&w, buf + pos / 8, (valid + 7) / 8);
+            w |= ~0ULL << valid;
+        }
+
+        if (w == 0) {
+            run += 64;
+            continue;
+        }
+        if (w == ~0ULL) {
+            close_run(ex, &in_head, run);
+            run = 0;
+            continue;
+        }
+
+        // Los bits de fuera están a 1, así que un tramo libre nunca pasa de valid
+        unsigned bit = 0;
+        while (bit < valid) {
+            uint64_t rest = w >> bit;
+            if ((rest & 1) == 0) {
+                unsigned n = rest ? (unsigned)__builtin_ctzll(rest) : 64 - bit;
+                run += n;
+                bit += n;
+            } else {
+                close_run(ex, &in_head, run);
+                run = 0;
+                uint64_t ones = ~rest;
+                bit += ones ? (unsigned)__builtin_ctzll(ones) : 64 - bit;
+            }
+        }
+    }
+
+    if (in_head) {
+        ex->all_free = 1;
+        ex->head = ex->tail = run;
+    } else {
+        ex->tail = run;
+    }
+}
+
+// Une a acc los tramos del mapa que le sigue: la cola de acc y la cabecera de next son
+// el mismo tramo si se tocan
+void bitmap_extents_merge(BitmapExtents *acc, const BitmapExtents *next) {
+    for (int k = 0; k < BITMAP_HIST_BUCKETS; k++) acc->hist[k] += next->hist[k];
+    if (next->largest > acc->largest) acc->largest = next->largest;
+
+    if (acc->all_free && next->all_free) {
+        acc->head = acc->tail = acc->head + next->head;
+    } else if (acc->all_free) {
+        acc->head += next->head;
+        acc->tail = next->tail;
+        acc->all_free = 0;
+    } else if (next->all_free) {
+        acc->tail += next->head;
+    } else {
+        bitmap_hist_add(acc->hist, &acc->largest, acc->tail + next->head);
+        acc->tail = next->tail;
+    }
+}
+
+// Pasa la cabecera y la cola al histograma cuando ya no queda nada que unir
+void bitmap_extents_close(BitmapExtents *ex) {
+    bitmap_hist_add(ex->hist, &ex->largest, ex->head);
+    if (!ex->all_free) bitmap_hist_add(ex->hist, &ex->largest, ex->tail);
+    ex->head = ex->tail = 0;
+    ex->all_free = 0;
+}
+
+// Escribe los cubos no vacíos del histograma ("  lo-hi: n") y devuelve el total de tramos
+uint64_t bitmap_print_hist(FILE *out, const uint64_t *hist) {
+    uint64_t total = 0;
+    for (int k = 0; k < BITMAP_HIST_BUCKETS; k++) {
+        if (!hist[k]) continue;
+        uint64_t lo = 1ULL << k, hi = (2ULL << k) - 1;
+        if (lo == hi) fprintf(out, "  %llu: %llu\n", (unsigned long long)lo, (unsigned long long)hist[k]);
+        else fprintf(out, "  %llu-%llu: %llu\n", (unsigned long long)lo, (unsigned long long)hi,
+                     (unsigned long long)hist[k]);
+        total += hist[k];
+    }
+    return total;
+}
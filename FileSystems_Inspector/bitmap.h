@@ -0,0 +1,31 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+
+// Tramos libres agrupados por potencias de 2: el cubo k cuenta los de longitud [2^k, 2^(k+1))
+#define BITMAP_HIST_BUCKETS 32
+
+// Tramos de bits a 0 (libres) de un mapa de bits. Los de los extremos se guardan aparte
+// para poder unirlos con los de los mapas vecinos
+typedef struct {
+    uint64_t head;              // Bits libres al principio
+    uint64_t tail;              // Bits libres al final
+    int all_free;               // Todo el mapa está libre (head == tail == nbits)
+    uint64_t hist[BITMAP_HIST_BUCKETS];     // Tramos interiores
+    uint64_t largest;           // Tramo más largo de los del histograma
+} BitmapExtents;
+
+
+const char *bitmap_kernel_name(void);
+uint64_t bitmap_count_set(const uint8_t *buf, uint64_t nbits);
+void bitmap_free_extents(const uint8_t *buf, uint64_t nbits, BitmapExtents *ex);
+void bitmap_hist_add(uint64_t *hist, uint64_t *largest, uint64_t len);
+void bitmap_extents_merge(BitmapExtents *acc, const BitmapExtents *next);
+void bitmap_extents_close(BitmapExtents *ex);
+uint64_t bitmap_print_hist(FILE *out, const uint64_t *hist);
+
+#endif
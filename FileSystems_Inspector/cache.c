@@ -0,0 +1,228 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static uint32_t hash_key(uint64_t key) {
+    // Los offsets de bloque comparten los bits bajos: se mezclan antes de repartir
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+static CacheShard *shard_of(BlockCache *cache, uint32_t h) {
+    return &cache->shards[h % CACHE_SHARDS];
+}
+
+static void lru_unlink(CacheEntry *e) {
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+}
+
+static void lru_push_front(CacheShard *s, CacheEntry *e) {
+    CacheEntry *head = &s->lru[e->cls];
+    e->next = head->next;
+    e->prev = head;
+    head->next->prev = e;
+    head->next = e;
+}
+
+static CacheEntry *find(CacheShard *s, uint32_t h, uint64_t key) {
+    for (CacheEntry *e = s->buckets[(h / CACHE_SHARDS) & (s->nbuckets - 1)]; e; e = e->hnext) {
+        if (e->key == key) return e;
+    }
+    return NULL;
+}
+
+static void remove_entry(CacheShard *s, CacheEntry *e) {
+    CacheEntry **p = &s->buckets[(hash_key(e->key) / CACHE_SHARDS) & (s->nbuckets - 1)];
+    while (*p != e) p = &(*p)->hnext;
+    *p = e->hnext;
+    lru_unlink(e);
+    s->bytes -= sizeof(CacheEntry) + e->len;
+    s->evictions++;
+    free(e);
+}
+
+// Libera bloques sin usar desde el final de la LRU: primero datos, después metadatos
+static void evict(CacheShard *s) {
+    for (int cls = CACHE_DATA; cls <= CACHE_META && s->bytes > s->budget; cls++) {
+        CacheEntry *e = s->lru[cls].prev;
+        while (e != &s->lru[cls] && s->bytes > s->budget) {
+            CacheEntry *prev = e->prev;
+            if (e->refs == 0) remove_entry(s, e);
+            e = prev;
+        }
+    }
+}
+
+// Inserta fresh (ya relleno) con una referencia tomada, o lo descarta si el bloque
+// apareció mientras se leía
+static CacheEntry *insert_entry(CacheShard *s, uint32_t h, CacheEntry *fresh, uint64_t key, size_t len, int cls) {
+    fresh->key = key;
+    fresh->len = len;
+    fresh->refs = 1;
+    fresh->cls = cls;
+
+    pthread_mutex_lock(&s->lock);
+    CacheEntry *e = find(s, h, key);
+    if (e) {
+        if (e->len == len) e->refs++;
+        else e = NULL;
+        pthread_mutex_unlock(&s->lock);
+        free(fresh);
+        return e;
+    }
+    CacheEntry **bucket = &s->buckets[(h / CACHE_SHARDS) & (s->nbuckets - 1)];
+    fresh->hnext = *bucket;
+    *bucket = fresh;
+    lru_push_front(s, fresh);
+    s->bytes += sizeof(CacheEntry) + len;
+    evict(s);
+    pthread_mutex_unlock(&s->lock);
+    return fresh;
+}
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+BlockCache *cache_create(size_t budget) {
+    BlockCache *cache = calloc(1, sizeof(BlockCache));
+    if (!cache) return NULL;
+    cache->budget = budget;
+
+    // Cubos suficientes para bloques de 4 KB con el presupuesto completo
+    uint32_t nbuckets = 64;
+    while ((size_t)nbuckets * 4096 * CACHE_SHARDS < budget && nbuckets < (1u << 20)) nbuckets *= 2;
+
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *s = &cache->shards[i];
+        pthread_mutex_init(&s->lock, NULL);
+        s->nbuckets = nbuckets;
+        s->buckets = calloc(nbuckets, sizeof(CacheEntry *));
+        s->budget = budget / CACHE_SHARDS;
+        for (int cls = 0; cls < 2; cls++) s->lru[cls].next = s->lru[cls].prev = &s->lru[cls];
+        if (!s->buckets) {
+            cache_destroy(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+void cache_destroy(BlockCache *cache) {
+    if (!cache) return;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *s = &cache->shards[i];
+        for (int cls = 0; cls < 2 && s->buckets; cls++) {
+            CacheEntry *e = s->lru[cls].next;
+            while (e != &s->lru[cls]) {
+                CacheEntry *next = e->next;
+                free(e);
+                e = next;
+            }
+        }
+        free(s->buckets);
+        pthread_mutex_destroy(&s->lock);
+    }
+    free(cache);
+}
+
+// Busca el bloque en key y, si está con el mismo tamaño, lo devuelve con una referencia
+// tomada (hay que soltarla con cache_release). Cuenta el acierto o el fallo
+CacheEntry *cache_lookup(BlockCache *cache, uint64_t key, size_t len, int cls) {
+    uint32_t h = hash_key(key);
+    CacheShard *s = shard_of(cache, h);
+
+    pthread_mutex_lock(&s->lock);
+    CacheEntry *e = find(s, h, key);
+    if (e && e->len == len) {
+        e->refs++;
+        s->hits[cls]++;
+        // Un bloque pedido como metadato pasa a esa clase aunque se leyera como dato
+        lru_unlink(e);
+        if (cls == CACHE_META) e->cls = CACHE_META;
+        lru_push_front(s, e);
+    } else {
+        e = NULL;
+        s->misses[cls]++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+// Guarda una copia de data como bloque key y la devuelve con una referencia tomada.
+// Si otro hilo lo insertó antes se devuelve el suyo. NULL si no cabe en la caché
+CacheEntry *cache_insert(BlockCache *cache, uint64_t key, size_t len, int cls, const void *data) {
+    uint32_t h = hash_key(key);
+    CacheShard *s = shard_of(cache, h);
+    if (len > s->budget / 4) return NULL;
+
+    CacheEntry *fresh = malloc(sizeof(CacheEntry) + len);
+    if (!fresh) return NULL;
+    memcpy(fresh->data, data, len);
+    return insert_entry(s, h, fresh, key, len, cls);
+}
+
+// Devuelve el bloque en key con una referencia tomada; en un fallo se lee con read
+// fuera del cerrojo. Devuelve NULL si el bloque no cabe en la caché, si ya estaba
+// con otro tamaño o si la lectura falla
+CacheEntry *cache_get(BlockCache *cache, uint64_t key, size_t len, int cls, CacheReadFn read, void *ctx) {
+    uint32_t h = hash_key(key);
+    CacheShard *s = shard_of(cache, h);
+    if (len > s->budget / 4) return NULL;
+
+    CacheEntry *e = cache_lookup(cache, key, len, cls);
+    if (e) return e;
+
+    CacheEntry *fresh = malloc(sizeof(CacheEntry) + len);
+    if (!fresh) return NULL;
+    if (read(ctx, fresh->data, len, key) < 0) {
+        free(fresh);
+        return NULL;
+    }
+    return insert_entry(s, h, fresh, key, len, cls);
+}
+
+void cache_release(BlockCache *cache, CacheEntry *entry) {
+    CacheShard *s = shard_of(cache, hash_key(entry->key));
+    pthread_mutex_lock(&s->lock);
+    entry->refs--;
+    // Se pudo pasar del presupuesto mientras todo estaba en uso
+    if (entry->refs == 0 && s->bytes > s->budget) evict(s);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void cache_stats(BlockCache *cache, CacheStats *out) {
+    memset(out, 0, sizeof(*out));
+    out->budget = cache->budget;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *s = &cache->shards[i];
+        pthread_mutex_lock(&s->lock);
+        for (int cls = 0; cls < 2; cls++) {
+            out->hits[cls] += s->hits[cls];
+            out->misses[cls] += s->misses[cls];
+        }
+        out->evictions += s->evictions;
+        out->bytes += s->bytes;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+void cache_print_stats(BlockCache *cache, FILE *out) {
+    CacheStats st;
+    cache_stats(cache, &st);
+    unsigned long hits = st.hits[CACHE_DATA] + st.hits[CACHE_META];
+    unsigned long misses = st.misses[CACHE_DATA] + st.misses[CACHE_META];
+    fprintf(out, "Block cache: %lu aciertos, %lu fallos (%.1f%% aciertos; metadatos %lu/%lu), "
+                 "%lu expulsiones, %zu/%zu KB en uso\n",
+            hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+            st.hits[CACHE_META], st.hits[CACHE_META] + st.misses[CACHE_META],
+            st.evictions, st.bytes / 1024, st.budget / 1024);
+}
@@ -0,0 +1,62 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+
+
+#define CACHE_SHARDS 16
+
+// Clase de bloque: los de metadatos sólo se expulsan cuando no quedan bloques de datos
+#define CACHE_DATA 0
+#define CACHE_META 1
+
+// Bloque cacheado; mientras refs > 0 no se puede expulsar
+typedef struct CacheEntry {
+    uint64_t key;                       // Offset del bloque en la imagen
+    size_t len;
+    int refs;
+    int cls;                            // CACHE_DATA o CACHE_META
+    struct CacheEntry *hnext;           // Cadena de la tabla hash
+    struct CacheEntry *prev, *next;     // Lista LRU de su clase
+    uint8_t data[];
+} CacheEntry;
+
+// Cada fragmento tiene su cerrojo, su tabla hash y una lista LRU por clase
+typedef struct {
+    pthread_mutex_t lock;
+    CacheEntry **buckets;
+    uint32_t nbuckets;                  // Potencia de 2
+    CacheEntry lru[2];                  // Centinelas: next = más reciente, prev = más antiguo
+    size_t bytes, budget;
+    unsigned long hits[2], misses[2], evictions;
+} CacheShard;
+
+// Caché de bloques con memoria fija repartida entre fragmentos por número de bloque
+typedef struct {
+    CacheShard shards[CACHE_SHARDS];
+    size_t budget;
+} BlockCache;
+
+typedef struct {
+    unsigned long hits[2], misses[2];   // Por clase
+    unsigned long evictions;
+    size_t bytes, budget;
+} CacheStats;
+
+// Lee len bytes de la imagen en offset (para rellenar un fallo)
+typedef int (*CacheReadFn)(void *ctx, void *dst, size_t len, uint64_t offset);
+
+
+BlockCache *cache_create(size_t budget);
+void cache_destroy(BlockCache *cache);
+CacheEntry *cache_lookup(BlockCache *cache, uint64_t key, size_t len, int cls);
+CacheEntry *cache_insert(BlockCache *cache, uint64_t key, size_t len, int cls, const void *data);
+CacheEntry *cache_get(BlockCache *cache, uint64_t key, size_t len, int cls, CacheReadFn read, void *ctx);
+void cache_release(BlockCache *cache, CacheEntry *entry);
+void cache_stats(BlockCache *cache, CacheStats *out);
+void cache_print_stats(BlockCache *cache, FILE *out);
+
+#endif
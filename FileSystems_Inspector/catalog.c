@@ -0,0 +1,727 @@
+#include "catalog.h"
+#include "walk.h"
+#include "find.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Registro que cada directorio deja en su salida del recorrido: los hijos quedan
+// intercalados detrás de su entrada, así el flujo completo sale en preorden
+typedef struct {
+    uint16_t depth;
+    uint16_t name_len;
+    uint32_t mode, ino;
+    uint32_t atime, mtime, ctime;
+    uint64_t size;
+} CatalogRecord;
+
+// Tabla hash de nombres ya guardados (direccionamiento abierto)
+typedef struct {
+    uint32_t *slots;            // Posición + 1 en offs (0 = libre)
+    uint32_t nslots;
+    uint32_t *offs;             // Offset de cada nombre distinto en names
+    uint16_t *lens;
+    uint32_t count, cap;
+    char *names;
+    size_t len, names_cap;
+} NamePool;
+
+// Clave de ordenación del índice por (padre, nombre)
+typedef struct {
+    uint32_t parent;
+    const char *name;
+    uint16_t name_len;
+    uint32_t index;
+} SortKey;
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static void append_record(WalkNode *node, const CatalogRecord *r, const char *name) {
+    walk_append(node, (const char *)r, sizeof(*r));
+    walk_append(node, name, r->name_len);
+}
+
+// --- EXT2: entradas de cada bloque con sus inodos leídos por lotes ---
+typedef struct {
+    Image *img;
+    const EXT2_Superblock *sb;
+    const EXT2_GroupTable *gt;
+} Ext2IndexCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+    uint32_t inos[EXT2_PREFETCH_BATCH];
+    const EXT2_DirEntry *ents[EXT2_PREFETCH_BATCH];
+    size_t n;
+} Ext2IndexBlock;
+
+static void ext2_record(CatalogRecord *r, int depth, size_t name_len, uint32_t ino, const EXT2_Inode *inode) {
+    memset(r, 0, sizeof(*r));
+    r->depth = depth;
+    r->name_len = name_len;
+    r->mode = inode->mode;
+    r->ino = ino;
+    r->atime = inode->atime;
+    r->mtime = inode->mtime;
+    r->ctime = inode->ctime;
+    r->size = EXT2_inode_size(inode);
+}
+
+static void ext2_flush(Ext2IndexBlock *ib) {
+    Ext2IndexCtx *ctx = ib->walk->ctx;
+    WalkNode *node = ib->node;
+    if (ib->n > 1) prefetch_EXT2_inodes(ctx->img, ctx->sb, ctx->gt, ib->inos, ib->n);
+
+    for (size_t i = 0; i < ib->n; i++) {
+        const EXT2_DirEntry *e = ib->ents[i];
+        EXT2_Inode inode;
+        if (read_inode(ctx->img, ctx->sb, ctx->gt, e->inode, &inode) < 0) continue;
+
+        size_t len = strnlen(e->name, e->name_len);
+        CatalogRecord r;
+        ext2_record(&r, node->depth, len, e->inode, &inode);
+        append_record(node, &r, e->name);
+
+        // Igual que --tree: se baja por las entradas marcadas como directorio
+        if (e->file_type == EXT2_FT_DIR) walk_child(ib->walk, node, e->inode, node->depth + 1);
+    }
+    ib->n = 0;
+}
+
+static void ext2_index_block(const uint8_t *buf, uint32_t block_size, void *arg) {
+    Ext2IndexBlock *ib = arg;
+    uint32_t pos = 0;
+
+    while (pos + 8 <= block_size) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
+
+        int dot = (e->name_len == 1 && e->name[0] == '.') ||
+                  (e->name_len == 2 && e->name[0] == '.' && e->name[1] == '.');
+        if (e->inode != 0 && !dot) {
+            ib->inos[ib->n] = e->inode;
+            ib->ents[ib->n++] = e;
+            if (ib->n == EXT2_PREFETCH_BATCH) ext2_flush(ib);
+        }
+        pos += e->rec_len;
+    }
+    // Los punteros a las entradas solo valen mientras el bloque está a la vista
+    ext2_flush(ib);
+}
+
+static void ext2_index_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    Ext2IndexCtx *ctx = walk->ctx;
+    EXT2_Inode inode;
+    if (read_inode(ctx->img, ctx->sb, ctx->gt, (uint32_t)node->key, &inode) < 0) return;
+
+    Ext2IndexBlock ib;
+    ib.walk = walk;
+    ib.node = node;
+    ib.n = 0;
+    for_each_directory_block(ctx->img, ctx->sb, &inode, ext2_index_block, &ib);
+}
+
+// --- FAT16: las entradas ya traen tamaño, atributos y fechas ---
+typedef struct {
+    Image *img;
+    const FAT16_BPB *bpb;
+    FAT16_Table *fat;
+} Fat16IndexCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+} Fat16IndexEntry;
+
+static int fat16_index_entry(const uint8_t *entry, void *arg) {
+    Fat16IndexEntry *ie = arg;
+    WalkNode *node = ie->node;
+    char name[13];
+    int len = format_entry_name(entry, name);
+
+    CatalogRecord r;
+    memset(&r, 0, sizeof(r));
+    r.depth = node->depth;
+    r.name_len = len;
+    r.mode = entry[11];
+    r.ino = entry[26] | (entry[27] << 8);
+    r.size = entry[28] | (entry[29] << 8) | (entry[30] << 16) | ((uint32_t)entry[31] << 24);
+    r.ctime = FAT16_time(entry[16] | (entry[17] << 8), entry[14] | (entry[15] << 8));
+    r.atime = FAT16_time(entry[18] | (entry[19] << 8), 0);
+    r.mtime = FAT16_time(entry[24] | (entry[25] << 8), entry[22] | (entry[23] << 8));
+    append_record(node, &r, name);
+
+    // Igual que --tree: "." y ".." se guardan pero no se recorren
+    if ((entry[11] & ATTR_DIRECTORY) && entry[0] != '.' && r.ino != 0) {
+        walk_child(ie->walk, node, r.ino, node->depth + 1);
+    }
+    return 0;
+}
+
+static void fat16_index_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    Fat16IndexCtx *ctx = walk->ctx;
+    Fat16IndexEntry ie = { walk, node };
+    for_each_dir_entry(ctx->img, ctx->bpb, ctx->fat, (uint16_t)node->key, fat16_index_entry, &ie);
+}
+
+// --- Construcción del fichero ---
+static uint32_t hash_name(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int pool_grow(NamePool *np) {
+    uint32_t nslots = np->nslots ? np->nslots * 2 : 1024;
+    uint32_t *slots = calloc(nslots, sizeof(uint32_t));
+    if (!slots) return -1;
+    for (uint32_t i = 0; i < np->count; i++) {
+        uint32_t h = hash_name(np->names + np->offs[i], np->lens[i]) & (nslots - 1);
+        while (slots[h]) h = (h + 1) & (nslots - 1);
+        slots[h] = i + 1;
+    }
+    free(np->slots);
+    np->slots = slots;
+    np->nslots = nslots;
+    return 0;
+}
+
+// Devuelve el offset del nombre en el almacén, guardándolo solo la primera vez
+static int64_t intern_name(NamePool *np, const char *name, size_t len) {
+    if ((np->count + 1) * 2 > np->nslots && pool_grow(np) < 0) return -1;
+
+    uint32_t h = hash_name(name, len) & (np->nslots - 1);
+    while (np->slots[h]) {
+        uint32_t i = np->slots[h] - 1;
+        if (np->lens[i] == len && memcmp(np->names + np->offs[i], name, len) == 0) return np->offs[i];
+        h = (h + 1) & (np->nslots - 1);
+    }
+
+    if (np->count == np->cap) {
+        uint32_t cap = np->cap ? np->cap * 2 : 1024;
+        uint32_t *offs = realloc(np->offs, cap * sizeof(uint32_t));
+        if (!offs) return -1;
+        np->offs = offs;
+        uint16_t *lens = realloc(np->lens, cap * sizeof(uint16_t));
+        if (!lens) return -1;
+        np->lens = lens;
+        np->cap = cap;
+    }
+    if (np->len + len > np->names_cap) {
+        size_t cap = np->names_cap ? np->names_cap : 4096;
+        while (cap < np->len + len) cap *= 2;
+        char *names = realloc(np->names, cap);
+        if (!names) return -1;
+        np->names = names;
+        np->names_cap = cap;
+    }
+    memcpy(np->names + np->len, name, len);
+    np->offs[np->count] = (uint32_t)np->len;
+    np->lens[np->count] = (uint16_t)len;
+    np->slots[h] = ++np->count;
+    np->len += len;
+    return np->offs[np->count - 1];
+}
+
+static void free_pool(NamePool *np) {
+    free(np->slots);
+    free(np->offs);
+    free(np->lens);
+    free(np->names);
+}
+
+static int cmp_sort_key(const void *a, const void *b) {
+    const SortKey *x = a, *y = b;
+    if (x->parent != y->parent) return x->parent < y->parent ? -1 : 1;
+    size_t n = x->name_len < y->name_len ? x->name_len : y->name_len;
+    int c = memcmp(x->name, y->name, n);
+    if (c != 0) return c;
+    if (x->name_len != y->name_len) return x->name_len < y->name_len ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static int write_all(int fd, const void *p, size_t len) {
+    const uint8_t *b = p;
+    while (len > 0) {
+        ssize_t n = write(fd, b, len);
+        if (n < 0) return -1;
+        b += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Convierte el flujo de registros en preorden en las tablas del catálogo y lo escribe
+static int build_catalog(const char *path, CatalogHeader *hdr, const CatalogRecord *root,
+                         const char *stream, size_t stream_len) {
+    size_t cap = 1024, count = 0;
+    CatalogEntry *entries = malloc(cap * sizeof(CatalogEntry));
+    NamePool np;
+    memset(&np, 0, sizeof(np));
+    uint32_t *parents = calloc(UINT16_MAX + 1, sizeof(uint32_t));  // Última entrada de cada profundidad
+    int ret = -1;
+    SortKey *keys = NULL;
+    uint32_t *sorted = NULL;
+    if (!entries || !parents) goto out;
+
+    // La raíz es la entrada 0, con nombre vacío
+    memset(&entries[0], 0, sizeof(CatalogEntry));
+    entries[0].mode = root->mode;
+    entries[0].ino = root->ino;
+    entries[0].atime = root->atime;
+    entries[0].mtime = root->mtime;
+    entries[0].ctime = root->ctime;
+    entries[0].size = root->size;
+    parents[0] = 0;
+    count = 1;
+
+    for (size_t pos = 0; pos + sizeof(CatalogRecord) <= stream_len; count++) {
+        CatalogRecord r;
+        memcpy(&r, stream + pos, sizeof(r));
+        const char *name = stream + pos + sizeof(r);
+        pos += sizeof(r) + r.name_len;
+        if (r.depth == 0 || pos > stream_len) break;
+
+        if (count == cap) {
+            cap *= 2;
+            CatalogEntry *grown = realloc(entries, cap * sizeof(CatalogEntry));
+            if (!grown) goto out;
+            entries = grown;
+        }
+        int64_t off = intern_name(&np, name, r.name_len);
+        if (off < 0) goto out;
+
+        CatalogEntry *e = &entries[count];
+        e->parent = parents[r.depth - 1];
+        e->name_off = (uint32_t)off;
+        e->name_len = r.name_len;
+        e->depth = r.depth;
+        e->mode = r.mode;
+        e->ino = r.ino;
+        e->atime = r.atime;
+        e->mtime = r.mtime;
+        e->ctime = r.ctime;
+        e->size = r.size;
+        parents[r.depth] = (uint32_t)count;
+    }
+
+    // Índice por (padre, nombre) para resolver rutas con búsqueda binaria
+    keys = malloc(count * sizeof(SortKey));
+    sorted = malloc(count * sizeof(uint32_t));
+    if (!keys || !sorted) goto out;
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = (SortKey){ entries[i].parent, np.names + entries[i].name_off, entries[i].name_len, (uint32_t)i };
+    }
+    qsort(keys, count, sizeof(SortKey), cmp_sort_key);
+    for (size_t i = 0; i < count; i++) sorted[i] = keys[i].index;
+
+    memcpy(hdr->magic, CATALOG_MAGIC, sizeof(hdr->magic));
+    hdr->version = CATALOG_VERSION;
+    hdr->count = (uint32_t)count;
+    hdr->entries_off = sizeof(CatalogHeader);
+    hdr->sorted_off = hdr->entries_off + count * sizeof(CatalogEntry);
+    hdr->names_off = hdr->sorted_off + count * sizeof(uint32_t);
+    hdr->names_len = np.len;
+
+    // Se escribe a un temporal y se renombra: quien lo tenga abierto nunca ve uno a medias
+    size_t plen = strlen(path);
+    char *tmp = malloc(plen + 5);
+    if (!tmp) goto out;
+    memcpy(tmp, path, plen);
+    memcpy(tmp + plen, ".tmp", 5);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("No se pudo crear el catálogo");
+        free(tmp);
+        goto out;
+    }
+    if (write_all(fd, hdr, sizeof(*hdr)) < 0 ||
+        write_all(fd, entries, count * sizeof(CatalogEntry)) < 0 ||
+        write_all(fd, sorted, count * sizeof(uint32_t)) < 0 ||
+        write_all(fd, np.names, np.len) < 0 ||
+        close(fd) < 0 || rename(tmp, path) < 0) {
+        perror("Error al escribir el catálogo");
+        unlink(tmp);
+        free(tmp);
+        goto out;
+    }
+    free(tmp);
+    fprintf(stderr, "Catálogo: %zu entradas, %u nombres distintos\n", count, np.count);
+    ret = 0;
+
+out:
+    free(parents);
+    free(entries);
+    free(keys);
+    free(sorted);
+    free_pool(&np);
+    return ret;
+}
+
+// Rellena la identidad de la imagen en la cabecera: sistema de archivos y fichero
+static int image_identity(Image *img, const Filesystem *fs, CatalogHeader *hdr) {
+    memset(hdr, 0, sizeof(*hdr));
+    struct stat st;
+    if (fstat(img->fd, &st) < 0) {
+        perror("fstat");
+        return -1;
+    }
+    hdr->image_mtime_sec = st.st_mtim.tv_sec;
+    hdr->image_mtime_nsec = st.st_mtim.tv_nsec;
+    hdr->image_size = img->size;
+
+    if (fs_is(fs, FS_EXT2)) {
+        hdr->fs_type = CATALOG_EXT2;
+        memcpy(hdr->fs_id, fs->sb.s_uuid, sizeof(hdr->fs_id));
+        hdr->fs_wtime = fs->sb.s_wtime;
+        return 0;
+    }
+    if (fs_is(fs, FS_FAT16)) {
+        hdr->fs_type = CATALOG_FAT16;
+        memcpy(hdr->fs_id, &fs->bpb.VolumeID, sizeof(fs->bpb.VolumeID));
+        return 0;
+    }
+    fprintf(stderr, "\nNot supported file system. Only FAT16 and EXT2 are supported.\n");
+    return -1;
+}
+
+// Nombre de un componente tal y como está en el catálogo (en FAT16, el 8.3 en mayúsculas)
+static size_t catalog_name(const Catalog *cat, const char *tok, size_t len, char *out, size_t cap) {
+    if (cat->hdr->fs_type == CATALOG_FAT16) {
+        char comp[256];
+        uint8_t name11[11];
+        if (len >= sizeof(comp)) len = sizeof(comp) - 1;
+        memcpy(comp, tok, len);
+        comp[len] = '\0';
+        format_name(comp, name11);
+        char name[13];
+        size_t n = format_entry_name(name11, name);
+        memcpy(out, name, n);
+        return n;
+    }
+    if (len > cap) len = cap;
+    memcpy(out, tok, len);
+    return len;
+}
+
+// Nombre de la entrada i, o NULL si el catálogo está dañado
+static const char *entry_name(const Catalog *cat, uint32_t i) {
+    if (i >= cat->hdr->count) return NULL;
+    const CatalogEntry *e = &cat->entries[i];
+    if ((uint64_t)e->name_off + e->name_len > cat->hdr->names_len) return NULL;
+    return cat->names + e->name_off;
+}
+
+// Búsqueda binaria del hijo de parent que se llama name (-2 si el catálogo está dañado)
+static long find_child(const Catalog *cat, uint32_t parent, const char *name, size_t len) {
+    size_t lo = 0, hi = cat->hdr->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *ename = entry_name(cat, cat->sorted[mid]);
+        if (!ename) return -2;
+        const CatalogEntry *e = &cat->entries[cat->sorted[mid]];
+        int c;
+        if (e->parent != parent) {
+            c = e->parent < parent ? -1 : 1;
+        } else {
+            size_t n = e->name_len < len ? e->name_len : len;
+            c = memcmp(ename, name, n);
+            if (c == 0 && e->name_len != len) c = e->name_len < len ? -1 : 1;
+            // La raíz es su propio padre: no cuenta como hija
+            if (c == 0 && cat->sorted[mid] == 0) c = -1;
+        }
+        if (c == 0) return cat->sorted[mid];
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// --index: recorre la imagen una vez (con jobs hilos) y guarda el catálogo en path
+int catalog_write(Image *img, const Filesystem *fs, const char *path, int jobs) {
+    CatalogHeader hdr;
+    if (image_identity(img, fs, &hdr) < 0) return -1;
+
+    OutWriter stream;
+    if (out_init_mem(&stream) < 0) return -1;
+
+    CatalogRecord root;
+    memset(&root, 0, sizeof(root));
+    int ret = -1;
+
+    if (hdr.fs_type == CATALOG_EXT2) {
+        EXT2_GroupTable gt;
+        if (read_group_descriptors(img, &gt, &fs->sb) == 0) {
+            EXT2_Inode inode;
+            if (read_inode(img, &fs->sb, &gt, EXT2_ROOT_INO, &inode) == 0) {
+                ext2_record(&root, 0, 0, EXT2_ROOT_INO, &inode);
+                Ext2IndexCtx ctx = { img, &fs->sb, &gt };
+                ret = walk_run(jobs, ext2_index_job, &ctx, EXT2_ROOT_INO, 1, &stream);
+            }
+            free(gt.desc);
+        }
+    } else {
+        FAT16_Table fat;
+        if (load_FAT16_table(img, &fs->bpb, &fat) == 0) {
+            root.mode = ATTR_DIRECTORY;
+            Fat16IndexCtx ctx = { img, &fs->bpb, &fat };
+            ret = walk_run(jobs, fat16_index_job, &ctx, 0, 1, &stream);
+            free_FAT16_table(&fat);
+        }
+    }
+
+    if (ret == 0) ret = build_catalog(path, &hdr, &root, stream.buf, stream.len);
+    out_free(&stream);
+    return ret;
+}
+
+// Abre y proyecta el catálogo. Devuelve -1 si no es válido y -2 si no corresponde
+// a la imagen tal y como está ahora (otro sistema de archivos o imagen modificada)
+int catalog_open(Catalog *cat, const char *path, Image *img, const Filesystem *fs) {
+    memset(cat, 0, sizeof(*cat));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("No se pudo abrir el catálogo");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CatalogHeader)) {
+        fprintf(stderr, "Catálogo no válido: %s\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap del catálogo");
+        return -1;
+    }
+    cat->map = map;
+    cat->map_size = st.st_size;
+    cat->hdr = map;
+
+    // Todas las tablas tienen que caber en el fichero y apuntar dentro de él
+    const CatalogHeader *h = cat->hdr;
+    uint64_t size = st.st_size;
+    int ok = memcmp(h->magic, CATALOG_MAGIC, sizeof(h->magic)) == 0 && h->version == CATALOG_VERSION &&
+             h->count > 0 &&
+             h->entries_off == sizeof(CatalogHeader) &&
+             h->sorted_off == h->entries_off + (uint64_t)h->count * sizeof(CatalogEntry) &&
+             h->names_off == h->sorted_off + (uint64_t)h->count * sizeof(uint32_t) &&
+             h->names_off <= size && h->names_len <= size - h->names_off;
+    if (ok) {
+        // Las entradas se comprueban al usarlas: abrir no recorre el fichero entero
+        cat->entries = (const CatalogEntry *)(cat->map + h->entries_off);
+        cat->sorted = (const uint32_t *)(cat->map + h->sorted_off);
+        cat->names = (const char *)(cat->map + h->names_off);
+    }
+    if (!ok) {
+        fprintf(stderr, "Catálogo no válido: %s\n", path);
+        catalog_close(cat);
+        return -1;
+    }
+
+    CatalogHeader now;
+    if (image_identity(img, fs, &now) < 0) {
+        catalog_close(cat);
+        return -1;
+    }
+    if (now.fs_type != h->fs_type || memcmp(now.fs_id, h->fs_id, sizeof(now.fs_id)) != 0 ||
+        now.fs_wtime != h->fs_wtime || now.image_size != h->image_size ||
+        now.image_mtime_sec != h->image_mtime_sec || now.image_mtime_nsec != h->image_mtime_nsec) {
+        fprintf(stderr, "El catálogo %s no corresponde a la imagen actual (hay que regenerarlo con --index)\n", path);
+        catalog_close(cat);
+        return -2;
+    }
+    return 0;
+}
+
+void catalog_close(Catalog *cat) {
+    if (cat->map) munmap((void *)cat->map, cat->map_size);
+    memset(cat, 0, sizeof(*cat));
+}
+
+// Resuelve una ruta absoluta con una búsqueda binaria por componente.
+// Devuelve el índice de la entrada o -1 si no existe
+long catalog_lookup(const Catalog *cat, const char *path) {
+    long cur = 0;
+    const char *p = path;
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+
+        char name[256];
+        size_t n = catalog_name(cat, p, len, name, sizeof(name));
+        cur = find_child(cat, (uint32_t)cur, name, n);
+        if (cur == -2) {
+            fprintf(stderr, "Catálogo dañado\n");
+            return -1;
+        }
+        if (cur < 0) {
+            fprintf(stderr, "No encontrado: %.*s\n", (int)len, p);
+            return -1;
+        }
+        p += len;
+    }
+    return cur;
+}
+
+// --tree desde el catálogo: las entradas ya están en el orden del recorrido
+int catalog_tree(const Catalog *cat) {
+    OutWriter out;
+    if (out_init(&out, STDOUT_FILENO) < 0) return -1;
+    fflush(stdout);
+
+    // Mismo formato que el --tree de cada sistema de archivos
+    int ext2 = cat->hdr->fs_type == CATALOG_EXT2;
+    const char *branch = ext2 ? "|__ " : "├── ";
+    size_t branch_len = strlen(branch);
+    int base = ext2 ? 0 : -1;
+
+    out_write(&out, ".\n", 2);
+    int ret = 0;
+    for (uint32_t i = 1; i < cat->hdr->count; i++) {
+        const char *name = entry_name(cat, i);
+        if (!name) {
+            fprintf(stderr, "Catálogo dañado\n");
+            ret = -1;
+            break;
+        }
+        const CatalogEntry *e = &cat->entries[i];
+        out_line(&out, e->depth + base, branch, branch_len, name, e->name_len);
+    }
+    out_free(&out);
+    return ret;
+}
+
+// --cat resolviendo la ruta en el catálogo: de la imagen solo se leen los datos
+// (en EXT2, además, el inodo del fichero para sus bloques)
+int catalog_cat(const Catalog *cat, Image *img, const Filesystem *fs, const char *path) {
+    long idx = catalog_lookup(cat, path);
+    if (idx < 0) return -1;
+    const CatalogEntry *e = &cat->entries[idx];
+
+    if (cat->hdr->fs_type == CATALOG_EXT2) {
+        if ((e->mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+            fprintf(stderr, "Es un directorio: %s\n", path);
+            return -1;
+        }
+        EXT2_GroupTable gt;
+        EXT2_Inode inode;
+        if (read_group_descriptors(img, &gt, &fs->sb) < 0) return -1;
+        int ret = read_inode(img, &fs->sb, &gt, e->ino, &inode);
+        if (ret == 0) {
+            fflush(stdout);
+            ret = dump_EXT2_inode(img, &fs->sb, &inode, STDOUT_FILENO);
+        }
+        free(gt.desc);
+        return ret;
+    }
+
+    FAT16_Table fat;
+    if (load_FAT16_table(img, &fs->bpb, &fat) < 0) return -1;
+    fflush(stdout);
+    int64_t ret = dump_FAT16_file(img, &fs->bpb, &fat, (uint16_t)e->ino, (uint32_t)e->size, STDOUT_FILENO);
+    free_FAT16_table(&fat);
+    return ret < 0 ? -1 : 0;
+}
+
+// --find sobre el catálogo: las entradas se recorren en orden y las rutas se van
+// construyendo con una pila de prefijos por profundidad, sin leer la imagen
+int catalog_find(const Catalog *cat, const char *path, FindQuery *q) {
+    int fat = cat->hdr->fs_type == CATALOG_FAT16;
+    long start = catalog_lookup(cat, path);
+    if (start < 0) return -1;
+    const CatalogEntry *root = &cat->entries[start];
+    int root_dir = fat ? (root->mode & ATTR_DIRECTORY) != 0 : (root->mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+    if (!root_dir) {
+        fprintf(stderr, "No es un directorio: %s\n", path);
+        return -1;
+    }
+    if (find_prepare(q, fat) < 0) return -1;
+
+    char *prefix = find_root(path);
+    size_t *ends = calloc(UINT16_MAX + 2, sizeof(size_t));   // Longitud del prefijo de cada profundidad
+    size_t cap = 4096;
+    char *buf = malloc(cap);
+    OutWriter out;
+    int ret = -1;
+    if (!prefix || !ends || !buf || out_init(&out, STDOUT_FILENO) < 0) goto done;
+    fflush(stdout);
+
+    size_t plen = strlen(prefix);
+    if (plen == 1) plen = 0;                // La raíz: los hijos quedan como "/nombre"
+    memcpy(buf, prefix, plen);
+    ends[root->depth] = plen;
+
+    long found = 0;
+    ret = 0;
+    // El subárbol de start son las entradas siguientes con más profundidad
+    for (uint32_t i = (uint32_t)start + 1; i < cat->hdr->count; i++) {
+        const CatalogEntry *e = &cat->entries[i];
+        if (e->depth <= root->depth) break;
+        const char *name = entry_name(cat, i);
+        if (!name) {
+            fprintf(stderr, "Catálogo dañado\n");
+            ret = -1;
+            break;
+        }
+
+        // Ruta de la entrada: prefijo de su padre + "/" + nombre
+        size_t base = ends[e->depth - 1];
+        if (base + 1 + e->name_len > cap) {
+            while (cap < base + 1 + e->name_len) cap *= 2;
+            char *grown = realloc(buf, cap);
+            if (!grown) {
+                ret = -1;
+                break;
+            }
+            buf = grown;
+        }
+        buf[base] = '/';
+        memcpy(buf + base + 1, name, e->name_len);
+        ends[e->depth] = base + 1 + e->name_len;
+
+        int is_dir, is_reg;
+        if (fat) {
+            if (name[0] == '.' || ((e->mode & 0x08) && !(e->mode & ATTR_DIRECTORY))) continue;
+            is_dir = (e->mode & ATTR_DIRECTORY) != 0;
+            is_reg = !is_dir;
+        } else {
+            is_dir = (e->mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+            is_reg = (e->mode & EXT2_S_IFMT) == EXT2_S_IFREG;
+        }
+        if (find_match_name(q, name, e->name_len) && find_match_type(q, is_dir, is_reg) &&
+            find_match_meta(q, e->size, e->mtime)) {
+            out_write(&out, buf, ends[e->depth]);
+            out_write(&out, "\n", 1);
+            if (q->max_results > 0 && ++found >= q->max_results) break;
+        }
+    }
+    out_free(&out);
+
+done:
+    free(prefix);
+    free(ends);
+    free(buf);
+    find_free(q);
+    return ret;
+}
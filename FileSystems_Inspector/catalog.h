@@ -0,0 +1,68 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "image.h"
+#include "out.h"
+#include "find.h"
+#include "fs.h"
+
+
+#define CATALOG_MAGIC "FSICAT01"
+#define CATALOG_VERSION 1
+
+#define CATALOG_EXT2 1
+#define CATALOG_FAT16 2
+
+// Cabecera del catálogo. Identifica la imagen de la que sale: si cambia el sistema
+// de archivos (s_wtime/UUID o VolumeID) o el fichero de imagen (mtime, tamaño), está caducado
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t fs_type;           // CATALOG_EXT2 / CATALOG_FAT16
+    uint8_t fs_id[16];          // UUID de EXT2 o VolumeID de FAT16
+    uint32_t fs_wtime;          // s_wtime de EXT2 (0 en FAT16)
+    uint32_t count;             // Entradas, la raíz incluida
+    int64_t image_mtime_sec;
+    int64_t image_mtime_nsec;
+    uint64_t image_size;
+    uint64_t entries_off;       // CatalogEntry[count], en preorden (el orden de --tree)
+    uint64_t sorted_off;        // uint32_t[count]: índices ordenados por (padre, nombre)
+    uint64_t names_off;         // Nombres sin repetir, sin terminador
+    uint64_t names_len;
+} CatalogHeader;
+
+// Una entrada del árbol. Los tiempos son segundos Unix (en FAT16, la hora local guardada)
+typedef struct {
+    uint32_t parent;            // Índice del directorio padre (la raíz es la 0 y su propio padre)
+    uint32_t name_off;
+    uint16_t name_len;
+    uint16_t depth;             // 0 = raíz
+    uint32_t mode;              // i_mode de EXT2 o atributos de FAT16
+    uint32_t ino;               // Inodo de EXT2 o primer cluster de FAT16
+    uint32_t atime, mtime, ctime;
+    uint64_t size;
+} CatalogEntry;
+
+// Catálogo abierto: todo apunta dentro de la proyección del fichero
+typedef struct {
+    const uint8_t *map;
+    size_t map_size;
+    const CatalogHeader *hdr;
+    const CatalogEntry *entries;
+    const uint32_t *sorted;
+    const char *names;
+} Catalog;
+
+
+int catalog_write(Image *img, const Filesystem *fs, const char *path, int jobs);
+int catalog_open(Catalog *cat, const char *path, Image *img, const Filesystem *fs);
+void catalog_close(Catalog *cat);
+long catalog_lookup(const Catalog *cat, const char *path);
+int catalog_tree(const Catalog *cat);
+int catalog_cat(const Catalog *cat, Image *img, const Filesystem *fs, const char *path);
+int catalog_find(const Catalog *cat, const char *path, FindQuery *q);
+
+#endif
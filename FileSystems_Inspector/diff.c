@@ -0,0 +1,143 @@
+#include "diff.h"
+#include "find.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parte común de --diff: las entradas de cada par de directorios se ordenan por nombre y se
+// cruzan. Lo que sólo está en una imagen se escribe ("-" borrado, "+" añadido); los
+// subdirectorios comunes pasan a ser nodos del recorrido y los ficheros comunes los compara
+// el sistema de archivos
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static int cmp_entry(const void *a, const void *b) {
+    return strcmp(((const DiffEntry *)a)->name, ((const DiffEntry *)b)->name);
+}
+
+// Escribe "<tipo>\t<ruta>" (con "/" al final si es un directorio)
+static void report(WalkNode *node, char kind, const char *path, int is_dir) {
+    char prefix[2] = { kind, '\t' };
+    walk_append(node, prefix, 2);
+    walk_append(node, path, strlen(path));
+    walk_append(node, is_dir ? "/\n" : "\n", is_dir ? 2 : 1);
+}
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Añade una entrada con una copia de su nombre. raw (32 bytes) puede ser NULL
+int diff_list_add(DiffList *list, const char *name, size_t len, uint64_t key, int is_dir, const uint8_t *raw) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        DiffEntry *items = realloc(list->items, cap * sizeof(DiffEntry));
+        if (!items) {
+            perror("realloc");
+            return -1;
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+    DiffEntry *e = &list->items[list->count];
+    e->name = malloc(len + 1);
+    if (!e->name) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(e->name, name, len);
+    e->name[len] = '\0';
+    e->key = key;
+    e->is_dir = is_dir;
+    if (raw) memcpy(e->raw, raw, sizeof(e->raw));
+    else memset(e->raw, 0, sizeof(e->raw));
+    list->count++;
+    return 0;
+}
+
+void diff_list_free(DiffList *list) {
+    for (size_t i = 0; i < list->count; i++) free(list->items[i].name);
+    free(list->items);
+    list->items = NULL;
+    list->count = list->cap = 0;
+}
+
+DiffDir *diff_dir_new(const char *path, uint64_t key_b) {
+    DiffDir *dir = malloc(sizeof(DiffDir));
+    if (!dir) return NULL;
+    dir->path = strdup(path);
+    if (!dir->path) {
+        free(dir);
+        return NULL;
+    }
+    dir->key_b = key_b;
+    return dir;
+}
+
+// Cruza las entradas de los dos directorios del nodo. Un directorio que sólo está en una
+// imagen se escribe una vez, sin bajar por él
+void diff_merge(Walk *walk, WalkNode *node, DiffList *a, DiffList *b) {
+    DiffCtx *ctx = walk->ctx;
+    const DiffDir *dir = node->data;
+    if (a->count > 1) qsort(a->items, a->count, sizeof(DiffEntry), cmp_entry);
+    if (b->count > 1) qsort(b->items, b->count, sizeof(DiffEntry), cmp_entry);
+
+    size_t i = 0, j = 0;
+    while (i < a->count || j < b->count) {
+        int c = i == a->count ? 1 : j == b->count ? -1 : strcmp(a->items[i].name, b->items[j].name);
+        const DiffEntry *ea = c <= 0 ? &a->items[i] : NULL;
+        const DiffEntry *eb = c >= 0 ? &b->items[j] : NULL;
+        const DiffEntry *any = ea ? ea : eb;
+
+        char *path = find_join(dir->path, any->name, strlen(any->name));
+        if (!path) break;
+        if (!eb) {
+            report(node, '-', path, ea->is_dir);
+            __atomic_add_fetch(&ctx->removed, 1, __ATOMIC_RELAXED);
+        } else if (!ea) {
+            report(node, '+', path, eb->is_dir);
+            __atomic_add_fetch(&ctx->added, 1, __ATOMIC_RELAXED);
+        } else if (ea->is_dir && eb->is_dir) {
+            DiffDir *child = diff_dir_new(path, eb->key);
+            if (child && !walk_child_data(walk, node, ea->key, node->depth + 1, child)) {
+                free(child->path);
+                free(child);
+            }
+        } else {
+            // Un fichero que pasa a directorio (o al revés) también cuenta como modificado
+            int ret = ea->is_dir != eb->is_dir ? 1 : ctx->file(ctx, ea, eb);
+            if (ret > 0) {
+                report(node, 'M', path, 0);
+                __atomic_add_fetch(&ctx->modified, 1, __ATOMIC_RELAXED);
+            } else if (ret < 0) {
+                fprintf(stderr, "No se ha podido comparar %s\n", path);
+                __atomic_add_fetch(&ctx->errors, 1, __ATOMIC_RELAXED);
+            }
+        }
+        free(path);
+
+        if (ea) i++;
+        if (eb) j++;
+    }
+}
+
+// Cierre en postorden: libera el par de directorios del nodo
+void diff_finish(Walk *walk, WalkNode *node, OutWriter *out) {
+    (void)walk;
+    (void)out;
+    DiffDir *dir = node->data;
+    if (!dir) return;
+    free(dir->path);
+    free(dir);
+    node->data = NULL;
+}
+
+void diff_summary(const DiffCtx *ctx, FILE *out) {
+    fprintf(out, "Cambios: %llu añadidas, %llu borradas, %llu modificadas\n",
+            (unsigned long long)ctx->added, (unsigned long long)ctx->removed, (unsigned long long)ctx->modified);
+    fprintf(out, "Ficheros iguales por sus metadatos: %llu; comparados por contenido: %llu (%llu bytes)\n",
+            (unsigned long long)ctx->quick, (unsigned long long)ctx->hashed, (unsigned long long)ctx->hashed_bytes);
+}
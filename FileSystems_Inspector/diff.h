@@ -0,0 +1,54 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "walk.h"
+
+
+// Entrada de un directorio en una de las dos imágenes
+typedef struct {
+    char *name;
+    uint64_t key;               // Inodo (EXT2) o primer cluster (FAT16)
+    int is_dir;
+    uint8_t raw[32];            // Entrada de directorio tal cual (sólo FAT16, que no tiene inodos)
+} DiffEntry;
+
+typedef struct {
+    DiffEntry *items;
+    size_t count, cap;
+} DiffList;
+
+// Par de directorios que se comparan: el de A es la clave del nodo y el de B va aquí
+typedef struct {
+    char *path;
+    uint64_t key_b;
+} DiffDir;
+
+typedef struct DiffCtx DiffCtx;
+
+// Compara dos entradas que no son directorios y tienen el mismo nombre.
+// Devuelve 0 si son iguales, 1 si han cambiado o -1 si no se han podido leer
+typedef int (*DiffFileFn)(DiffCtx *ctx, const DiffEntry *a, const DiffEntry *b);
+
+// Parte común de --diff: va al principio del contexto de cada sistema de archivos
+struct DiffCtx {
+    DiffFileFn file;
+    uint64_t added, removed, modified;      // Rutas escritas (atómicos)
+    uint64_t quick;             // Ficheros iguales sólo por sus metadatos (atómico)
+    uint64_t hashed;            // Ficheros cuyo contenido hubo que resumir (atómico)
+    uint64_t hashed_bytes;      // Bytes resumidos de las dos imágenes para eso (atómico)
+    int errors;                 // Entradas que no se han podido comparar (atómico)
+};
+
+
+int diff_list_add(DiffList *list, const char *name, size_t len, uint64_t key, int is_dir, const uint8_t *raw);
+void diff_list_free(DiffList *list);
+DiffDir *diff_dir_new(const char *path, uint64_t key_b);
+void diff_merge(Walk *walk, WalkNode *node, DiffList *a, DiffList *b);
+void diff_finish(Walk *walk, WalkNode *node, OutWriter *out);
+void diff_summary(const DiffCtx *ctx, FILE *out);
+
+#endif
@@ -0,0 +1,69 @@
+#include "du.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Crea los totales de un directorio con su ruta completa (parent NULL = ruta tal cual)
+DuDir *du_dir_new(const char *parent, const char *name, size_t name_len) {
+    DuDir *dir = calloc(1, sizeof(DuDir));
+    if (!dir) return NULL;
+
+    size_t plen = parent ? strlen(parent) : 0;
+    int slash = plen > 0 && parent[plen - 1] != '/';
+    dir->path = malloc(plen + slash + name_len + 1);
+    if (!dir->path) {
+        free(dir);
+        return NULL;
+    }
+    if (plen) memcpy(dir->path, parent, plen);
+    if (slash) dir->path[plen] = '/';
+    memcpy(dir->path + plen + slash, name, name_len);
+    dir->path[plen + slash + name_len] = '\0';
+    return dir;
+}
+
+// Totales del directorio de partida: la ruta se escribe como "/a/b" (la raíz es "/")
+DuDir *du_root_new(const char *path) {
+    while (*path == '/') path++;
+    size_t len = strlen(path);
+    while (len > 0 && path[len - 1] == '/') len--;
+    return du_dir_new("/", path, len);
+}
+
+void du_dir_free(DuDir *dir) {
+    if (!dir) return;
+    free(dir->path);
+    free(dir);
+}
+
+// Una línea por directorio: bytes reservados, bytes lógicos, ficheros y ruta
+void du_print(OutWriter *out, const DuDir *dir) {
+    char line[80];
+    int len = snprintf(line, sizeof(line), "%llu\t%llu\t%llu\t",
+                       (unsigned long long)dir->allocated, (unsigned long long)dir->logical,
+                       (unsigned long long)dir->files);
+    out_write(out, line, len);
+    out_write(out, dir->path, strlen(dir->path));
+    out_write(out, "\n", 1);
+}
+
+// Cierre en postorden: el subárbol ya está sumado, se escribe y se añade al padre
+void du_finish(Walk *walk, WalkNode *node, OutWriter *out) {
+    const DuCtx *du = walk->ctx;
+    DuDir *dir = node->data;
+    if (!dir) return;
+
+    if (du->max_depth < 0 || node->depth <= du->max_depth) du_print(out, dir);
+    if (node->parent && node->parent->data) {
+        DuDir *parent = node->parent->data;
+        parent->allocated += dir->allocated;
+        parent->logical += dir->logical;
+        parent->files += dir->files;
+    }
+    du_dir_free(dir);
+    node->data = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef DU_H
+#define DU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "walk.h"
+#include "out.h"
+
+
+// Totales de un directorio: los de sus entradas y, al cerrarse, los de todo su subárbol
+typedef struct {
+    char *path;
+    uint64_t allocated;         // Bytes reservados en disco (bloques o clusters)
+    uint64_t logical;           // Tamaño lógico en bytes
+    uint64_t files;             // Entradas que no son directorios
+} DuDir;
+
+// Parte común del contexto de --du: va al principio del contexto de cada sistema de archivos
+typedef struct {
+    int max_depth;              // Profundidad máxima que se escribe (-1 = todas)
+} DuCtx;
+
+
+DuDir *du_dir_new(const char *parent, const char *name, size_t name_len);
+DuDir *du_root_new(const char *path);
+void du_dir_free(DuDir *dir);
+void du_finish(Walk *walk, WalkNode *node, OutWriter *out);
+void du_print(OutWriter *out, const DuDir *dir);
+
+#endif
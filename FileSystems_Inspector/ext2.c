@@ -1,164 +1,202 @@
 #include "ext2.h"
+#include "walk.h"
+#include "du.h"
+#include "bitmap.h"
+#include "pool.h"
+#include "out.h"
+#include "extract.h"
+#include "hash.h"
+#include "diff.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <errno.h>
 
-void print_time(uint32_t timestamp) {
+void print_time(FILE *out, uint32_t timestamp) {
     time_t t = timestamp;
     struct tm *tm_info = localtime(&t);
     char buffer[80];
     strftime(buffer, sizeof(buffer), "%a %b %d %H:%M:%S %Y", tm_info);
-    printf("%s", buffer);
+    fputs(buffer, out);
 }
 
-void print_EXT2_info(const EXT2_Superblock *sb) {
+void print_EXT2_info(const EXT2_Superblock *sb, FILE *out) {
     uint32_t block_size = 1024 << sb->s_log_block_size;
 
-    printf("--- Filesystem Information ---\n");
-    printf("Filesystem: EXT2\n\n");
+    fprintf(out, "--- Filesystem Information ---\n");
+    fprintf(out, "Filesystem: EXT2\n\n");
     
-    printf("INODE INFO\n");
-    printf("  Size: %u\n", sb->s_inode_size);
-    printf("  Num Inodes: %u\n", sb->s_inodes_count);
-    printf("  First Inode: %u\n", sb->s_first_ino);
-    printf("  Inodes Group: %u\n", sb->s_inodes_per_group);
-    printf("  Free Inodes: %u\n\n", sb->s_free_inodes_count);
+    fprintf(out, "INODE INFO\n");
+    fprintf(out, "  Size: %u\n", sb->s_inode_size);
+    fprintf(out, "  Num Inodes: %u\n", sb->s_inodes_count);
+    fprintf(out, "  First Inode: %u\n", sb->s_first_ino);
+    fprintf(out, "  Inodes Group: %u\n", sb->s_inodes_per_group);
+    fprintf(out, "  Free Inodes: %u\n\n", sb->s_free_inodes_count);
     
-    printf("INFO BLOCK\n");
-    printf("  Block size: %u\n", block_size);
-    printf("  Reserved blocks: %u\n", sb->s_r_blocks_count);
-    printf("  Free blocks: %u\n", sb->s_free_blocks_count);
-    printf("  Total blocks: %u\n", sb->s_blocks_count);
-    printf("  First block: %u\n", sb->s_first_data_block);
-    printf("  Group blocks: %u\n", sb->s_blocks_per_group);
-    printf("  Group flags: %u\n\n", sb->s_frags_per_group);
+    fprintf(out, "INFO BLOCK\n");
+    fprintf(out, "  Block size: %u\n", block_size);
+    fprintf(out, "  Reserved blocks: %u\n", sb->s_r_blocks_count);
+    fprintf(out, "  Free blocks: %u\n", sb->s_free_blocks_count);
+    fprintf(out, "  Total blocks: %u\n", sb->s_blocks_count);
+    fprintf(out, "  First block: %u\n", sb->s_first_data_block);
+    fprintf(out, "  Group blocks: %u\n", sb->s_blocks_per_group);
+    fprintf(out, "  Group flags: %u\n\n", sb->s_frags_per_group);
     
-    printf("INFO VOLUME\n");
-    printf("  Volume name: %s\n", sb->s_volume_name);
-    printf("  Last Checked: ");
-    print_time(sb->s_lastcheck);
-    printf("\n");
-    printf("  Last Mounted: ");
-    print_time(sb->s_wtime);
-    printf("\n");
-    printf("  Last Written: ");
-    print_time(sb->s_wtime);
-    printf("\n");
-}
-
-int detect_EXT2(const char *device, EXT2_Superblock *sb) {
-    int fd = open(device, O_RDONLY);
-    if (fd == -1) {
-        perror("Error al abrir el dispositivo (EXT2)");
-        return -1;
-    }
-
-    if (lseek(fd, EXT2_SUPERBLOCK_OFFSET, SEEK_SET) == -1) {
-        perror("Error al buscar el superbloque");
-        close(fd);
-        return -1;
-    }
+    fprintf(out, "INFO VOLUME\n");
+    fprintf(out, "  Volume name: %.16s\n", sb->s_volume_name);
+    fprintf(out, "  Last Checked: ");
+    print_time(out, sb->s_lastcheck);
+    fprintf(out, "\n");
+    fprintf(out, "  Last Mounted: ");
+    print_time(out, sb->s_wtime);
+    fprintf(out, "\n");
+    fprintf(out, "  Last Written: ");
+    print_time(out, sb->s_wtime);
+    fprintf(out, "\n");
+}
 
-    if (read(fd, sb, sizeof(EXT2_Superblock)) != sizeof(EXT2_Superblock)) {
-        perror("Error al leer el superbloque");
-        close(fd);
+// Reconoce EXT2 en los primeros bytes de la imagen (el superbloque empieza en el byte 1024)
+int probe_EXT2(const uint8_t *buf, size_t len, EXT2_Superblock *sb) {
+    if (len < EXT2_SUPERBLOCK_OFFSET + sizeof(EXT2_Superblock)) {
         return -1;
     }
+    memcpy(sb, buf + EXT2_SUPERBLOCK_OFFSET, sizeof(EXT2_Superblock));
 
     if (sb->s_magic != EXT2_SUPER_MAGIC) {
-        close(fd);
         return -1;
     }
 
-    close(fd);
     return 1;
 }
 
 
 // Fase 2
-static void print_indent(int level) {
-    for (int i = 0; i < level; i++) printf("│   ");
-}
-
 // Lee un inodo específico del sistema de archivos a partir de su número en out
-int read_inode(int fd, const EXT2_Superblock *sb, const EXT2_GroupDesc *gd, uint32_t inode_num, EXT2_Inode *out)
+int read_inode(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt, uint32_t inode_num, EXT2_Inode *out)
 {
     uint32_t blk_sz     = EXT2_BLOCK_SIZE(sb);
 
-    off_t table_offset  = (off_t)gd->bg_inode_table * blk_sz;
-    off_t inode_offset  = table_offset + (inode_num - 1) * sb->s_inode_size;
+    // Grupo al que pertenece el inodo y posición dentro de su tabla
+    uint32_t group      = (inode_num - 1) / sb->s_inodes_per_group;
+    uint32_t index      = (inode_num - 1) % sb->s_inodes_per_group;
+    if (inode_num == 0 || group >= gt->count) {
+        fprintf(stderr, "read_inode: inodo %u fuera de rango\n", inode_num);
+        return -1;
+    }
 
-    uint8_t buf[sb->s_inode_size];
-    if (lseek(fd, inode_offset, SEEK_SET) == -1 ||
-        read(fd, buf, sb->s_inode_size) != (ssize_t)sb->s_inode_size)
-    {
-        perror("read_inode");
+    // Bloque de la tabla de inodos que lo contiene: los hermanos de un directorio
+    // suelen caer en el mismo bloque y con caché sólo se lee una vez
+    uint64_t byte_in_table = (uint64_t)index * sb->s_inode_size;
+    uint64_t table_block = gt->desc[group].bg_inode_table + byte_in_table / blk_sz;
+    STATS_START(t0);
+    ImageView view;
+    const uint8_t *block = image_get_block(img, table_block * blk_sz, blk_sz, CACHE_META, &view);
+    if (!block) {
+        fprintf(stderr, "read_inode: no se pudo leer el inodo %u\n", inode_num);
         return -1;
     }
 
     // Copia SOLO los primeros Bytes que coinciden con el struct 
-    memcpy(out, buf, sizeof(EXT2_Inode));
+    memcpy(out, block + byte_in_table % blk_sz, sizeof(EXT2_Inode));
+    image_put(img, &view);
+    STATS_TIME(TIMER_INODE, t0);
     return 0;
 }
 
-// Lee un bloque de datos del sistema de  en buf
-int read_block(int fd, uint32_t block_size, uint32_t block_num, void *buf) {
-    off_t offset = (off_t)block_num * block_size;
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        perror("Error seeking to block");
-        return -1;
-    }
-
-    ssize_t bytes_read = read(fd, buf, block_size);
-    if (bytes_read == -1) {
-        perror("Error reading block");
-        return -1;
-    }
-    if (bytes_read == 0) {
-        // Bloque vacío: no es un error, solo no hay datos (probablemente porque han sido borrados)
-        return 0;
-    }
-    if (bytes_read != (ssize_t)block_size) {
-        fprintf(stderr, "Short read: expected %u, got %zd\n", block_size, bytes_read);
-        return -1;
-    }
-
-    return 0;
+// Obtiene una vista de un bloque del sistema de archivos (sin copia si la imagen está proyectada).
+// cls indica a la caché si es un bloque de metadatos (tabla de inodos, indirectos) o de datos
+const uint8_t *get_block(Image *img, uint32_t block_size, uint32_t block_num, int cls, ImageView *view) {
+    return image_get_block(img, (uint64_t)block_num * block_size, block_size, cls, view);
 }
 
 
-void print_directory_recursive(int fd,
+void print_directory_recursive(Image *img,
                               const EXT2_Superblock *sb,
-                              const EXT2_GroupDesc *gd,
+                              const EXT2_GroupTable *gt,
                               const EXT2_Inode *inode,
-                              int depth);
+                              int depth,
+                              OutWriter *out);
                       
                               
+// Indica si la entrada es "." o ".."
+static int is_dot_entry(const EXT2_DirEntry *e) {
+    return (e->name_len == 1 && e->name[0] == '.') ||
+           (e->name_len == 2 && e->name[0] == '.' && e->name[1] == '.');
+}
+
+static int cmp_block(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Adelanta la lectura de los bloques de la tabla de inodos que contienen inos:
+// se ordenan, se quitan repetidos y los cercanos se piden juntos como un único rango
+void prefetch_EXT2_inodes(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt,
+                          const uint32_t *inos, size_t n) {
+    uint32_t blk_sz = EXT2_BLOCK_SIZE(sb);
+    uint64_t blocks[EXT2_PREFETCH_BATCH];
+    size_t count = 0;
+
+    if (n > EXT2_PREFETCH_BATCH) n = EXT2_PREFETCH_BATCH;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t group = (inos[i] - 1) / sb->s_inodes_per_group;
+        uint32_t index = (inos[i] - 1) % sb->s_inodes_per_group;
+        if (inos[i] == 0 || group >= gt->count) continue;
+        blocks[count++] = gt->desc[group].bg_inode_table + (uint64_t)index * sb->s_inode_size / blk_sz;
+    }
+    if (count == 0) return;
+    qsort(blocks, count, sizeof(uint64_t), cmp_block);
+
+    uint64_t start = blocks[0], end = blocks[0] + 1;
+    for (size_t i = 1; i <= count; i++) {
+        if (i < count && blocks[i] <= end + EXT2_PREFETCH_GAP) {
+            if (blocks[i] >= end) end = blocks[i] + 1;
+            continue;
+        }
+        image_prefetch(img, start * blk_sz, (end - start) * blk_sz);
+        if (i < count) {
+            start = blocks[i];
+            end = blocks[i] + 1;
+        }
+    }
+}
+
 // Procesa un bloque directo de directorio, mostrando sus entradas y recorriendolas si son directorios.
-void process_directory_block(int fd, const EXT2_Superblock *sb, const EXT2_GroupDesc *gd,
-                            uint8_t *buf, uint32_t block_size, int depth) {
+void process_directory_block(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt,
+                            const uint8_t *buf, uint32_t block_size, int depth, OutWriter *out) {
+    // 1) Reunir los inodos de los subdirectorios y pedir sus bloques de la tabla de una vez
+    uint32_t inos[EXT2_PREFETCH_BATCH];
+    size_t n = 0;
     uint32_t pos = 0;
-    // Recorremos entradas
-    while (pos < block_size) {
-        EXT2_DirEntry *e = (EXT2_DirEntry *)(buf + pos);
-        if (e->inode == 0 || e->rec_len == 0) break;
+    while (pos + 8 <= block_size && n < EXT2_PREFETCH_BATCH) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
+        if (e->inode != 0 && !is_dot_entry(e) && e->file_type == EXT2_FT_DIR) inos[n++] = e->inode;
+        pos += e->rec_len;
+    }
+    if (n > 1) prefetch_EXT2_inodes(img, sb, gt, inos, n);
 
-        char name[MAX_NAME_LEN + 1] = {0};
-        memcpy(name, e->name, e->name_len);
-        name[e->name_len] = '\0';
+    // 2) Recorremos entradas
+    // Las entradas con inodo 0 (borradas, o los nodos del índice de un directorio
+    // indexado) se saltan: detrás puede haber entradas válidas
+    pos = 0;
+    while (pos + 8 <= block_size) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
 
         // Comprobamos que no sea ni . ni ..
-        if (strcmp(name, ".") && strcmp(name, "..")) {
-            print_indent(depth);
-            printf("|__ %s\n", name);
+        if (e->inode != 0 && !is_dot_entry(e)) {
+            // El nombre se copia tal cual desde la entrada, sin pasar por printf
+            out_line(out, depth, "|__ ", 4, e->name, strnlen(e->name, e->name_len));
 
             if (e->file_type == EXT2_FT_DIR) {
                 EXT2_Inode child;
-                if (read_inode(fd, sb, gd, e->inode, &child) == 0) {
-                    print_directory_recursive(fd, sb, gd, &child, depth + 1);
+                if (read_inode(img, sb, gt, e->inode, &child) == 0) {
+                    print_directory_recursive(img, sb, gt, &child, depth + 1, out);
                 }
             }
         }
@@ -166,153 +204,1518 @@ void process_directory_block(int fd, const EXT2_Superblock *sb, const EXT2_Group
     }
 }
 
-// Procesa recursivamente bloques indirectos (nivel 2 o 3)
-void process_indirect_blocks(int fd, const EXT2_Superblock *sb, const EXT2_GroupDesc *gd,
-                            uint32_t block_num, int level, const EXT2_Inode *inode, int depth) {
-    uint32_t block_size = EXT2_BLOCK_SIZE(sb);
-    uint32_t *block_ptrs = malloc(block_size);
-    if (!block_ptrs) {
-        perror("malloc failed");
-        return;
+// Entrega de bloques de directorio leídos por lotes
+typedef struct {
+    EXT2_DirBlockFn fn;
+    void *ctx;
+} DirBlockBatch;
+
+static int deliver_dir_block(size_t index, const uint8_t *data, size_t len, void *arg) {
+    (void)index;
+    DirBlockBatch *db = arg;
+    db->fn(data, (uint32_t)len, db->ctx);
+    return 0;
+}
+
+// Lee los bloques blks[0..n) en un solo lote (en vuelo a la vez con --io-depth)
+// y los entrega a fn en orden
+static void read_directory_blocks(Image *img, uint32_t block_size, const uint32_t *blks, size_t n,
+                                  EXT2_DirBlockFn fn, void *ctx) {
+    ImageReq reqs[EXT2_DIR_BATCH];
+    DirBlockBatch db = { fn, ctx };
+    size_t k = 0;
+    for (size_t i = 0; i <= n; i++) {
+        if (k == EXT2_DIR_BATCH || (i == n && k > 0)) {
+            image_read_batch(img, reqs, k, 1, deliver_dir_block, &db);
+            k = 0;
+        }
+        if (i < n) reqs[k++] = (ImageReq){ (uint64_t)blks[i] * block_size, block_size, CACHE_DATA };
     }
+}
 
-    if (read_block(fd, block_size, block_num, block_ptrs) < 0) {
-        free(block_ptrs);
+// Procesa recursivamente bloques indirectos (nivel 2 o 3), entregando cada bloque de datos a fn
+void process_indirect_blocks(Image *img, const EXT2_Superblock *sb, uint32_t block_num, int level,
+                            EXT2_DirBlockFn fn, void *ctx) {
+    uint32_t block_size = EXT2_BLOCK_SIZE(sb);
+    ImageView ptr_view;
+    const uint32_t *block_ptrs = (const uint32_t *)get_block(img, block_size, block_num, CACHE_META, &ptr_view);
+    if (!block_ptrs) {
         return;
     }
 
     int entries = block_size / sizeof(uint32_t);
+    uint32_t data_blks[EXT2_DIR_BATCH];
+    size_t n = 0;
     for (int i = 0; i < entries; i++) {
         uint32_t blk = block_ptrs[i];
         if (!blk || blk >= sb->s_blocks_count) continue;
 
         if (level > 1) {
             // Si es nivel 2 o 3, procesamos recursivamente
-            process_indirect_blocks(fd, sb, gd, blk, level - 1, inode, depth);
+            process_indirect_blocks(img, sb, blk, level - 1, fn, ctx);
         } else {
-            // Si es nivel 1, leemos el bloque de datos
-            uint8_t *buf = malloc(block_size);
-            if (!buf) {
-                perror("malloc failed");
-                continue;
-            }
-
-            if (read_block(fd, block_size, blk, buf) == 0) {
-                process_directory_block(fd, sb, gd, buf, block_size, depth);
+            // Si es nivel 1, los bloques de datos se leen por lotes
+            data_blks[n++] = blk;
+            if (n == EXT2_DIR_BATCH) {
+                read_directory_blocks(img, block_size, data_blks, n, fn, ctx);
+                n = 0;
             }
-
-            free(buf);
         }
     }
+    read_directory_blocks(img, block_size, data_blks, n, fn, ctx);
 
-    free(block_ptrs);
+    image_put(img, &ptr_view);
 }
 
-// Procesa las entradas de un bloque de directorio e imprime nombres de archivos/directorios
-void print_directory_recursive(int fd,
-                              const EXT2_Superblock *sb,
-                              const EXT2_GroupDesc *gd,
-                              const EXT2_Inode *inode,
-                              int depth) {
+// Recorre los bloques de datos de un directorio (directos e indirectos) en orden
+void for_each_directory_block(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *inode,
+                              EXT2_DirBlockFn fn, void *ctx) {
     uint32_t block_size = EXT2_BLOCK_SIZE(sb);
-    uint8_t *buf = malloc(block_size);
-    if (!buf) {
-        perror("malloc failed");
-        return;
-    }
 
     // 1. Procesar bloques directos (0-11)
     uint32_t blocks_to_read = (inode->size + block_size - 1) / block_size;
     uint32_t direct_blocks = (blocks_to_read > EXT2_DIRECT_BLOCKS) ? EXT2_DIRECT_BLOCKS : blocks_to_read;
 
+    uint32_t blks[EXT2_DIRECT_BLOCKS];
+    size_t n = 0;
     for (uint32_t i = 0; i < direct_blocks; i++) {
         uint32_t blk = inode->block[i];
         if (!blk || blk >= sb->s_blocks_count + sb->s_first_data_block) continue;
-
-        if (read_block(fd, block_size, blk, buf) == 0) {
-            process_directory_block(fd, sb, gd, buf, block_size, depth);
-        }
+        blks[n++] = blk;
     }
+    read_directory_blocks(img, block_size, blks, n, fn, ctx);
 
     // 2. Procesar bloque indirecto simple (nivel 1)
     if (blocks_to_read > EXT2_INDIRECT_BLOCK && inode->block[EXT2_INDIRECT_BLOCK]) {
-        process_indirect_blocks(fd, sb, gd, inode->block[EXT2_INDIRECT_BLOCK], 1, inode, depth);
+        process_indirect_blocks(img, sb, inode->block[EXT2_INDIRECT_BLOCK], 1, fn, ctx);
     }
 
     // 3. Procesar bloque doble indirecto (nivel 2)
     if (blocks_to_read > EXT2_DOUBLE_INDIRECT_BLOCK) {
         if (inode->block[EXT2_DOUBLE_INDIRECT_BLOCK]) {
-            process_indirect_blocks(fd, sb, gd, inode->block[EXT2_DOUBLE_INDIRECT_BLOCK], 2, inode, depth);
+            process_indirect_blocks(img, sb, inode->block[EXT2_DOUBLE_INDIRECT_BLOCK], 2, fn, ctx);
         }
     }
 
     // 4. Procesar bloque triple indirecto (nivel 3)
     if (blocks_to_read > EXT2_TRIPLE_INDIRECT_BLOCK) {
         if (inode->block[EXT2_TRIPLE_INDIRECT_BLOCK]) {
-            process_indirect_blocks(fd, sb, gd, inode->block[EXT2_TRIPLE_INDIRECT_BLOCK], 3, inode, depth);
+            process_indirect_blocks(img, sb, inode->block[EXT2_TRIPLE_INDIRECT_BLOCK], 3, fn, ctx);
+        }
+    }
+}
+
+// Contexto del recorrido secuencial
+typedef struct {
+    Image *img;
+    const EXT2_Superblock *sb;
+    const EXT2_GroupTable *gt;
+    int depth;
+    OutWriter *out;
+} PrintCtx;
+
+static void print_block(const uint8_t *buf, uint32_t block_size, void *arg) {
+    PrintCtx *pc = arg;
+    process_directory_block(pc->img, pc->sb, pc->gt, buf, block_size, pc->depth, pc->out);
+}
+
+// Procesa las entradas de un bloque de directorio e imprime nombres de archivos/directorios
+void print_directory_recursive(Image *img,
+                              const EXT2_Superblock *sb,
+                              const EXT2_GroupTable *gt,
+                              const EXT2_Inode *inode,
+                              int depth,
+                              OutWriter *out) {
+    PrintCtx pc = { img, sb, gt, depth, out };
+    for_each_directory_block(img, sb, inode, print_block, &pc);
+}
+
+
+// Contexto compartido por los hilos del recorrido paralelo
+typedef struct {
+    Image *img;
+    const EXT2_Superblock *sb;
+    const EXT2_GroupTable *gt;
+} TreeJobCtx;
+
+// Bloque de directorio dentro de una tarea: mismas reglas que process_directory_block
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+} TreeBlockCtx;
+
+static void tree_job_block(const uint8_t *buf, uint32_t block_size, void *arg) {
+    TreeBlockCtx *tb = arg;
+    TreeJobCtx *ctx = tb->walk->ctx;
+    WalkNode *node = tb->node;
+    uint32_t inos[EXT2_PREFETCH_BATCH];
+    size_t n = 0;
+    uint32_t pos = 0;
+
+    while (pos + 8 <= block_size) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
+
+        if (e->inode != 0 && !is_dot_entry(e)) {
+            walk_indent(node, node->depth);
+            walk_append(node, "|__ ", 4);
+            walk_append(node, e->name, strnlen(e->name, e->name_len));
+            walk_append(node, "\n", 1);
+
+            // Cada subdirectorio es una tarea nueva; su salida se intercala aquí
+            if (e->file_type == EXT2_FT_DIR) {
+                walk_child(tb->walk, node, e->inode, node->depth + 1);
+                if (n < EXT2_PREFETCH_BATCH) inos[n++] = e->inode;
+            }
         }
+        pos += e->rec_len;
     }
 
-    free(buf);
+    // Las tareas hijas leerán estos inodos: sus bloques de la tabla se piden ya, ordenados
+    if (n > 1) prefetch_EXT2_inodes(ctx->img, ctx->sb, ctx->gt, inos, n);
 }
 
+static void tree_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    TreeJobCtx *ctx = walk->ctx;
+    EXT2_Inode inode;
+    if (read_inode(ctx->img, ctx->sb, ctx->gt, (uint32_t)node->key, &inode) < 0) return;
 
+    TreeBlockCtx tb = { walk, node };
+    for_each_directory_block(ctx->img, ctx->sb, &inode, tree_job_block, &tb);
+}
 
-// Lee el descriptor del primer grupo de bloques desde el disco
-int read_group_descriptors(int fd, EXT2_GroupDesc *gd, const EXT2_Superblock *sb) {
+
+// Lee la tabla completa de descriptores de grupo con una única lectura
+int read_group_descriptors(Image *img, EXT2_GroupTable *gt, const EXT2_Superblock *sb) {
     uint32_t block_size = EXT2_BLOCK_SIZE(sb);
 
     // Calculamos el offset de GD:
     // - Si block_size == 1024, GD empieza en byte 1024 (offset superbloque) + 1024 = 2048
     // - Si block_size > 1024, GD ocupa el bloque 1, es decir offset = block_size
-    off_t gd_offset = (block_size == 1024) ? (EXT2_SUPERBLOCK_OFFSET + block_size) : block_size;
+    uint64_t gd_offset = (block_size == 1024) ? (EXT2_SUPERBLOCK_OFFSET + block_size) : block_size;
 
-    // Posicionarnos al inicio de la tabla de descriptores
-    if (lseek(fd, gd_offset, SEEK_SET) == -1) {
-        perror("Error seeking to group descriptors");
+    // Número de grupos: bloques de datos repartidos en grupos de s_blocks_per_group
+    if (sb->s_blocks_per_group == 0 || sb->s_inodes_per_group == 0) {
+        fprintf(stderr, "Superbloque con grupos de tamaño 0\n");
         return -1;
     }
+    gt->count = (sb->s_blocks_count - sb->s_first_data_block + sb->s_blocks_per_group - 1)
+                / sb->s_blocks_per_group;
 
-    // Leer primer descriptor de grupo
-    ssize_t bytes_read = read(fd, gd, sizeof(EXT2_GroupDesc));
-    if (bytes_read != sizeof(EXT2_GroupDesc)) {
-        perror("Error reading group descriptor");
+    size_t table_size = (size_t)gt->count * sizeof(EXT2_GroupDesc);
+    gt->desc = malloc(table_size);
+    if (!gt->desc) {
+        perror("malloc failed");
+        return -1;
+    }
+
+    // Leer todos los descriptores de grupo
+    STATS_START(t0);
+    if (image_read(img, gt->desc, table_size, gd_offset) < 0) {
+        perror("Error reading group descriptors");
+        free(gt->desc);
+        gt->desc = NULL;
         return -2;
     }
+    STATS_TIME(TIMER_METADATA, t0);
 
-    printf("Bloque del mapa de inodos: %u\n", gd->bg_inode_bitmap);
-    printf("Bloque del mapa de bloques: %u\n", gd->bg_block_bitmap);
-    printf("Primer bloque de inodos: %u\n", gd->bg_inode_table);
+    return 0;
+}
+
+
+// Escribe el árbol completo en out usando una tabla de descriptores ya cargada
+int tree_EXT2(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt, int jobs, OutWriter *out) {
+    // Leer el inodo raíz (2) y arrancar el recorrido desde él
+    EXT2_Inode root;
+    if (read_inode(img, sb, gt, EXT2_ROOT_INO, &root) < 0) {
+        fprintf(stderr, "No se pudo leer el inodo raíz\n");
+        return -1;
+    }
 
+    // Mostrar el nodo raíz y su contenido
+    out_write(out, ".\n", 2);
+    if (jobs > 1) {
+        // Con varios hilos, cada directorio es una tarea y la salida se reensambla en orden
+        TreeJobCtx ctx = { img, sb, gt };
+        return walk_run(jobs, tree_job, &ctx, EXT2_ROOT_INO, 1, out);
+    }
+    STATS_START(t0);
+    print_directory_recursive(img, sb, gt, &root, 1, out);
+    STATS_TIME(TIMER_TRAVERSAL, t0);
     return 0;
 }
 
+int print_EXT2_tree(Image *img, const EXT2_Superblock *sb, int jobs) {
+    // 1) Leer la tabla de descriptores de grupo
+    EXT2_GroupTable gt;
+    if (read_group_descriptors(img, &gt, sb) < 0) {
+        return -1;
+    }
 
-void print_EXT2_tree(const char *image_path, const EXT2_Superblock *sb) {
-    int fd = open(image_path, O_RDONLY);
-    if (fd < 0) {
-        perror("No se pudo abrir la imagen");
-        return;
+    // 2) Recorrer el árbol escribiendo por la salida con buffer
+    OutWriter out;
+    if (out_init(&out, STDOUT_FILENO) < 0) {
+        free(gt.desc);
+        return -1;
     }
+    fflush(stdout);
+    int ret = tree_EXT2(img, sb, &gt, jobs, &out);
+
+    out_free(&out);
+    free(gt.desc);
+    return ret;
+}
+
 
-    // 1) Leer descriptor de grupo
-    EXT2_GroupDesc gd;
-    if (read_group_descriptors(fd, &gd, sb) < 0) {
-        close(fd);
+// Fase 3
+// Acumula bloques lógicos consecutivos en tramos físicamente contiguos (o huecos)
+typedef struct {
+    EXT2_Run cur;           // Tramo en construcción
+    uint64_t next_logical;  // Siguiente bloque lógico a añadir
+    uint64_t limit;         // Número de bloques lógicos del fichero
+    EXT2_RunFn fn;
+    void *ctx;
+    int stop;               // El callback pidió parar o hubo un error
+} RunBuilder;
+
+static void flush_run(RunBuilder *rb) {
+    if (rb->cur.count && !rb->stop) {
+        if (rb->fn(&rb->cur, rb->ctx) != 0) rb->stop = 1;
+    }
+    rb->cur.count = 0;
+}
+
+// Añade count bloques lógicos que empiezan en el físico phys (0 = hueco)
+static void add_blocks(RunBuilder *rb, uint64_t phys, uint64_t count) {
+    if (rb->next_logical >= rb->limit) return;
+    if (count > rb->limit - rb->next_logical) count = rb->limit - rb->next_logical;
+
+    int extends = rb->cur.count &&
+                  ((phys == 0 && rb->cur.physical == 0) ||
+                   (phys != 0 && rb->cur.physical != 0 && rb->cur.physical + rb->cur.count == phys));
+    if (!extends) {
+        flush_run(rb);
+        rb->cur.logical = rb->next_logical;
+        rb->cur.physical = phys;
+    }
+    rb->cur.count += count;
+    rb->next_logical += count;
+}
+
+// Recorre un bloque de punteros de nivel level (1 = indirecto simple) que cubre span bloques lógicos
+static void map_indirect(Image *img, const EXT2_Superblock *sb, uint32_t block_num, int level,
+                         uint64_t span, RunBuilder *rb) {
+    uint32_t block_size = EXT2_BLOCK_SIZE(sb);
+    uint32_t ptrs = block_size / sizeof(uint32_t);
+
+    // Puntero nulo o fuera del sistema de archivos: todo el rango es un hueco
+    if (!block_num || block_num >= sb->s_blocks_count) {
+        add_blocks(rb, 0, span);
         return;
     }
 
-    // 2) Leer el inodo raíz (2) y arrancar la recursión desde él
-    EXT2_Inode root;
-    if (read_inode(fd, sb, &gd, 2, &root) < 0) {
-        fprintf(stderr, "No se pudo leer el inodo raíz\n");
-        close(fd);
+    ImageView view;
+    const uint32_t *block_ptrs = (const uint32_t *)get_block(img, block_size, block_num, CACHE_META, &view);
+    if (!block_ptrs) {
+        rb->stop = 1;
         return;
     }
 
-    // 3) Mostrar el nodo raíz y su contenido
-    printf(".\n");
-    print_directory_recursive(fd, sb, &gd, &root, 1);
+    uint64_t child_span = span / ptrs;
+    for (uint32_t i = 0; i < ptrs && rb->next_logical < rb->limit && !rb->stop; i++) {
+        uint32_t blk = block_ptrs[i];
+        if (level > 1) {
+            map_indirect(img, sb, blk, level - 1, child_span, rb);
+        } else {
+            add_blocks(rb, (blk < sb->s_blocks_count) ? blk : 0, 1);
+        }
+    }
+
+    image_put(img, &view);
+}
+
+// Tamaño de un inodo en bytes (los ficheros regulares guardan los 32 bits altos en dir_acl)
+uint64_t EXT2_inode_size(const EXT2_Inode *inode) {
+    uint64_t size = inode->size;
+    if ((inode->mode & EXT2_S_IFMT) == EXT2_S_IFREG) size |= (uint64_t)inode->dir_acl << 32;
+    return size;
+}
+
+// Traduce los bloques de un inodo (directos, indirectos, dobles y triples) en tramos
+// contiguos que se entregan a fn en orden lógico. Devuelve -1 si hubo un error de lectura
+int map_EXT2_file(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *inode,
+                  EXT2_RunFn fn, void *ctx) {
+    uint32_t block_size = EXT2_BLOCK_SIZE(sb);
+    uint64_t ptrs = block_size / sizeof(uint32_t);
+
+    RunBuilder rb;
+    memset(&rb, 0, sizeof(rb));
+    rb.limit = (EXT2_inode_size(inode) + block_size - 1) / block_size;
+    rb.fn = fn;
+    rb.ctx = ctx;
+
+    // 1. Bloques directos (0-11)
+    for (int i = 0; i < EXT2_DIRECT_BLOCKS && rb.next_logical < rb.limit; i++) {
+        uint32_t blk = inode->block[i];
+        add_blocks(&rb, (blk < sb->s_blocks_count) ? blk : 0, 1);
+    }
+
+    // 2. Indirecto simple, doble y triple
+    uint64_t span = ptrs;
+    for (int level = 1; level <= 3 && rb.next_logical < rb.limit && !rb.stop; level++) {
+        map_indirect(img, sb, inode->block[EXT2_DIRECT_BLOCKS + level - 1], level, span, &rb);
+        span *= ptrs;
+    }
+
+    flush_run(&rb);
+    return rb.stop && rb.next_logical < rb.limit ? -1 : 0;
+}
+
+
+// Búsqueda de una entrada por nombre dentro de los bloques de un directorio
+typedef struct {
+    Image *img;
+    uint32_t block_size;
+    const char *name;
+    size_t name_len;
+    uint32_t found;         // Inodo encontrado (0 si no)
+} LookupCtx;
+
+static int lookup_block(size_t index, const uint8_t *buf, size_t len, void *arg) {
+    (void)index;
+    LookupCtx *lc = arg;
+    uint32_t pos = 0;
+    while (pos + 8 <= len) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
+        if (e->inode != 0 && e->name_len == lc->name_len &&
+            memcmp(e->name, lc->name, lc->name_len) == 0) {
+            lc->found = e->inode;
+            return 1;
+        }
+        pos += e->rec_len;
+    }
+    return 0;
+}
+
+// Los bloques de cada tramo se piden juntos; la búsqueda para en cuanto aparece el nombre,
+// así que da igual en qué orden terminen
+static int lookup_run(const EXT2_Run *run, void *arg) {
+    LookupCtx *lc = arg;
+    if (run->physical == 0) return 0;
+
+    ImageReq reqs[EXT2_DIR_BATCH];
+    for (uint64_t b = 0; b < run->count; ) {
+        size_t k = 0;
+        for (; k < EXT2_DIR_BATCH && b < run->count; k++, b++) {
+            reqs[k] = (ImageReq){ (run->physical + b) * lc->block_size, lc->block_size, CACHE_DATA };
+        }
+        int ret = image_read_batch(lc->img, reqs, k, 0, lookup_block, lc);
+        if (ret != 0) return ret;
+    }
+    return 0;
+}
+
+// Traduce un bloque lógico de un inodo a su bloque físico bajando sólo por los punteros
+// que lo cubren (0 si es un hueco, está fuera del sistema de archivos o falla la lectura)
+static uint32_t bmap_EXT2(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *inode, uint64_t logical) {
+    uint32_t block_size = EXT2_BLOCK_SIZE(sb);
+    uint64_t ptrs = block_size / sizeof(uint32_t);
+    uint32_t blk;
+
+    if (logical < EXT2_DIRECT_BLOCKS) {
+        blk = inode->block[logical];
+        return blk < sb->s_blocks_count ? blk : 0;
+    }
+
+    // Nivel de indirección que cubre el bloque y bloques que abarca cada puntero
+    logical -= EXT2_DIRECT_BLOCKS;
+    uint64_t span = 1;
+    int level = 1;
+    for (; level <= 3; level++) {
+        if (logical < span * ptrs) break;
+        logical -= span * ptrs;
+        span *= ptrs;
+    }
+    if (level > 3) return 0;
+
+    blk = inode->block[EXT2_DIRECT_BLOCKS + level - 1];
+    for (; level > 0; level--) {
+        if (!blk || blk >= sb->s_blocks_count) return 0;
+        ImageView view;
+        const uint32_t *block_ptrs = (const uint32_t *)get_block(img, block_size, blk, CACHE_META, &view);
+        if (!block_ptrs) return 0;
+        blk = block_ptrs[logical / span];
+        image_put(img, &view);
+        logical %= span;
+        span /= ptrs;
+    }
+    return blk < sb->s_blocks_count ? blk : 0;
+}
+
+// Un nivel del índice de un directorio indexado: copia del bloque y entrada seguida.
+// Cada entrada son 8 bytes {hash, bloque}; la primera lleva {limit, count} en lugar del hash
+typedef struct {
+    uint8_t *block;
+    uint32_t off;           // Posición de la primera entrada dentro del bloque
+    uint16_t count;
+    uint16_t at;
+} DxLevel;
+
+static uint32_t dx_hash(const DxLevel *l, uint32_t i) {
+    return i ? *(const uint32_t *)(l->block + l->off + 8 * i) : 0;
+}
+
+static uint32_t dx_block(const DxLevel *l, uint32_t i) {
+    return *(const uint32_t *)(l->block + l->off + 8 * i + 4) & 0x0FFFFFFF;
+}
+
+// Lee el bloque lógico logical del directorio en el nivel l y comprueba su cabecera
+static int dx_load(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *dir, uint32_t logical,
+                   uint32_t off, DxLevel *l) {
+    uint32_t block_size = EXT2_BLOCK_SIZE(sb);
+    uint32_t phys = bmap_EXT2(img, sb, dir, logical);
+    if (!phys) return -1;
+
+    ImageView view;
+    const uint8_t *buf = get_block(img, block_size, phys, CACHE_META, &view);
+    if (!buf) return -1;
+    memcpy(l->block, buf, block_size);
+    image_put(img, &view);
+
+    uint16_t limit = *(const uint16_t *)(l->block + off);
+    l->off = off;
+    l->count = *(const uint16_t *)(l->block + off + 2);
+    l->at = 0;
+    if (limit != (block_size - off) / 8 || l->count == 0 || l->count > limit) return -1;
+    return 0;
+}
+
+// Última entrada del nivel cuyo hash es <= hash (búsqueda binaria; la 0 cubre desde 0)
+static uint16_t dx_search(const DxLevel *l, uint32_t hash) {
+    uint32_t lo = 1, hi = l->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (dx_hash(l, mid) <= hash) lo = mid + 1;
+        else hi = mid;
+    }
+    return (uint16_t)(lo - 1);
+}
+
+// Busca name bajando por el índice de un directorio indexado: se lee un bloque por nivel
+// y la hoja que le toca (más las siguientes si su hash continúa en ellas por colisión).
+// Devuelve 0 (found queda a 0 si no existe) o -1 si el índice no se puede usar
+static int htree_lookup(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *dir, LookupCtx *lc) {
+    uint32_t block_size = lc->block_size;
+    DxLevel levels[EXT2_HTREE_MAX_LEVELS];
+    int nlevels = 0, ret = -1;
+
+    uint8_t *blocks = malloc((size_t)block_size * EXT2_HTREE_MAX_LEVELS);
+    if (!blocks) return -1;
+    for (int i = 0; i < EXT2_HTREE_MAX_LEVELS; i++) levels[i].block = blocks + (size_t)i * block_size;
+
+    // Raíz: "." (12 bytes), ".." que tapa el resto del bloque y dx_root_info en 0x18
+    uint32_t phys = bmap_EXT2(img, sb, dir, 0);
+    ImageView view;
+    const uint8_t *root = phys ? get_block(img, block_size, phys, CACHE_META, &view) : NULL;
+    if (!root) goto out;
+    uint8_t hash_version = root[0x1C];
+    uint8_t info_length = root[0x1D];
+    uint8_t indirect_levels = root[0x1E];
+    image_put(img, &view);
+    if (info_length != 8 || indirect_levels >= EXT2_HTREE_MAX_LEVELS) goto out;
+
+    int version = hash_version;
+    if (version <= HTREE_HASH_TEA && (sb->s_flags & EXT2_FLAGS_UNSIGNED_HASH)) version += 3;
+    uint32_t hash;
+    if (htree_hash(lc->name, lc->name_len, version, sb->s_hash_seed, &hash) < 0) goto out;
+
+    // Bajar por los niveles hasta el bloque hoja
+    if (dx_load(img, sb, dir, 0, 0x18 + info_length, &levels[0]) < 0) goto out;
+    for (nlevels = 1; ; nlevels++) {
+        DxLevel *l = &levels[nlevels - 1];
+        l->at = dx_search(l, hash);
+        if (nlevels > indirect_levels) break;
+        // Los nodos intermedios empiezan con una entrada vacía de 8 bytes que tapa el bloque
+        if (dx_load(img, sb, dir, dx_block(l, l->at), 8, &levels[nlevels]) < 0) goto out;
+    }
+
+    for (;;) {
+        DxLevel *leaf = &levels[nlevels - 1];
+        phys = bmap_EXT2(img, sb, dir, dx_block(leaf, leaf->at));
+        const uint8_t *buf = phys ? get_block(img, block_size, phys, CACHE_DATA, &view) : NULL;
+        if (!buf) goto out;
+        int hit = lookup_block(0, buf, block_size, lc);
+        image_put(img, &view);
+        if (hit) break;
+
+        // La siguiente hoja sólo puede tenerlo si empieza con el mismo hash (colisión)
+        int lv = nlevels - 1;
+        while (lv >= 0 && levels[lv].at + 1 >= levels[lv].count) lv--;
+        if (lv < 0 || (dx_hash(&levels[lv], levels[lv].at + 1) & ~1u) != hash) break;
+        levels[lv].at++;
+        for (lv++; lv < nlevels; lv++) {
+            if (dx_load(img, sb, dir, dx_block(&levels[lv - 1], levels[lv - 1].at), 8, &levels[lv]) < 0) goto out;
+        }
+    }
+    ret = 0;
+
+out:
+    free(blocks);
+    return ret;
+}
+
+// Busca name en el directorio dir y devuelve su número de inodo (0 si no existe).
+// Los directorios indexados se consultan por su índice; si no se puede, se recorren enteros
+uint32_t lookup_EXT2_entry(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *dir, const char *name) {
+    LookupCtx lc = { img, EXT2_BLOCK_SIZE(sb), name, strlen(name), 0 };
+    int dot = strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+
+    if (!dot && (sb->s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) && (dir->flags & EXT2_INDEX_FL) &&
+        htree_lookup(img, sb, dir, &lc) == 0) {
+        return lc.found;
+    }
+    lc.found = 0;
+    map_EXT2_file(img, sb, dir, lookup_run, &lc);
+    return lc.found;
+}
+
+// Resuelve una ruta absoluta desde el inodo raíz (2) y deja su inodo en out.
+// Con --stats cuenta como recorrido
+int resolve_EXT2_path(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt,
+                      const char *filepath, EXT2_Inode *out, uint32_t *ino_out) {
+    STATS_START(t0);
+    uint32_t ino = EXT2_ROOT_INO;
+    if (read_inode(img, sb, gt, ino, out) < 0) return -1;
+
+    // Tokenizar ruta por '/' y bajar componente a componente
+    char *path = strdup(filepath);
+    char *tok = strtok(path, "/");
+    while (tok) {
+        if ((out->mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+            fprintf(stderr, "No es un directorio: %s\n", tok);
+            free(path);
+            return -1;
+        }
+        ino = lookup_EXT2_entry(img, sb, out, tok);
+        if (ino == 0 || read_inode(img, sb, gt, ino, out) < 0) {
+            fprintf(stderr, "No encontrado: %s\n", tok);
+            free(path);
+            return -1;
+        }
+        tok = strtok(NULL, "/");
+    }
+    free(path);
+    if (ino_out) *ino_out = ino;
+    STATS_TIME(TIMER_TRAVERSAL, t0);
+    return 0;
+}
+
+
+// Volcado de un fichero a stdout tramo a tramo
+typedef struct {
+    Image *img;
+    uint32_t block_size;
+    uint64_t size;          // Tamaño del fichero: el último bloque se recorta
+    int out_fd;
+} DumpCtx;
+
+static int dump_run(const EXT2_Run *run, void *arg) {
+    DumpCtx *dc = arg;
+    uint64_t start = run->logical * dc->block_size;
+    if (start >= dc->size) return 1;
+
+    uint64_t len = run->count * dc->block_size;
+    if (len > dc->size - start) len = dc->size - start;
+
+    // Los huecos se escriben como ceros sin leer nada de la imagen
+    if (run->physical == 0) return image_write_zeros(dc->out_fd, len) < 0 ? -1 : 0;
+    return image_copy_out(dc->img, run->physical * dc->block_size, len, dc->out_fd) < 0 ? -1 : 0;
+}
+
+// Enlace simbólico rápido: el destino (menos de 60 bytes) está en i_block y no ocupa bloques de
+// datos. i_blocks sólo cuenta entonces el bloque de atributos extendidos, si lo hay (como el kernel)
+static int is_fast_symlink(const EXT2_Superblock *sb, const EXT2_Inode *inode) {
+    uint32_t ea_blocks = inode->file_acl ? EXT2_BLOCK_SIZE(sb) / 512 : 0;
+    return (inode->mode & EXT2_S_IFMT) == EXT2_S_IFLNK && inode->blocks - ea_blocks == 0;
+}
+
+// Vuelca el contenido de un inodo a out_fd tramo a tramo
+int dump_EXT2_inode(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *inode, int out_fd) {
+    uint64_t size = EXT2_inode_size(inode);
+    if (is_fast_symlink(sb, inode)) {
+        if (size >= sizeof(inode->block)) {
+            fprintf(stderr, "Enlace simbólico rápido con tamaño inválido (%llu)\n", (unsigned long long)size);
+            return -1;
+        }
+        if (image_write_bytes(out_fd, inode->block, size) < 0) {
+            perror("Error al volcar el fichero");
+            return -1;
+        }
+        return 0;
+    }
+
+    DumpCtx dc = { img, EXT2_BLOCK_SIZE(sb), size, out_fd };
+    int ret = map_EXT2_file(img, sb, inode, dump_run, &dc);
+    if (ret < 0) perror("Error al volcar el fichero");
+    return ret;
+}
+
+// --cat para EXT2
+int cat_EXT2(Image *img, const EXT2_Superblock *sb, const char *filepath) {
+    EXT2_GroupTable gt;
+    if (read_group_descriptors(img, &gt, sb) < 0) {
+        return -1;
+    }
+
+    EXT2_Inode inode;
+    if (resolve_EXT2_path(img, sb, &gt, filepath, &inode, NULL) < 0) {
+        free(gt.desc);
+        return -1;
+    }
+    if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+        fprintf(stderr, "Es un directorio: %s\n", filepath);
+        free(gt.desc);
+        return -1;
+    }
+
+    fflush(stdout);
+    int ret = dump_EXT2_inode(img, sb, &inode, STDOUT_FILENO);
+
+    free(gt.desc);
+    return ret;
+}
+
+// Tipo de fichero legible a partir de i_mode
+static const char *inode_type_name(uint16_t mode) {
+    switch (mode & EXT2_S_IFMT) {
+        case EXT2_S_IFREG: return "regular file";
+        case EXT2_S_IFDIR: return "directory";
+        case 0xA000:       return "symbolic link";
+        case 0x2000:       return "character device";
+        case 0x6000:       return "block device";
+        case 0x1000:       return "fifo";
+        case 0xC000:       return "socket";
+        default:           return "unknown";
+    }
+}
+
+// Escribe los metadatos de un inodo en out
+void print_EXT2_stat(const char *path, uint32_t ino, const EXT2_Inode *inode, FILE *out) {
+    fprintf(out, "File: %s\n", path);
+    fprintf(out, "Type: %s\n", inode_type_name(inode->mode));
+    fprintf(out, "Inode: %u\n", ino);
+    fprintf(out, "Mode: %04o\n", inode->mode & 07777);
+    fprintf(out, "Size: %llu\n", (unsigned long long)EXT2_inode_size(inode));
+    fprintf(out, "Blocks (512B): %u\n", inode->blocks);
+    fprintf(out, "Links: %u\n", inode->links_count);
+    fprintf(out, "Uid: %u  Gid: %u\n", inode->uid, inode->gid);
+    fprintf(out, "Access: ");
+    print_time(out, inode->atime);
+    fprintf(out, "\nModify: ");
+    print_time(out, inode->mtime);
+    fprintf(out, "\nChange: ");
+    print_time(out, inode->ctime);
+    fprintf(out, "\n");
+}
+
+// --stat para EXT2
+int stat_EXT2(Image *img, const EXT2_Superblock *sb, const char *filepath) {
+    EXT2_GroupTable gt;
+    if (read_group_descriptors(img, &gt, sb) < 0) {
+        return -1;
+    }
+
+    EXT2_Inode inode;
+    uint32_t ino;
+    int ret = resolve_EXT2_path(img, sb, &gt, filepath, &inode, &ino);
+    if (ret == 0) print_EXT2_stat(filepath, ino, &inode, stdout);
+
+    free(gt.desc);
+    return ret;
+}
+
+
+// --du: totales por directorio sumados de abajo arriba
+typedef struct {
+    DuCtx du;                   // Debe ir primero (lo usa du_finish)
+    Image *img;
+    const EXT2_Superblock *sb;
+    const EXT2_GroupTable *gt;
+    uint8_t *seen;              // Bit por inodo con varios enlaces: ya contado
+} DuJobCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+    uint32_t inos[EXT2_PREFETCH_BATCH];
+    size_t n;
+} DuBlockCtx;
+
+// Suma un inodo a los totales de dir; los ficheros con varios enlaces duros solo cuentan una vez
+static void du_add_inode(DuJobCtx *ctx, DuDir *dir, uint32_t ino, const EXT2_Inode *inode) {
+    int is_dir = (inode->mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+    if (!is_dir && inode->links_count > 1 && ctx->seen) {
+        uint8_t bit = 1u << (ino % 8);
+        if (__atomic_fetch_or(&ctx->seen[ino / 8], bit, __ATOMIC_RELAXED) & bit) return;
+    }
+    dir->allocated += (uint64_t)inode->blocks * 512;    // i_blocks va en sectores de 512 bytes
+    dir->logical += EXT2_inode_size(inode);
+    if (!is_dir) dir->files++;
+}
+
+// Lee (con la tabla de inodos pedida por adelantado) los ficheros acumulados en db
+static void du_flush_files(DuBlockCtx *db) {
+    DuJobCtx *ctx = db->walk->ctx;
+    if (db->n > 1) prefetch_EXT2_inodes(ctx->img, ctx->sb, ctx->gt, db->inos, db->n);
+    for (size_t i = 0; i < db->n; i++) {
+        EXT2_Inode inode;
+        if (read_inode(ctx->img, ctx->sb, ctx->gt, db->inos[i], &inode) == 0) {
+            du_add_inode(ctx, db->node->data, db->inos[i], &inode);
+        }
+    }
+    db->n = 0;
+}
+
+static void du_job_block(const uint8_t *buf, uint32_t block_size, void *arg) {
+    DuBlockCtx *db = arg;
+    DuJobCtx *ctx = db->walk->ctx;
+    WalkNode *node = db->node;
+    DuDir *dir = node->data;
+    uint32_t pos = 0;
+
+    while (pos + 8 <= block_size) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
+
+        // Las entradas con inodo 0 son huecos (borradas): se saltan sin cortar el bloque
+        if (e->inode != 0 && e->inode <= ctx->sb->s_inodes_count && !is_dot_entry(e)) {
+            if (e->file_type == EXT2_FT_DIR) {
+                // Cada subdirectorio es una tarea; sus totales se suman aquí al cerrarse
+                DuDir *child = du_dir_new(dir->path, e->name, strnlen(e->name, e->name_len));
+                if (child && !walk_child_data(db->walk, node, e->inode, node->depth + 1, child)) {
+                    du_dir_free(child);
+                }
+            } else {
+                db->inos[db->n++] = e->inode;
+                if (db->n == EXT2_PREFETCH_BATCH) du_flush_files(db);
+            }
+        }
+        pos += e->rec_len;
+    }
+    du_flush_files(db);
+}
+
+static void du_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    DuJobCtx *ctx = walk->ctx;
+    EXT2_Inode inode;
+    if (!node->data || read_inode(ctx->img, ctx->sb, ctx->gt, (uint32_t)node->key, &inode) < 0) return;
+
+    // El propio directorio también ocupa bloques
+    du_add_inode(ctx, node->data, (uint32_t)node->key, &inode);
+    DuBlockCtx db = { walk, node, { 0 }, 0 };
+    for_each_directory_block(ctx->img, ctx->sb, &inode, du_job_block, &db);
+}
+
+// Escribe en out los totales de cada directorio bajo path, de abajo arriba;
+// si path es un fichero, una sola línea con los suyos
+int du_EXT2_tree(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt, const char *path,
+                 int jobs, int max_depth, OutWriter *out) {
+    EXT2_Inode inode;
+    uint32_t ino;
+    if (resolve_EXT2_path(img, sb, gt, path, &inode, &ino) < 0) return -1;
+
+    DuJobCtx ctx = { { max_depth }, img, sb, gt, calloc(sb->s_inodes_count / 8 + 1, 1) };
+    DuDir *root = du_root_new(path);
+    if (!root) {
+        free(ctx.seen);
+        return -1;
+    }
+
+    int ret = 0;
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        du_add_inode(&ctx, root, ino, &inode);
+        du_print(out, root);
+        du_dir_free(root);
+    } else {
+        ret = walk_run_postorder(jobs, du_job, du_finish, &ctx, ino, root, 0, out);
+    }
+    free(ctx.seen);
+    return ret;
+}
+
+// --du para EXT2
+int du_EXT2(Image *img, const EXT2_Superblock *sb, const char *path, int jobs, int max_depth) {
+    EXT2_GroupTable gt;
+    if (read_group_descriptors(img, &gt, sb) < 0) {
+        return -1;
+    }
+
+    OutWriter out;
+    if (out_init(&out, STDOUT_FILENO) < 0) {
+        free(gt.desc);
+        return -1;
+    }
+    fflush(stdout);
+    int ret = du_EXT2_tree(img, sb, &gt, path, jobs, max_depth, &out);
+
+    out_free(&out);
+    free(gt.desc);
+    return ret;
+}
+
+
+// --find: coincidencias con su ruta completa, en el orden del árbol
+typedef struct {
+    Image *img;
+    const EXT2_Superblock *sb;
+    const EXT2_GroupTable *gt;
+    const FindQuery *q;
+} FindJobCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+    uint32_t inos[EXT2_PREFETCH_BATCH];
+    const EXT2_DirEntry *ents[EXT2_PREFETCH_BATCH];
+    size_t n;
+} FindBlockCtx;
+
+// Lee los inodos de las entradas que el nombre y el tipo no descartaron y emite las que cumplen
+static void find_flush(FindBlockCtx *fb) {
+    FindJobCtx *ctx = fb->walk->ctx;
+    const char *parent = fb->node->data;
+    if (fb->n > 1) prefetch_EXT2_inodes(ctx->img, ctx->sb, ctx->gt, fb->inos, fb->n);
+
+    for (size_t i = 0; i < fb->n; i++) {
+        const EXT2_DirEntry *e = fb->ents[i];
+        EXT2_Inode inode;
+        if (read_inode(ctx->img, ctx->sb, ctx->gt, e->inode, &inode) < 0) continue;
+
+        int fmt = inode.mode & EXT2_S_IFMT;
+        if (find_match_type(ctx->q, fmt == EXT2_S_IFDIR, fmt == EXT2_S_IFREG) &&
+            find_match_meta(ctx->q, EXT2_inode_size(&inode), inode.mtime)) {
+            find_emit(fb->node, parent, e->name, strnlen(e->name, e->name_len));
+        }
+    }
+    fb->n = 0;
+}
+
+static void find_job_block(const uint8_t *buf, uint32_t block_size, void *arg) {
+    FindBlockCtx *fb = arg;
+    FindJobCtx *ctx = fb->walk->ctx;
+    const FindQuery *q = ctx->q;
+    WalkNode *node = fb->node;
+    const char *parent = node->data;
+    uint32_t pos = 0;
+
+    while (pos + 8 <= block_size && !walk_stopped(fb->walk)) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
+        pos += e->rec_len;
+        if (e->inode == 0 || e->inode > ctx->sb->s_inodes_count || is_dot_entry(e)) continue;
+
+        size_t len = strnlen(e->name, e->name_len);
+        int is_dir = e->file_type == EXT2_FT_DIR;
+
+        // Poda con lo que ya dice la entrada: nombre y, si se conoce, tipo
+        int match = find_match_name(q, e->name, len);
+        if (match && e->file_type != EXT2_FT_UNKNOWN) {
+            match = find_match_type(q, is_dir, e->file_type == EXT2_FT_REG_FILE);
+        }
+        if (match && (find_needs_meta(q) || e->file_type == EXT2_FT_UNKNOWN)) {
+            // Hace falta el inodo: se leerá junto con los demás candidatos del bloque
+            fb->inos[fb->n] = e->inode;
+            fb->ents[fb->n++] = e;
+            match = 0;
+            if (fb->n == EXT2_PREFETCH_BATCH) find_flush(fb);
+        }
+
+        if (is_dir) {
+            // Lo pendiente va antes que el directorio y que todo lo que cuelga de él
+            find_flush(fb);
+            if (match) find_emit(node, parent, e->name, len);
+            char *child = find_join(parent, e->name, len);
+            if (child && !walk_child_data(fb->walk, node, e->inode, node->depth + 1, child)) free(child);
+        } else if (match) {
+            find_emit(node, parent, e->name, len);
+        }
+    }
+    // Los punteros a las entradas solo valen mientras el bloque está a la vista
+    find_flush(fb);
+}
+
+static void find_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    FindJobCtx *ctx = walk->ctx;
+    EXT2_Inode inode;
+    if (!node->data || read_inode(ctx->img, ctx->sb, ctx->gt, (uint32_t)node->key, &inode) < 0) return;
+
+    FindBlockCtx fb;
+    fb.walk = walk;
+    fb.node = node;
+    fb.n = 0;
+    for_each_directory_block(ctx->img, ctx->sb, &inode, find_job_block, &fb);
+}
+
+// Escribe en out la ruta de cada entrada bajo path que cumple q
+int find_EXT2_tree(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt, const char *path,
+                   const FindQuery *q, int jobs, OutWriter *out) {
+    EXT2_Inode inode;
+    uint32_t ino;
+    if (resolve_EXT2_path(img, sb, gt, path, &inode, &ino) < 0) return -1;
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        fprintf(stderr, "No es un directorio: %s\n", path);
+        return -1;
+    }
+
+    char *root_path = find_root(path);
+    if (!root_path) return -1;
+
+    FindJobCtx ctx = { img, sb, gt, q };
+    return walk_run_postorder(jobs, find_job, find_finish, &ctx, ino, root_path, q->max_results, out);
+}
+
+// --find para EXT2
+int find_EXT2(Image *img, const EXT2_Superblock *sb, const char *path, FindQuery *q, int jobs) {
+    if (find_prepare(q, 0) < 0) return -1;
+
+    EXT2_GroupTable gt;
+    if (read_group_descriptors(img, &gt, sb) < 0) {
+        find_free(q);
+        return -1;
+    }
+
+    OutWriter out;
+    int ret = -1;
+    if (out_init(&out, STDOUT_FILENO) == 0) {
+        fflush(stdout);
+        ret = find_EXT2_tree(img, sb, &gt, path, q, jobs, &out);
+        out_free(&out);
+    }
+    free(gt.desc);
+    find_free(q);
+    return ret;
+}
+
+// --verify-counts / --bitmap-stats: cuentas reales de libres a partir de los mapas de bits
+typedef struct {
+    Image *img;
+    const EXT2_Superblock *sb;
+    const EXT2_GroupTable *gt;
+    int histogram;              // Calcular también los tramos libres de bloques
+    uint32_t *free_blocks;      // Por grupo, según su mapa de bloques
+    uint32_t *free_inodes;      // Por grupo, según su mapa de inodos
+} BitmapCtx;
+
+// Rango de grupos de una tarea; los tramos libres se unen entre grupos consecutivos
+typedef struct {
+    BitmapCtx *ctx;
+    uint32_t first, end;
+    BitmapExtents ext;
+    int error;
+} BitmapChunk;
+
+// Bloques que cubre el mapa del grupo g (el último grupo puede quedar incompleto)
+static uint32_t group_blocks(const EXT2_Superblock *sb, uint32_t g) {
+    uint64_t start = (uint64_t)g * sb->s_blocks_per_group;
+    uint64_t left = sb->s_blocks_count - sb->s_first_data_block - start;
+    return left < sb->s_blocks_per_group ? (uint32_t)left : sb->s_blocks_per_group;
+}
+
+// Cuenta los bits libres de un mapa (y sus tramos si ex no es NULL). Devuelve -1 si no se lee
+static int count_bitmap(BitmapCtx *ctx, uint32_t blk, uint32_t nbits, uint32_t *free_out, BitmapExtents *ex) {
+    uint32_t block_size = EXT2_BLOCK_SIZE(ctx->sb);
+    if (blk == 0 || blk >= ctx->sb->s_blocks_count) return -1;
+    if (nbits > block_size * 8) nbits = block_size * 8;
+
+    ImageView view;
+    const uint8_t *buf = get_block(ctx->img, block_size, blk, CACHE_META, &view);
+    if (!buf) return -1;
+    *free_out = nbits - (uint32_t)bitmap_count_set(buf, nbits);
+    if (ex) bitmap_free_extents(buf, nbits, ex);
+    image_put(ctx->img, &view);
+    return 0;
+}
+
+static void bitmap_chunk_task(void *arg, int worker) {
+    (void)worker;
+    BitmapChunk *chunk = arg;
+    BitmapCtx *ctx = chunk->ctx;
+
+    for (uint32_t g = chunk->first; g < chunk->end; g++) {
+        const EXT2_GroupDesc *gd = &ctx->gt->desc[g];
+        BitmapExtents ex;
+        if (count_bitmap(ctx, gd->bg_block_bitmap, group_blocks(ctx->sb, g), &ctx->free_blocks[g],
+                         ctx->histogram ? &ex : NULL) < 0 ||
+            count_bitmap(ctx, gd->bg_inode_bitmap, ctx->sb->s_inodes_per_group, &ctx->free_inodes[g], NULL) < 0) {
+            fprintf(stderr, "Grupo %u: no se pudo leer su mapa de bits\n", g);
+            chunk->error = 1;
+            return;
+        }
+        if (!ctx->histogram) continue;
+        if (g == chunk->first) chunk->ext = ex;
+        else bitmap_extents_merge(&chunk->ext, &ex);
+    }
+}
+
+static void print_count(FILE *out, const char *label, uint64_t recorded, uint64_t real) {
+    fprintf(out, "  %s: %llu (%+lld)\n", label, (unsigned long long)recorded,
+            (long long)recorded - (long long)real);
+}
+
+// Lee los mapas de bloques e inodos de todos los grupos (en paralelo con jobs hilos) y compara
+// los libres reales con los de los descriptores y el superbloque. Con histogram escribe además
+// los tramos libres de bloques por tamaño. Devuelve 1 si alguna cuenta no cuadra y -1 si hay error
+int bitmap_stats_EXT2(Image *img, const EXT2_Superblock *sb, int jobs, int histogram, FILE *out) {
+    EXT2_GroupTable gt;
+    if (read_group_descriptors(img, &gt, sb) < 0) return -1;
+
+    BitmapCtx ctx = { img, sb, &gt, histogram, NULL, NULL };
+    ctx.free_blocks = calloc(gt.count, sizeof(uint32_t));
+    ctx.free_inodes = calloc(gt.count, sizeof(uint32_t));
+
+    // Varios rangos por hilo para repartir mejor los grupos lentos
+    uint32_t nchunks = gt.count < (uint32_t)jobs * 8 ? gt.count : (uint32_t)jobs * 8;
+    BitmapChunk *chunks = calloc(nchunks ? nchunks : 1, sizeof(BitmapChunk));
+    if (!ctx.free_blocks || !ctx.free_inodes || !chunks) {
+        perror("calloc");
+        free(ctx.free_blocks);
+        free(ctx.free_inodes);
+        free(chunks);
+        free(gt.desc);
+        return -1;
+    }
+    for (uint32_t c = 0; c < nchunks; c++) {
+        chunks[c].ctx = &ctx;
+        chunks[c].first = (uint32_t)((uint64_t)gt.count * c / nchunks);
+        chunks[c].end = (uint32_t)((uint64_t)gt.count * (c + 1) / nchunks);
+    }
+
+    Pool *pool = jobs > 1 ? pool_create(jobs) : NULL;
+    for (uint32_t c = 0; c < nchunks; c++) {
+        if (pool) pool_submit(pool, bitmap_chunk_task, &chunks[c]);
+        else bitmap_chunk_task(&chunks[c], 0);
+    }
+    if (pool) {
+        pool_wait(pool);
+        pool_destroy(pool);
+    }
+
+    int ret = 0;
+    for (uint32_t c = 0; c < nchunks; c++) {
+        if (chunks[c].error) ret = -1;
+    }
+
+    if (ret == 0) {
+        uint64_t real_blocks = 0, real_inodes = 0, desc_blocks = 0, desc_inodes = 0;
+        for (uint32_t g = 0; g < gt.count; g++) {
+            real_blocks += ctx.free_blocks[g];
+            real_inodes += ctx.free_inodes[g];
+            desc_blocks += gt.desc[g].bg_free_blocks_count;
+            desc_inodes += gt.desc[g].bg_free_inodes_count;
+        }
+
+        fprintf(out, "--- Bitmap Statistics ---\n");
+        fprintf(out, "Groups: %u\n", gt.count);
+        fprintf(out, "Popcount: %s\n\n", bitmap_kernel_name());
+
+        fprintf(out, "FREE BLOCKS\n");
+        fprintf(out, "  Bitmaps: %llu\n", (unsigned long long)real_blocks);
+        print_count(out, "Descriptors", desc_blocks, real_blocks);
+        print_count(out, "Superblock", sb->s_free_blocks_count, real_blocks);
+        fprintf(out, "FREE INODES\n");
+        fprintf(out, "  Bitmaps: %llu\n", (unsigned long long)real_inodes);
+        print_count(out, "Descriptors", desc_inodes, real_inodes);
+        print_count(out, "Superblock", sb->s_free_inodes_count, real_inodes);
+
+        // Sólo los grupos cuyo descriptor no cuadra con su mapa
+        fprintf(out, "\nGROUP DELTAS (descriptor - bitmap)\n");
+        uint32_t bad = 0;
+        for (uint32_t g = 0; g < gt.count; g++) {
+            long long db = (long long)gt.desc[g].bg_free_blocks_count - ctx.free_blocks[g];
+            long long di = (long long)gt.desc[g].bg_free_inodes_count - ctx.free_inodes[g];
+            if (db || di) {
+                fprintf(out, "  Group %u: blocks %+lld, inodes %+lld\n", g, db, di);
+                bad++;
+            }
+        }
+        if (!bad) fprintf(out, "  None\n");
+        if (bad || desc_blocks != sb->s_free_blocks_count || real_blocks != sb->s_free_blocks_count ||
+            real_inodes != sb->s_free_inodes_count) {
+            ret = 1;
+        }
+
+        if (histogram && nchunks) {
+            BitmapExtents all = chunks[0].ext;
+            for (uint32_t c = 1; c < nchunks; c++) bitmap_extents_merge(&all, &chunks[c].ext);
+            bitmap_extents_close(&all);
+
+            fprintf(out, "\nFREE EXTENTS (blocks)\n");
+            uint64_t total = bitmap_print_hist(out, all.hist);
+            fprintf(out, "  Extents: %llu\n", (unsigned long long)total);
+            fprintf(out, "  Largest: %llu\n", (unsigned long long)all.largest);
+        }
+    }
+
+    free(chunks);
+    free(ctx.free_blocks);
+    free(ctx.free_inodes);
+    free(gt.desc);
+    return ret;
+}
+
+
+// --extract: un recorrido en paralelo llena la lista y luego se copian los ficheros
+typedef struct {
+    ExtractList list;           // Al principio: la copia recibe la lista y llega al contexto
+    Image *img;
+    const EXT2_Superblock *sb;
+    const EXT2_GroupTable *gt;
+} ExtractJobCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+} ExtractBlockCtx;
+
+// Como dump_run, pero los huecos se dejan sin escribir: cada tramo va a su posición
+static int sparse_run(const EXT2_Run *run, void *arg) {
+    DumpCtx *dc = arg;
+    uint64_t start = run->logical * dc->block_size;
+    if (start >= dc->size) return 1;
+    if (run->physical == 0) return 0;
+
+    uint64_t len = run->count * dc->block_size;
+    if (len > dc->size - start) len = dc->size - start;
+    if (lseek(dc->out_fd, (off_t)start, SEEK_SET) < 0) return -1;
+    return image_copy_out(dc->img, run->physical * dc->block_size, len, dc->out_fd) < 0 ? -1 : 0;
+}
+
+// Copia de un fichero (o sólo la fecha de un directorio) a partir de su inodo
+static int extract_copy(ExtractList *list, ExtractItem *item, int fd) {
+    ExtractJobCtx *ctx = (ExtractJobCtx *)list;
+    EXT2_Inode inode;
+    if (read_inode(ctx->img, ctx->sb, ctx->gt, (uint32_t)item->key, &inode) < 0) return -1;
+    item->mtime = inode.mtime;
+    if (fd < 0) return 0;
+
+    item->size = EXT2_inode_size(&inode);
+    DumpCtx dc = { ctx->img, EXT2_BLOCK_SIZE(ctx->sb), item->size, fd };
+    return map_EXT2_file(ctx->img, ctx->sb, &inode, sparse_run, &dc) < 0 ? -1 : 0;
+}
+
+static void extract_job_block(const uint8_t *buf, uint32_t block_size, void *arg) {
+    ExtractBlockCtx *eb = arg;
+    ExtractJobCtx *ctx = eb->walk->ctx;
+    WalkNode *node = eb->node;
+    const char *parent = node->data;
+    uint32_t pos = 0;
+
+    while (pos + 8 <= block_size) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
+        pos += e->rec_len;
+        if (e->inode == 0 || e->inode > ctx->sb->s_inodes_count || is_dot_entry(e)) continue;
+
+        // Sin tipo en la entrada hay que mirar el inodo
+        int type = e->file_type;
+        if (type == EXT2_FT_UNKNOWN) {
+            EXT2_Inode inode;
+            if (read_inode(ctx->img, ctx->sb, ctx->gt, e->inode, &inode) < 0) continue;
+            if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFDIR) type = EXT2_FT_DIR;
+            else if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFREG) type = EXT2_FT_REG_FILE;
+        }
+        if (type != EXT2_FT_DIR && type != EXT2_FT_REG_FILE) {
+            __atomic_add_fetch(&ctx->list.skipped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        char *path = find_join(parent, e->name, strnlen(e->name, e->name_len));
+        if (!path) continue;
+        if (type == EXT2_FT_DIR) {
+            // El hijo recorre su directorio con su propia copia de la ruta
+            char *child = strdup(path);
+            if (child && !walk_child_data(eb->walk, node, e->inode, node->depth + 1, child)) free(child);
+        }
+        extract_add(&ctx->list, path, e->inode, 0, -1, type == EXT2_FT_DIR);
+    }
+}
+
+static void extract_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    ExtractJobCtx *ctx = walk->ctx;
+    EXT2_Inode inode;
+    if (!node->data || read_inode(ctx->img, ctx->sb, ctx->gt, (uint32_t)node->key, &inode) < 0) return;
+
+    ExtractBlockCtx eb = { walk, node };
+    for_each_directory_block(ctx->img, ctx->sb, &inode, extract_job_block, &eb);
+}
+
+// Añade a la lista el directorio ino y todo lo que cuelga de él, con rutas bajo root
+static int extract_walk(ExtractJobCtx *ctx, uint32_t ino, const char *root, int jobs) {
+    if (extract_add(&ctx->list, strdup(root), ino, 0, -1, 1) < 0) return -1;
+
+    OutWriter out;
+    if (out_init_mem(&out) < 0) return -1;
+    char *data = strdup(root);
+    int ret = data ? walk_run_postorder(jobs, extract_job, find_finish, ctx, ino, data, 0, &out) : -1;
+    out_free(&out);
+    return ret;
+}
+
+// --extract para EXT2: restaura path (un fichero o un subárbol entero) dentro de dest
+int extract_EXT2(Image *img, const EXT2_Superblock *sb, const char *path, const char *dest, int jobs) {
+    EXT2_GroupTable gt;
+    if (read_group_descriptors(img, &gt, sb) < 0) {
+        return -1;
+    }
+
+    ExtractJobCtx ctx;
+    EXT2_Inode inode;
+    uint32_t ino;
+    if (extract_init(&ctx.list, extract_copy) < 0 || resolve_EXT2_path(img, sb, &gt, path, &inode, &ino) < 0) {
+        free(gt.desc);
+        return -1;
+    }
+    ctx.img = img;
+    ctx.sb = sb;
+    ctx.gt = &gt;
+
+    int ret = -1;
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        // Un solo fichero: se deja en dest con su nombre
+        const char *name = strrchr(path, '/');
+        name = name ? name + 1 : path;
+        if (mkdir(dest, 0755) < 0 && errno != EEXIST) perror(dest);
+        else if (extract_add(&ctx.list, find_join(dest, name, strlen(name)), ino, 0, -1, 0) == 0) ret = 0;
+    } else {
+        ret = extract_walk(&ctx, ino, dest, jobs);
+    }
+
+    if (ret == 0) ret = extract_run(&ctx.list, jobs);
+    fprintf(stderr, "Extraídos: %zu entradas, %llu bytes, %llu omitidas\n", ctx.list.count,
+            (unsigned long long)ctx.list.bytes, (unsigned long long)ctx.list.skipped);
+    extract_free(&ctx.list);
+    free(gt.desc);
+    return ret;
+}
+
+
+// --hash: la misma lista que --extract, pero cada tramo va al resumen en vez de a un fichero
+typedef struct {
+    Image *img;
+    HashCtx *h;
+    uint32_t block_size;
+    uint64_t size;
+    uint64_t pos;               // Bytes ya resumidos
+} HashFileCtx;
+
+// Los huecos entran como ceros sin leer nada de la imagen
+static int hash_run(const EXT2_Run *run, void *arg) {
+    HashFileCtx *hc = arg;
+    uint64_t start = run->logical * hc->block_size;
+    if (start >= hc->size) return 1;
+
+    uint64_t len = run->count * hc->block_size;
+    if (len > hc->size - start) len = hc->size - start;
+    hash_zeros(hc->h, start - hc->pos);
+    hc->pos = start + len;
+    if (run->physical == 0) {
+        hash_zeros(hc->h, len);
+        return 0;
+    }
+    return hash_image(hc->h, hc->img, run->physical * hc->block_size, len);
+}
+
+// Resume el contenido de un inodo en orden lógico
+static int hash_inode(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *inode, HashCtx *h) {
+    uint64_t size = EXT2_inode_size(inode);
+    HashFileCtx hc = { img, h, EXT2_BLOCK_SIZE(sb), size, 0 };
+    if (map_EXT2_file(img, sb, inode, hash_run, &hc) < 0) return -1;
+    hash_zeros(h, size - hc.pos);           // Hueco final sin bloques
+    return 0;
+}
+
+static int hash_file(ExtractList *list, ExtractItem *item, HashCtx *h) {
+    ExtractJobCtx *ctx = (ExtractJobCtx *)list;
+    EXT2_Inode inode;
+    if (read_inode(ctx->img, ctx->sb, ctx->gt, (uint32_t)item->key, &inode) < 0) return -1;
+
+    item->size = EXT2_inode_size(&inode);
+    return hash_inode(ctx->img, ctx->sb, &inode, h);
+}
+
+// --hash para EXT2: manifiesto de los ficheros regulares de path (por defecto la raíz)
+int hash_EXT2(Image *img, const EXT2_Superblock *sb, const char *path, int algo, int jobs) {
+    EXT2_GroupTable gt;
+    if (read_group_descriptors(img, &gt, sb) < 0) {
+        return -1;
+    }
+
+    ExtractJobCtx ctx;
+    EXT2_Inode inode;
+    uint32_t ino;
+    if (extract_init(&ctx.list, NULL) < 0 || resolve_EXT2_path(img, sb, &gt, path, &inode, &ino) < 0) {
+        free(gt.desc);
+        return -1;
+    }
+    ctx.img = img;
+    ctx.sb = sb;
+    ctx.gt = &gt;
+
+    int ret = -1;
+    char *root = find_root(path);
+    if (root && (inode.mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        ret = extract_add(&ctx.list, root, ino, 0, -1, 0);
+        root = NULL;
+    } else if (root) {
+        ret = extract_walk(&ctx, ino, root, jobs);
+    }
+    free(root);
+
+    if (ret == 0) ret = hash_manifest(&ctx.list, algo, jobs, hash_file, stdout);
+    extract_free(&ctx.list);
+    free(gt.desc);
+    return ret;
+}
+
+
+// --diff: los dos árboles se recorren a la vez, un nodo por cada par de directorios comunes
+typedef struct {
+    DiffCtx diff;               // Al principio: la comparación de ficheros recibe el contexto
+    Image *img[2];
+    const EXT2_Superblock *sb[2];
+    EXT2_GroupTable gt[2];
+} DiffJobCtx;
+
+typedef struct {
+    DiffJobCtx *ctx;
+    int side;                   // 0 = imagen A, 1 = imagen B
+    DiffList *list;
+} DiffBlockCtx;
+
+static void diff_job_block(const uint8_t *buf, uint32_t block_size, void *arg) {
+    DiffBlockCtx *db = arg;
+    DiffJobCtx *ctx = db->ctx;
+    int s = db->side;
+    uint32_t pos = 0;
+
+    while (pos + 8 <= block_size) {
+        const EXT2_DirEntry *e = (const EXT2_DirEntry *)(buf + pos);
+        if (e->rec_len < 8) break;
+        pos += e->rec_len;
+        if (e->inode == 0 || e->inode > ctx->sb[s]->s_inodes_count || is_dot_entry(e)) continue;
+
+        int is_dir = e->file_type == EXT2_FT_DIR;
+        if (e->file_type == EXT2_FT_UNKNOWN) {
+            EXT2_Inode inode;
+            if (read_inode(ctx->img[s], ctx->sb[s], &ctx->gt[s], e->inode, &inode) < 0) continue;
+            is_dir = (inode.mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+        }
+        diff_list_add(db->list, e->name, strnlen(e->name, e->name_len), e->inode, is_dir, NULL);
+    }
+}
+
+// Campos que cambian al escribir el contenido: si coinciden todos, el fichero no se lee
+static int same_inode_data(const EXT2_Inode *a, const EXT2_Inode *b) {
+    return a->mode == b->mode && a->size == b->size && a->dir_acl == b->dir_acl &&
+           a->mtime == b->mtime && a->ctime == b->ctime && a->blocks == b->blocks &&
+           memcmp(a->block, b->block, sizeof(a->block)) == 0;
+}
+
+// Con los metadatos distintos pero el mismo tipo y tamaño se comparan los resúmenes del
+// contenido. Los enlaces rápidos y los dispositivos guardan su contenido en block[]
+static int diff_file(DiffCtx *dc, const DiffEntry *a, const DiffEntry *b) {
+    DiffJobCtx *ctx = (DiffJobCtx *)dc;
+    EXT2_Inode inode[2];
+    if (read_inode(ctx->img[0], ctx->sb[0], &ctx->gt[0], (uint32_t)a->key, &inode[0]) < 0 ||
+        read_inode(ctx->img[1], ctx->sb[1], &ctx->gt[1], (uint32_t)b->key, &inode[1]) < 0) {
+        return -1;
+    }
+
+    if (same_inode_data(&inode[0], &inode[1])) {
+        __atomic_add_fetch(&dc->quick, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    uint16_t type = inode[0].mode & EXT2_S_IFMT;
+    uint64_t size = EXT2_inode_size(&inode[0]);
+    if (type != (inode[1].mode & EXT2_S_IFMT) || size != EXT2_inode_size(&inode[1])) return 1;
+    int in_blocks = type == EXT2_S_IFREG ||
+                    (type == EXT2_S_IFLNK && !is_fast_symlink(ctx->sb[0], &inode[0]) && !is_fast_symlink(ctx->sb[1], &inode[1]));
+    if (!in_blocks) return memcmp(inode[0].block, inode[1].block, sizeof(inode[0].block)) != 0;
+
+    char digest[2][HASH_HEX_MAX + 1];
+    for (int s = 0; s < 2; s++) {
+        HashCtx h;
+        hash_init(&h, HASH_XXH64);
+        if (hash_inode(ctx->img[s], ctx->sb[s], &inode[s], &h) < 0) return -1;
+        hash_final(&h, digest[s]);
+    }
+    __atomic_add_fetch(&dc->hashed, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dc->hashed_bytes, 2 * size, __ATOMIC_RELAXED);
+    return strcmp(digest[0], digest[1]) != 0;
+}
+
+static void diff_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    DiffJobCtx *ctx = walk->ctx;
+    const DiffDir *dir = node->data;
+    if (!dir) return;
+
+    uint32_t ino[2] = { (uint32_t)node->key, (uint32_t)dir->key_b };
+    DiffList lists[2];
+    memset(lists, 0, sizeof(lists));
+    int ok = 1;
+    for (int s = 0; s < 2 && ok; s++) {
+        EXT2_Inode inode;
+        if (read_inode(ctx->img[s], ctx->sb[s], &ctx->gt[s], ino[s], &inode) < 0) {
+            ok = 0;
+            break;
+        }
+        DiffBlockCtx db = { ctx, s, &lists[s] };
+        for_each_directory_block(ctx->img[s], ctx->sb[s], &inode, diff_job_block, &db);
+    }
+
+    if (ok) diff_merge(walk, node, &lists[0], &lists[1]);
+    else __atomic_add_fetch(&ctx->diff.errors, 1, __ATOMIC_RELAXED);
+    diff_list_free(&lists[0]);
+    diff_list_free(&lists[1]);
+}
+
+// --diff para EXT2: rutas añadidas, borradas y modificadas de la imagen A a la B
+int diff_EXT2(Image *img_a, const EXT2_Superblock *sb_a, Image *img_b, const EXT2_Superblock *sb_b, int jobs) {
+    DiffJobCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.diff.file = diff_file;
+    ctx.img[0] = img_a;
+    ctx.img[1] = img_b;
+    ctx.sb[0] = sb_a;
+    ctx.sb[1] = sb_b;
+    if (read_group_descriptors(img_a, &ctx.gt[0], sb_a) < 0) {
+        return -1;
+    }
+    if (read_group_descriptors(img_b, &ctx.gt[1], sb_b) < 0) {
+        free(ctx.gt[0].desc);
+        return -1;
+    }
+
+    int ret = -1;
+    OutWriter out;
+    DiffDir *root = diff_dir_new("/", EXT2_ROOT_INO);
+    if (root && out_init(&out, STDOUT_FILENO) == 0) {
+        fflush(stdout);
+        ret = walk_run_postorder(jobs, diff_job, diff_finish, &ctx, EXT2_ROOT_INO, root, 0, &out);
+        out_free(&out);
+        diff_summary(&ctx.diff, stderr);
+    } else if (root) {
+        free(root->path);
+        free(root);
+    }
 
-    close(fd);
+    free(ctx.gt[0].desc);
+    free(ctx.gt[1].desc);
+    return ret < 0 || ctx.diff.errors ? -1 : 0;
 }
\ No newline at end of file
@@ -8,6 +8,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "image.h"
+#include "out.h"
+#include "find.h"
+#include "htree.h"
+
 
 // Fase 1
 #define EXT2_SUPERBLOCK_OFFSET 1024
@@ -17,7 +22,22 @@
 #define EXT2_BLOCK_SIZE(sb) (1024 << (sb)->s_log_block_size)
 #define EXT2_INODE_SIZE 256  // asumiendo rev 0
 
+#define EXT2_FT_UNKNOWN 0
+#define EXT2_FT_REG_FILE 1
 #define EXT2_FT_DIR 2
+#define EXT2_ROOT_INO 2
+
+// Directorios indexados (htree)
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020  // s_feature_compat
+#define EXT2_INDEX_FL 0x00001000              // i_flags: el directorio tiene índice
+#define EXT2_FLAGS_UNSIGNED_HASH 0x0002       // s_flags: hash con caracteres sin signo
+#define EXT2_HTREE_MAX_LEVELS 3               // Raíz más dos niveles intermedios
+
+// Tipo de fichero en i_mode
+#define EXT2_S_IFMT  0xF000
+#define EXT2_S_IFREG 0x8000
+#define EXT2_S_IFDIR 0x4000
+#define EXT2_S_IFLNK 0xA000
 
 
 #define MAX_BLOCK_SIZE 4096
@@ -28,6 +48,10 @@
 #define EXT2_TRIPLE_INDIRECT_BLOCK 14 // Índice del bloque triple indirecto
 #define EXT2_N_BLOCKS 15 // Total de bloques en el inodo
 
+#define EXT2_PREFETCH_BATCH 256 // Inodos por lote de lectura adelantada
+#define EXT2_DIR_BATCH 64       // Bloques de directorio por lote de lectura
+#define EXT2_PREFETCH_GAP 8     // Bloques de separación que aún se piden en el mismo rango
+
 
 // Estructura del superbloque EXT2
 #pragma pack(push, 1)
@@ -64,7 +88,20 @@ typedef struct {
     uint32_t s_feature_incompat;
     uint32_t s_feature_ro_compat;
     uint8_t s_uuid[16];
-    char s_volume_name[16];          // 0x78: Volume name
+    char s_volume_name[16];          // 0x78: Volume name (sin terminador si ocupa los 16)
+    char s_last_mounted[64];         // 0x88: Directory where last mounted
+    uint32_t s_algorithm_usage_bitmap; // 0xC8
+    uint8_t s_prealloc_blocks;       // 0xCC
+    uint8_t s_prealloc_dir_blocks;   // 0xCD
+    uint16_t s_padding1;             // 0xCE
+    uint8_t s_journal_uuid[16];      // 0xD0
+    uint32_t s_journal_inum;         // 0xE0
+    uint32_t s_journal_dev;          // 0xE4
+    uint32_t s_last_orphan;          // 0xE8
+    uint32_t s_hash_seed[4];         // 0xEC: Seed for directory hashes
+    uint8_t s_def_hash_version;      // 0xFC: Default hash version
+    uint8_t s_reserved_fd[0x63];     // 0xFD
+    uint32_t s_flags;                // 0x160: Misc flags (signed/unsigned hash)
 } EXT2_Superblock;
 
 // Fase 2
@@ -109,9 +146,56 @@ typedef struct {
 } EXT2_GroupDesc;
 #pragma pack(pop)
 
-int detect_EXT2(const char *device, EXT2_Superblock *sb);
-void print_EXT2_info(const EXT2_Superblock *sb);
-void print_EXT2_tree(const char *image_path, const EXT2_Superblock *sb);
+// Tabla completa de descriptores de grupo, cargada una sola vez
+typedef struct {
+    EXT2_GroupDesc *desc;   // Descriptores contiguos, uno por grupo
+    uint32_t count;         // Número de grupos de bloques
+} EXT2_GroupTable;
+
+// Tramo de bloques lógicos consecutivos de un fichero (physical == 0 es un hueco)
+typedef struct {
+    uint64_t logical;
+    uint64_t physical;
+    uint64_t count;
+} EXT2_Run;
+
+// Callback por tramo: devuelve 0 para seguir, >0 para parar y <0 si hay error
+typedef int (*EXT2_RunFn)(const EXT2_Run *run, void *ctx);
+
+// Callback por bloque de datos de un directorio
+typedef void (*EXT2_DirBlockFn)(const uint8_t *buf, uint32_t block_size, void *ctx);
+
+int probe_EXT2(const uint8_t *buf, size_t len, EXT2_Superblock *sb);
+void print_EXT2_info(const EXT2_Superblock *sb, FILE *out);
+int print_EXT2_tree(Image *img, const EXT2_Superblock *sb, int jobs);
+int cat_EXT2(Image *img, const EXT2_Superblock *sb, const char *filepath);
+int stat_EXT2(Image *img, const EXT2_Superblock *sb, const char *filepath);
+int du_EXT2(Image *img, const EXT2_Superblock *sb, const char *path, int jobs, int max_depth);
+int find_EXT2(Image *img, const EXT2_Superblock *sb, const char *path, FindQuery *q, int jobs);
+int extract_EXT2(Image *img, const EXT2_Superblock *sb, const char *path, const char *dest, int jobs);
+int hash_EXT2(Image *img, const EXT2_Superblock *sb, const char *path, int algo, int jobs);
+int diff_EXT2(Image *img_a, const EXT2_Superblock *sb_a, Image *img_b, const EXT2_Superblock *sb_b, int jobs);
+int bitmap_stats_EXT2(Image *img, const EXT2_Superblock *sb, int jobs, int histogram, FILE *out);
+
+int tree_EXT2(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt, int jobs, OutWriter *out);
+int du_EXT2_tree(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt, const char *path,
+                 int jobs, int max_depth, OutWriter *out);
+int dump_EXT2_inode(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *inode, int out_fd);
+void print_EXT2_stat(const char *path, uint32_t ino, const EXT2_Inode *inode, FILE *out);
+void print_time(FILE *out, uint32_t timestamp);
+
+int read_group_descriptors(Image *img, EXT2_GroupTable *gt, const EXT2_Superblock *sb);
+void prefetch_EXT2_inodes(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt,
+                          const uint32_t *inos, size_t n);
+int read_inode(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt, uint32_t inode_num, EXT2_Inode *out);
+uint64_t EXT2_inode_size(const EXT2_Inode *inode);
+void for_each_directory_block(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *inode,
+                              EXT2_DirBlockFn fn, void *ctx);
+int map_EXT2_file(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *inode,
+                  EXT2_RunFn fn, void *ctx);
+uint32_t lookup_EXT2_entry(Image *img, const EXT2_Superblock *sb, const EXT2_Inode *dir, const char *name);
+int resolve_EXT2_path(Image *img, const EXT2_Superblock *sb, const EXT2_GroupTable *gt,
+                      const char *filepath, EXT2_Inode *out, uint32_t *ino_out);
 
 
 #endif
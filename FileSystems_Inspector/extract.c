@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+#include "extract.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Ficheros por tarea del pool: muchos ficheros pequeños no pagan una tarea cada uno
+#define EXTRACT_BATCH 32
+
+typedef struct {
+    ExtractList *list;
+    ExtractItemFn fn;
+    void *arg;
+    size_t first, end;
+} ExtractBatch;
+
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static int cmp_item(const void *a, const void *b) {
+    return strcmp(((const ExtractItem *)a)->path, ((const ExtractItem *)b)->path);
+}
+
+static void set_mtime(int fd, const char *path, int64_t mtime) {
+    if (mtime < 0) return;
+    struct timespec ts[2] = { { 0, UTIME_OMIT }, { (time_t)mtime, 0 } };
+    int ret = fd >= 0 ? futimens(fd, ts) : utimensat(AT_FDCWD, path, ts, 0);
+    if (ret < 0) perror(path);
+}
+
+// Crea el fichero, copia su contenido y le deja el tamaño y la fecha de la imagen
+static void extract_file(ExtractList *list, size_t index, void *arg) {
+    (void)arg;
+    ExtractItem *item = &list->items[index];
+    int fd = open(item->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(item->path);
+        __atomic_add_fetch(&list->errors, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    // Los huecos se saltan con lseek: ftruncate deja también el del final
+    if (list->copy(list, item, fd) < 0 || ftruncate(fd, (off_t)item->size) < 0) {
+        fprintf(stderr, "Error al extraer %s\n", item->path);
+        __atomic_add_fetch(&list->errors, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&list->bytes, item->size, __ATOMIC_RELAXED);
+        set_mtime(fd, item->path, item->mtime);
+    }
+    close(fd);
+}
+
+static void extract_batch_task(void *arg, int worker) {
+    (void)worker;
+    ExtractBatch *b = arg;
+    for (size_t i = b->first; i < b->end; i++) {
+        if (!b->list->items[i].is_dir) b->fn(b->list, i, b->arg);
+    }
+}
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+int extract_init(ExtractList *list, ExtractCopyFn copy) {
+    memset(list, 0, sizeof(*list));
+    list->copy = copy;
+    return pthread_mutex_init(&list->lock, NULL) == 0 ? 0 : -1;
+}
+
+// Añade una entrada encontrada en el recorrido (se queda con path). Seguro entre hilos
+int extract_add(ExtractList *list, char *path, uint64_t key, uint64_t size, int64_t mtime, int is_dir) {
+    if (!path) return -1;
+    pthread_mutex_lock(&list->lock);
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 256;
+        ExtractItem *items = realloc(list->items, cap * sizeof(ExtractItem));
+        if (!items) {
+            pthread_mutex_unlock(&list->lock);
+            perror("realloc");
+            free(path);
+            return -1;
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+    list->items[list->count++] = (ExtractItem){ path, key, size, mtime, is_dir };
+    pthread_mutex_unlock(&list->lock);
+    return 0;
+}
+
+// Ordena la lista por ruta: un directorio queda siempre antes que lo que contiene
+void extract_sort(ExtractList *list) {
+    qsort(list->items, list->count, sizeof(ExtractItem), cmp_item);
+}
+
+// Llama a fn con el índice de cada fichero (no de los directorios), por lotes en jobs hilos.
+// Devuelve -1 si no se pudo preparar el reparto
+int extract_for_each(ExtractList *list, int jobs, ExtractItemFn fn, void *arg) {
+    size_t nbatches = (list->count + EXTRACT_BATCH - 1) / EXTRACT_BATCH;
+    ExtractBatch *batches = malloc((nbatches ? nbatches : 1) * sizeof(ExtractBatch));
+    if (!batches) {
+        perror("malloc");
+        return -1;
+    }
+    Pool *pool = jobs > 1 ? pool_create(jobs) : NULL;
+    for (size_t b = 0; b < nbatches; b++) {
+        batches[b].list = list;
+        batches[b].fn = fn;
+        batches[b].arg = arg;
+        batches[b].first = b * EXTRACT_BATCH;
+        batches[b].end = batches[b].first + EXTRACT_BATCH < list->count ? batches[b].first + EXTRACT_BATCH : list->count;
+        if (pool) pool_submit(pool, extract_batch_task, &batches[b]);
+        else extract_batch_task(&batches[b], 0);
+    }
+    if (pool) {
+        pool_wait(pool);
+        pool_destroy(pool);
+    }
+    free(batches);
+    return 0;
+}
+
+// Restaura la lista: los directorios se crean antes (en orden de ruta, el padre siempre
+// primero), los ficheros se copian por lotes en jobs hilos y las fechas de los directorios
+// se ponen al final, cuando ya no va a cambiar su contenido. Devuelve -1 si algo falla
+int extract_run(ExtractList *list, int jobs) {
+    extract_sort(list);
+
+    for (size_t i = 0; i < list->count; i++) {
+        const ExtractItem *item = &list->items[i];
+        if (item->is_dir && mkdir(item->path, 0755) < 0 && errno != EEXIST) {
+            perror(item->path);
+            return -1;
+        }
+    }
+
+    if (extract_for_each(list, jobs, extract_file, NULL) < 0) return -1;
+
+    // De dentro afuera: crear un hijo ya no tocará la fecha de un padre arreglado
+    for (size_t i = list->count; i-- > 0;) {
+        ExtractItem *item = &list->items[i];
+        if (!item->is_dir) continue;
+        if (list->copy(list, item, -1) == 0) set_mtime(-1, item->path, item->mtime);
+    }
+    return list->errors ? -1 : 0;
+}
+
+void extract_free(ExtractList *list) {
+    for (size_t i = 0; i < list->count; i++) free(list->items[i].path);
+    free(list->items);
+    list->items = NULL;
+    list->count = list->cap = 0;
+    pthread_mutex_destroy(&list->lock);
+}
@@ -0,0 +1,48 @@
+#ifndef EXTRACT_H
+#define EXTRACT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+
+// Fichero o directorio que se restaura en el host
+typedef struct {
+    char *path;                 // Ruta en el host (destino + ruta relativa)
+    uint64_t key;               // Inodo (EXT2) o entrada de directorio (FAT16) de la que sale
+    uint64_t size;
+    int64_t mtime;              // Segundos Unix (-1 = lo deja el sistema de archivos al copiar)
+    int is_dir;
+} ExtractItem;
+
+typedef struct ExtractList ExtractList;
+
+// Copia el contenido de item en fd (fd < 0 en directorios, que sólo necesitan su mtime).
+// Devuelve 0 o -1 si hay error
+typedef int (*ExtractCopyFn)(ExtractList *list, ExtractItem *item, int fd);
+
+// Trabajo sobre el fichero index de la lista (extract_for_each)
+typedef void (*ExtractItemFn)(ExtractList *list, size_t index, void *arg);
+
+// Parte común de --extract: va al principio del contexto de cada sistema de archivos.
+// El recorrido llena la lista y luego un pool de hilos crea y copia los ficheros
+// (--hash usa la misma lista sin copia: copy es NULL)
+struct ExtractList {
+    ExtractCopyFn copy;
+    pthread_mutex_t lock;       // Protege items durante el recorrido
+    ExtractItem *items;
+    size_t count, cap;
+    uint64_t bytes;             // Bytes copiados (atómico)
+    uint64_t skipped;           // Entradas que no son ficheros regulares ni directorios (atómico)
+    int errors;                 // Ficheros que no se han podido restaurar (atómico)
+};
+
+
+int extract_init(ExtractList *list, ExtractCopyFn copy);
+int extract_add(ExtractList *list, char *path, uint64_t key, uint64_t size, int64_t mtime, int is_dir);
+void extract_sort(ExtractList *list);
+int extract_for_each(ExtractList *list, int jobs, ExtractItemFn fn, void *arg);
+int extract_run(ExtractList *list, int jobs);
+void extract_free(ExtractList *list);
+
+#endif
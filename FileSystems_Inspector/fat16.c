@@ -1,4 +1,14 @@
+#define _DEFAULT_SOURCE
 #include "fat16.h"
+#include "walk.h"
+#include "du.h"
+#include "out.h"
+#include "bitmap.h"
+#include "pool.h"
+#include "extract.h"
+#include "hash.h"
+#include "diff.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -8,6 +18,11 @@
 #include <dirent.h>
 #include <ctype.h>
 #include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // ----------------------------------------
 // --------- Funciones Privadas -----------
@@ -30,14 +45,9 @@ uint32_t calculate_cluster_count(const FAT16_BPB *bpb) {
 
 // FASE 2
 
-void print_indent(int level) {
-    for (int i = 0; i < level; ++i) {
-        printf("│   ");
-    }
-}
-
-void print_entry_name(const uint8_t *entry) {
-    char name[12];
+// Nombre 8.3 legible ("NOMBRE.EXT") en out; devuelve su longitud
+int format_entry_name(const uint8_t *entry, char out[13]) {
+    char name[13];
     memset(name, 0, sizeof(name));
 
     memcpy(name, entry, 8);
@@ -48,94 +58,201 @@ void print_entry_name(const uint8_t *entry) {
         strncat(name, (char*)&entry[8], 3);
     }
 
-    printf("%s\n", name);
+    memcpy(out, name, sizeof(name));
+    return (int)strlen(out);
 }
 
 
-void read_directory(int fd, const FAT16_BPB *bpb, uint16_t cluster, int level, int is_root) {
+// Entrega de las entradas de clusters de directorio leídos por lotes
+typedef struct {
+    FAT16_EntryFn fn;
+    void *ctx;
+} DirClusterBatch;
+
+static int scan_dir_cluster(size_t index, const uint8_t *buffer, size_t cluster_size, void *arg) {
+    (void)index;
+    DirClusterBatch *db = arg;
+
+    // Recorrer las entradas del directorio (dentro del clúster)
+    int ret = 0;
+    for (size_t i = 0; i < cluster_size && ret == 0; i += DIR_ENTRY_SIZE) {
+        const uint8_t *entry = buffer + i;
+
+        if (entry[0] == 0x00) break;
+        if (entry[0] == 0xE5) continue;
+        if (entry[11] == 0x0F) continue;
+
+        ret = db->fn(entry, db->ctx);
+    }
+    return ret;
+}
+
+// Número de clusters distintos de la cadena que empieza en start. Se para en el final, en
+// un enlace a un cluster libre o fuera de la tabla o, si la cadena vuelve sobre sí misma,
+// justo antes de repetir el primer cluster (el ciclo se detecta con el método de Brent)
+static uint32_t chain_distinct(const FAT16_Table *fat, uint16_t start) {
+#define FAT16_LINK(c) ((c) >= 2 && (c) < 0xFFF8 && (c) < fat->count)
+    if (!FAT16_LINK(start)) return 0;
+
+    uint32_t power = 1, lam = 1, len = 1;
+    uint16_t tortoise = start, hare = fat->entries[start];
+    while (FAT16_LINK(hare) && hare != tortoise) {
+        if (power == lam) {
+            tortoise = hare;
+            power *= 2;
+            lam = 0;
+        }
+        hare = fat->entries[hare];
+        lam++;
+        len++;
+    }
+    if (!FAT16_LINK(hare)) return len;
+
+    // Ciclo de longitud lam: el primer cluster repetido está a mu pasos del principio
+    uint32_t mu = 0;
+    tortoise = hare = start;
+    for (uint32_t i = 0; i < lam; i++) hare = fat->entries[hare];
+    while (tortoise != hare) {
+        tortoise = fat->entries[tortoise];
+        hare = fat->entries[hare];
+        mu++;
+    }
+    return mu + lam;
+#undef FAT16_LINK
+}
+
+// Recorre las entradas válidas de un directorio (cluster 0 = raíz) y las entrega a fn.
+// Se saltan las entradas borradas y LFN; se para en la marca de fin o si fn devuelve != 0
+int for_each_dir_entry(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t cluster,
+                       FAT16_EntryFn fn, void *ctx) {
     uint32_t root_dir_sectors = ((bpb->RootEntries * 32) + (bpb->BytesPerSector - 1)) / bpb->BytesPerSector;
     uint32_t first_data_sector = bpb->ReservedSectors + (bpb->NumFATs * bpb->FATSize16) + root_dir_sectors;
 
-    if (is_root) {
+    if (cluster == 0) {
         // El directorio raíz está en una ubicación fija
         uint32_t dir_sector = bpb->ReservedSectors + (bpb->NumFATs * bpb->FATSize16);
         size_t dir_size = root_dir_sectors * bpb->BytesPerSector;
 
-        // Mover el puntero al sector del directorio
-        uint8_t *buffer = malloc(dir_size);
-        lseek(fd, dir_sector * bpb->BytesPerSector, SEEK_SET);
-        read(fd, buffer, dir_size);
+        // Obtener la vista del directorio raíz
+        ImageView view;
+        const uint8_t *buffer = image_get_block(img, (uint64_t)dir_sector * bpb->BytesPerSector, dir_size, CACHE_DATA, &view);
+        if (!buffer) return -1;
 
         // Leer las entradas del directorio
-        for (size_t i = 0; i < dir_size; i += DIR_ENTRY_SIZE) {
-            uint8_t *entry = buffer + i;
+        int ret = 0;
+        for (size_t i = 0; i < dir_size && ret == 0; i += DIR_ENTRY_SIZE) {
+            const uint8_t *entry = buffer + i;
 
             if (entry[0] == 0x00) break; // fin de entradas
             if (entry[0] == 0xE5) continue; // entrada eliminada
             if (entry[11] == 0x0F) continue; // entrada LFN (long filename)
 
-            print_indent(level);
-            printf("├── ");
-            print_entry_name(entry);
-
-            // Si es un directorio, leerlo recursivamente (excepto para "." y "..")
-            if ((entry[11] & ATTR_DIRECTORY) && entry[0] != '.') {
-                uint16_t firstCluster = entry[26] | (entry[27] << 8);
-                if (firstCluster != 0) {
-                    read_directory(fd, bpb, firstCluster, level + 1, 0);
-                }
-            }
+            ret = fn(entry, ctx);
         }
 
-        free(buffer);
-        return;
+        image_put(img, &view);
+        return ret;
     }
 
-    // --- Subdirectorios: seguir la cadena de clusters ---
+    // --- Subdirectorios: la cadena se saca de la FAT en memoria y los clusters
+    // se leen por lotes (en vuelo a la vez con --io-depth), entregados en orden ---
+    size_t cluster_size = bpb->SectorsPerCluster * bpb->BytesPerSector;
     uint16_t current_cluster = cluster;
+    DirClusterBatch db = { fn, ctx };
 
-    while (current_cluster < 0xFFF8) {  // Fin de cadena en FAT16
-        // Calcular el sector inicial del clúster
-        uint32_t first_sector = ((current_cluster - 2) * bpb->SectorsPerCluster) + first_data_sector;
-        size_t cluster_size = bpb->SectorsPerCluster * bpb->BytesPerSector;
+    // Una cadena dañada (con ciclo o que acaba en un cluster libre) se lee sólo hasta ahí
+    uint32_t left = chain_distinct(fat, cluster);
+    while (left > 0) {
+        ImageReq reqs[FAT16_DIR_BATCH];
+        size_t n = 0;
+        while (n < FAT16_DIR_BATCH && left > 0) {
+            // Calcular el sector inicial del clúster
+            uint32_t first_sector = ((current_cluster - 2) * bpb->SectorsPerCluster) + first_data_sector;
+            reqs[n++] = (ImageReq){ (uint64_t)first_sector * bpb->BytesPerSector, cluster_size, CACHE_DATA };
 
-        // Mover el puntero al sector del clúster correspondiente y leerlo
-        uint8_t *buffer = malloc(cluster_size);
-        lseek(fd, first_sector * bpb->BytesPerSector, SEEK_SET);
-        read(fd, buffer, cluster_size);
+            // Obtener el siguiente clúster desde la FAT en memoria
+            current_cluster = next_FAT16_cluster(fat, current_cluster);
+            left--;
+        }
 
-        // Recorrer las entradas del directorio (dentro del clúster)
-        for (size_t i = 0; i < cluster_size; i += DIR_ENTRY_SIZE) {
-            uint8_t *entry = buffer + i;
+        int ret = image_read_batch(img, reqs, n, 1, scan_dir_cluster, &db);
+        if (ret != 0) return ret;
+    }
+    return 0;
+}
 
-            if (entry[0] == 0x00) break;
-            if (entry[0] == 0xE5) continue;
-            if (entry[11] == 0x0F) continue;
+// Contexto del recorrido secuencial
+typedef struct {
+    Image *img;
+    const FAT16_BPB *bpb;
+    FAT16_Table *fat;
+    int level;
+    OutWriter *out;
+} PrintCtx;
 
-            print_indent(level);
-            printf("├── ");
-            print_entry_name(entry);
+void read_directory(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t cluster, int level, int is_root, OutWriter *out);
 
-            if ((entry[11] & ATTR_DIRECTORY) && entry[0] != '.') {
-                uint16_t firstCluster = entry[26] | (entry[27] << 8);
-                if (firstCluster != 0) {
-                    read_directory(fd, bpb, firstCluster, level + 1, 0);
-                }
-            }
+static int print_entry(const uint8_t *entry, void *arg) {
+    PrintCtx *pc = arg;
+    char name[13];
+    int len = format_entry_name(entry, name);
+
+    out_line(pc->out, pc->level, "├── ", sizeof("├── ") - 1, name, len);
+
+    // Si es un directorio, leerlo recursivamente (excepto para "." y "..")
+    if ((entry[11] & ATTR_DIRECTORY) && entry[0] != '.') {
+        uint16_t firstCluster = entry[26] | (entry[27] << 8);
+        if (firstCluster != 0) {
+            read_directory(pc->img, pc->bpb, pc->fat, firstCluster, pc->level + 1, 0, pc->out);
         }
+    }
+    return 0;
+}
+
+void read_directory(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t cluster, int level, int is_root, OutWriter *out) {
+    PrintCtx pc = { img, bpb, fat, level, out };
+    for_each_dir_entry(img, bpb, fat, is_root ? 0 : cluster, print_entry, &pc);
+}
+
+
+// Contexto compartido por los hilos del recorrido paralelo
+typedef struct {
+    Image *img;
+    const FAT16_BPB *bpb;
+    FAT16_Table *fat;
+} TreeJobCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+} TreeEntryCtx;
 
-        free(buffer);
+static int tree_job_entry(const uint8_t *entry, void *arg) {
+    TreeEntryCtx *te = arg;
+    WalkNode *node = te->node;
+    char name[13];
+    int len = format_entry_name(entry, name);
 
-        // Obtener el siguiente clúster desde la FAT
-        off_t fat_offset = bpb->ReservedSectors * bpb->BytesPerSector;
-        off_t next_cluster_offset_in_fat = fat_offset + current_cluster * 2;
-        uint16_t next_cluster;
-        lseek(fd, next_cluster_offset_in_fat, SEEK_SET);
-        read(fd, &next_cluster, 2);
+    walk_indent(node, node->depth);
+    walk_append(node, "├── ", sizeof("├── ") - 1);
+    walk_append(node, name, len);
+    walk_append(node, "\n", 1);
 
-        if (next_cluster >= 0xFFF8) break;  // Fin de cadena
-        current_cluster = next_cluster;
+    // Cada subdirectorio es una tarea nueva; su salida se intercala aquí
+    if ((entry[11] & ATTR_DIRECTORY) && entry[0] != '.') {
+        uint16_t firstCluster = entry[26] | (entry[27] << 8);
+        if (firstCluster != 0) {
+            walk_child(te->walk, node, firstCluster, node->depth + 1);
+        }
     }
+    return 0;
+}
+
+static void tree_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    TreeJobCtx *ctx = walk->ctx;
+    TreeEntryCtx te = { walk, node };
+    for_each_dir_entry(ctx->img, ctx->bpb, ctx->fat, (uint16_t)node->key, tree_job_entry, &te);
 }
 
 
@@ -143,77 +260,168 @@ void read_directory(int fd, const FAT16_BPB *bpb, uint16_t cluster, int level, i
 // --------- Funciones Publicas -----------
 // ----------------------------------------
 
-int detect_FAT16(const char *device, FAT16_BPB *bpb) {
+// Reconoce FAT16 en los primeros bytes de la imagen (el BPB está en el sector de arranque)
+int probe_FAT16(const uint8_t *buf, size_t len, FAT16_BPB *bpb) {
 
     //----FAT16----
-    int fd = open(device, O_RDONLY);
-    if (fd == -1) {
-        perror("Error al abrir el dispositivo");
+    if (len < FAT16_BPB_OFFSET + 512) {
         return -1;
     }
 
-    // Ir al offset del BPB (es 0 pero para entender mejor el funcionamiento)
-    if (lseek(fd, FAT16_BPB_OFFSET, SEEK_SET) == -1) {
-        perror("Error al hacer lseek para FAT16");
-        close(fd);
-        return -1;
-    }
+    // Obtener el BPB desde el sector de arranque
+    memcpy(bpb, buf + FAT16_BPB_OFFSET, sizeof(FAT16_BPB));
 
-    // Leer 512 bytes del sector de arranque
-    unsigned char boot_sector[512];
-    if (read(fd, boot_sector, sizeof(boot_sector)) != sizeof(boot_sector)) {
-        perror("Error al leer el sector de arranque");
-        close(fd);
+    // Un BPB sin geometría válida no es FAT (evita divisiones por cero)
+    if (bpb->BytesPerSector == 0 || bpb->SectorsPerCluster == 0) {
         return -1;
     }
 
-    // Obtener el BPB desde el sector leído
-    memcpy(bpb, boot_sector, sizeof(FAT16_BPB));
-
-
     // Calcular número de clusters
     uint32_t cluster_count = calculate_cluster_count(bpb);
 
     // Verificar si el tipo de sistema de archivos es FAT16
     if ((cluster_count >= 4085 && cluster_count < 65525)) {
         // Es FAT16
-        close(fd);
         return 1;
 
     } else {
         // No es FAT16
         //printf("No es un sistema de archivos FAT16 (CountofClusters: %u)\n", cluster_count);
-        close(fd);
         return -1;
     }
     
 }
 
-void print_FAT16_info(const FAT16_BPB *bpb) {
-    printf("\n--- Filesystem Information ---\n\n");
-    printf("Filesystem: FAT16\n\n");
+void print_FAT16_info(const FAT16_BPB *bpb, FILE *out) {
+    fprintf(out, "\n--- Filesystem Information ---\n\n");
+    fprintf(out, "Filesystem: FAT16\n\n");
     
-    printf("System name: %.8s\n", bpb->OEMName);
-    printf("Sector size: %u\n", bpb->BytesPerSector);
-    printf("Sectors per cluster: %u\n", bpb->SectorsPerCluster);
-    printf("Reserved sectors: %u\n", bpb->ReservedSectors);
-    printf("# of FATs: %u\n", bpb->NumFATs);
-    printf("Max root entries: %u\n", bpb->RootEntries);
-    printf("Sectors per FAT: %u\n", bpb->FATSize16);
-    printf("Label: %.11s\n\n", bpb->VolumeLabel);
-}
-
-void print_FAT16_tree(const char *image_path, const FAT16_BPB *bpb) {
-    int fd = open(image_path, O_RDONLY);
-    if (fd < 0) {
-        perror("No se pudo abrir la imagen/dispositivo");
-        return;
+    fprintf(out, "System name: %.8s\n", bpb->OEMName);
+    fprintf(out, "Sector size: %u\n", bpb->BytesPerSector);
+    fprintf(out, "Sectors per cluster: %u\n", bpb->SectorsPerCluster);
+    fprintf(out, "Reserved sectors: %u\n", bpb->ReservedSectors);
+    fprintf(out, "# of FATs: %u\n", bpb->NumFATs);
+    fprintf(out, "Max root entries: %u\n", bpb->RootEntries);
+    fprintf(out, "Sectors per FAT: %u\n", bpb->FATSize16);
+    fprintf(out, "Label: %.11s\n\n", bpb->VolumeLabel);
+}
+
+// Carga la FAT principal en memoria: sin copia si la imagen está proyectada,
+// o con una única lectura en caso contrario
+int load_FAT16_table(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat) {
+    STATS_START(t0);
+    size_t fat_bytes = (size_t)bpb->FATSize16 * bpb->BytesPerSector;
+    uint64_t fat_offset = (uint64_t)bpb->ReservedSectors * bpb->BytesPerSector;
+
+    fat->count = fat_bytes / 2;
+    fat->owned = NULL;
+
+    if (img->map) {
+        if (fat_offset + fat_bytes > img->size) {
+            fprintf(stderr, "La FAT queda fuera de la imagen\n");
+            return -1;
+        }
+        fat->entries = (const uint16_t *)(img->map + fat_offset);
+        STATS_TIME(TIMER_METADATA, t0);
+        return 0;
     }
 
-    printf(".\n"); // raíz del sistema
-    read_directory(fd, bpb, 0, 0, 1);
+    fat->owned = malloc(fat_bytes);
+    if (!fat->owned) {
+        perror("malloc failed");
+        return -1;
+    }
 
-    close(fd);
+    if (image_read(img, fat->owned, fat_bytes, fat_offset) < 0) {
+        perror("Error al leer la FAT");
+        free(fat->owned);
+        fat->owned = NULL;
+        return -1;
+    }
+    STATS_TIME(TIMER_METADATA, t0);
+    fat->entries = fat->owned;
+    return 0;
+}
+
+// Devuelve el siguiente cluster de la cadena (fin de cadena si está fuera de la tabla)
+uint16_t next_FAT16_cluster(FAT16_Table *fat, uint16_t cluster) {
+    if (cluster >= fat->count) return 0xFFFF;
+    STATS_ADD(STAT_FAT_LOOKUPS, 1);
+    return fat->entries[cluster];
+}
+
+// Compara la cadena que empieza en start con la segunda copia de la FAT.
+// Devuelve el número de clusters en los que ambas copias difieren (-1 si hay error)
+int verify_FAT16_chain(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t start) {
+    if (bpb->NumFATs < 2) {
+        fprintf(stderr, "La imagen solo tiene una copia de la FAT\n");
+        return -1;
+    }
+
+    size_t fat_bytes = (size_t)bpb->FATSize16 * bpb->BytesPerSector;
+    uint64_t copy_offset = ((uint64_t)bpb->ReservedSectors + bpb->FATSize16) * bpb->BytesPerSector;
+    ImageView view;
+    const uint16_t *copy = (const uint16_t *)image_get(img, copy_offset, fat_bytes, &view);
+    if (!copy) {
+        fprintf(stderr, "Error al leer la segunda FAT\n");
+        return -1;
+    }
+
+    int mismatches = 0;
+    uint16_t cur = start;
+    uint32_t steps = 0;
+    while (cur >= 2 && cur < 0xFFF8 && cur < fat->count && steps++ <= fat->count) {
+        uint16_t next = next_FAT16_cluster(fat, cur);
+        if (copy[cur] != next) {
+            printf("Cluster %u: FAT1 -> 0x%04X, FAT2 -> 0x%04X\n", cur, next, copy[cur]);
+            mismatches++;
+        }
+        cur = next;
+    }
+
+    image_put(img, &view);
+    return mismatches;
+}
+
+void free_FAT16_table(FAT16_Table *fat) {
+    free(fat->owned);
+    fat->owned = NULL;
+    fat->entries = NULL;
+    fat->count = 0;
+}
+
+// Escribe el árbol completo en out usando una FAT ya cargada
+int tree_FAT16(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, int jobs, OutWriter *out) {
+    out_write(out, ".\n", 2); // raíz del sistema
+    if (jobs > 1) {
+        // Cada directorio es una tarea y la salida se reensambla en orden
+        TreeJobCtx ctx = { img, bpb, fat };
+        return walk_run(jobs, tree_job, &ctx, 0, 0, out);
+    }
+    STATS_START(t0);
+    read_directory(img, bpb, fat, 0, 0, 1, out);
+    STATS_TIME(TIMER_TRAVERSAL, t0);
+    return 0;
+}
+
+int print_FAT16_tree(Image *img, const FAT16_BPB *bpb, int jobs) {
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) {
+        return -1;
+    }
+
+    OutWriter out;
+    if (out_init(&out, STDOUT_FILENO) < 0) {
+        free_FAT16_table(&fat);
+        return -1;
+    }
+
+    fflush(stdout);
+    int ret = tree_FAT16(img, bpb, &fat, jobs, &out);
+
+    out_free(&out);
+    free_FAT16_table(&fat);
+    return ret;
 }
 
 
@@ -224,6 +432,13 @@ void format_name(const char *input, uint8_t out11[11]) {
     char ext[4]  = {0};
     int nameLen = 0, extLen = 0;
 
+    // "." y ".." se guardan tal cual en el directorio
+    if (strcmp(input, ".") == 0 || strcmp(input, "..") == 0) {
+        memset(out11, ' ', 11);
+        memcpy(out11, input, strlen(input));
+        return;
+    }
+
     const char *dot = strchr(input, '.');
     if (dot) {
         nameLen = dot - input;
@@ -250,7 +465,47 @@ void format_name(const char *input, uint8_t out11[11]) {
 }
 
 
-static int find_entry(int fd, const FAT16_BPB *bpb,uint16_t cluster, const uint8_t name11[11], uint8_t entry_out[32]) {
+// Busca name11 entre n entradas de 32 bytes. Devuelve el índice de la primera entrada viva
+// que coincide, -1 si no está en este trozo o -2 si se llega a la marca de fin (0x00)
+static long scan_entries(const uint8_t *buf, size_t n, const uint8_t name11[11]) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // Se comparan los 16 primeros bytes de cada entrada contra el nombre y contra cero;
+    // basta con mirar los 11 bits del nombre y el bit del primer byte
+    uint8_t pattern_bytes[16] = {0};
+    memcpy(pattern_bytes, name11, 11);
+    const __m128i pattern = _mm_loadu_si128((const __m128i *)pattern_bytes);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 4 <= n; i += 4) {
+        int hits = 0;
+        for (int k = 0; k < 4; k++) {
+            __m128i e = _mm_loadu_si128((const __m128i *)(buf + (i + k) * DIR_ENTRY_SIZE));
+            int name_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(e, pattern));
+            int end_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(e, zero));
+            hits |= ((name_mask & 0x7FF) == 0x7FF) | (end_mask & 1);
+        }
+        if (!hits) continue;
+
+        // Alguna de las 4 entradas es candidata: se resuelve en orden
+        for (size_t k = i; k < i + 4; k++) {
+            const uint8_t *e = buf + k * DIR_ENTRY_SIZE;
+            if (e[0] == 0x00) return -2;
+            if (e[0] != 0xE5 && e[11] != 0x0F && memcmp(e, name11, 11) == 0) return (long)k;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        const uint8_t *e = buf + i * DIR_ENTRY_SIZE;
+        if (e[0] == 0x00) return -2;
+        if (e[0] == 0xE5 || e[11] == 0x0F) continue;
+        if (memcmp(e, name11, 11) == 0) return (long)i;
+    }
+    return -1;
+}
+
+// Búsqueda lineal en un directorio con el núcleo vectorizado (cluster 0 = raíz)
+static int scan_directory(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t cluster, const uint8_t name11[11], uint8_t entry_out[32]) {
     // Cálculo de sectores en directorio raíz y primer sector con datos
     uint32_t root_dir_sectors = ((bpb->RootEntries * 32) + bpb->BytesPerSector - 1) / bpb->BytesPerSector;
     uint32_t first_data_sector = bpb->ReservedSectors + bpb->NumFATs * bpb->FATSize16 + root_dir_sectors;
@@ -259,105 +514,1469 @@ static int find_entry(int fd, const FAT16_BPB *bpb,uint16_t cluster, const uint8
         // Ruta fija de la raíz
         uint32_t dir_sector = bpb->ReservedSectors + bpb->NumFATs * bpb->FATSize16;
         size_t dir_size = root_dir_sectors * bpb->BytesPerSector;
-        uint8_t *buf = malloc(dir_size);
-        lseek(fd, dir_sector * bpb->BytesPerSector, SEEK_SET);
-        read(fd, buf, dir_size);
-        for (size_t off = 0; off < dir_size; off += 32) {
-            uint8_t *e = buf + off;
-            if (e[0] == 0x00) break;
-            if (e[0] == 0xE5 || e[11] == 0x0F) continue;
-            if (memcmp(e, name11, 11) == 0) {
-                memcpy(entry_out, e, 32);
-                free(buf);
-                return 0;
-            }
-        }
-        free(buf);
-        return -1;
+        ImageView view;
+        const uint8_t *buf = image_get_block(img, (uint64_t)dir_sector * bpb->BytesPerSector, dir_size, CACHE_DATA, &view);
+        if (!buf) return -1;
+        long idx = scan_entries(buf, dir_size / DIR_ENTRY_SIZE, name11);
+        if (idx >= 0) memcpy(entry_out, buf + idx * DIR_ENTRY_SIZE, 32);
+        image_put(img, &view);
+        return idx >= 0 ? 0 : -1;
     }
 
     // Subdirectorios: recorrer cadena de clusters
     uint16_t cur = cluster;
+    uint32_t steps = 0;
     while (cur < 0xFFF8) {
         uint32_t first_sector = ((cur - 2) * bpb->SectorsPerCluster) + first_data_sector;
         size_t cl_sz = bpb->SectorsPerCluster * bpb->BytesPerSector;
-        uint8_t *buf = malloc(cl_sz);
-        lseek(fd, first_sector * bpb->BytesPerSector, SEEK_SET);
-        read(fd, buf, cl_sz);
-        for (size_t off = 0; off < cl_sz; off += 32) {
-            uint8_t *e = buf + off;
-            if (e[0] == 0x00) { free(buf); return -1; }
-            if (e[0] == 0xE5 || e[11] == 0x0F) continue;
-            if (memcmp(e, name11, 11) == 0) {
-                memcpy(entry_out, e, 32);
-                free(buf);
-                return 0;
-            }
-        }
-        free(buf);
-        // Leer siguiente cluster de la FAT 
-        off_t fat_off = bpb->ReservedSectors * bpb->BytesPerSector + cur * 2;
-        lseek(fd, fat_off, SEEK_SET);
-        read(fd, &cur, 2);
+        ImageView view;
+        const uint8_t *buf = image_get_block(img, (uint64_t)first_sector * bpb->BytesPerSector, cl_sz, CACHE_DATA, &view);
+        if (!buf) return -1;
+        long idx = scan_entries(buf, cl_sz / DIR_ENTRY_SIZE, name11);
+        if (idx >= 0) memcpy(entry_out, buf + idx * DIR_ENTRY_SIZE, 32);
+        image_put(img, &view);
+        if (idx >= 0) return 0;
+        if (idx == -2) return -1;
+        // Siguiente cluster desde la FAT en memoria
+        cur = next_FAT16_cluster(fat, cur);
+        if (++steps > fat->count) break;
     }
     return -1;
 }
 
-static void dump_file(int fd, const FAT16_BPB *bpb, uint16_t start, uint32_t size) {
+// Hash FNV-1a de un nombre 8.3
+static uint32_t hash_name11(const uint8_t name11[11]) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 11; i++) {
+        h ^= name11[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int index_insert(const uint8_t *entry, void *arg) {
+    FAT16_DirIndex *idx = arg;
+    uint32_t mask = idx->nslots - 1;
+
+    // Si la tabla se llena a la mitad, se duplica y se reinsertan las entradas
+    if ((idx->count + 1) * 2 > idx->nslots) {
+        uint32_t nslots = idx->nslots ? idx->nslots * 2 : 64;
+        uint32_t *slots = calloc(nslots, sizeof(uint32_t));
+        uint8_t (*entries)[32] = realloc(idx->entries, (size_t)nslots / 2 * 32);
+        if (!slots || !entries) {
+            free(slots);
+            if (entries) idx->entries = entries;
+            return -1;
+        }
+        idx->entries = entries;
+        for (uint32_t e = 0; e < idx->count; e++) {
+            uint32_t h = hash_name11(idx->entries[e]) & (nslots - 1);
+            while (slots[h]) h = (h + 1) & (nslots - 1);
+            slots[h] = e + 1;
+        }
+        free(idx->slots);
+        idx->slots = slots;
+        idx->nslots = nslots;
+        mask = nslots - 1;
+    }
+
+    // Si el nombre ya está, manda la primera aparición (igual que la búsqueda lineal)
+    uint32_t h = hash_name11(entry) & mask;
+    while (idx->slots[h]) {
+        if (memcmp(idx->entries[idx->slots[h] - 1], entry, 11) == 0) return 0;
+        h = (h + 1) & mask;
+    }
+    memcpy(idx->entries[idx->count], entry, 32);
+    idx->slots[h] = ++idx->count;
+    return 0;
+}
+
+static const uint8_t *index_lookup(const FAT16_DirIndex *idx, const uint8_t name11[11]) {
+    if (!idx->nslots) return NULL;
+    uint32_t mask = idx->nslots - 1;
+    uint32_t h = hash_name11(name11) & mask;
+    while (idx->slots[h]) {
+        const uint8_t *e = idx->entries[idx->slots[h] - 1];
+        if (memcmp(e, name11, 11) == 0) return e;
+        h = (h + 1) & mask;
+    }
+    return NULL;
+}
+
+static void free_dir_index(FAT16_DirIndex *idx) {
+    if (!idx) return;
+    free(idx->slots);
+    free(idx->entries);
+    free(idx);
+}
+
+// Busca name11 en el directorio: con índice si ya existe; la primera visita usa el
+// núcleo vectorizado y la segunda construye el índice, que se reutiliza en la sesión
+static int find_entry(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, FAT16_DirCache *cache, uint16_t cluster, const uint8_t name11[11], uint8_t entry_out[32]) {
+    if (!cache) return scan_directory(img, bpb, fat, cluster, name11, entry_out);
+
+    FAT16_DirIndex *idx = cache->dirs[cluster];
+    if (!idx) {
+        uint8_t bit = 1u << (cluster & 7);
+        if (!(cache->seen[cluster >> 3] & bit)) {
+            cache->seen[cluster >> 3] |= bit;
+            return scan_directory(img, bpb, fat, cluster, name11, entry_out);
+        }
+
+        idx = calloc(1, sizeof(FAT16_DirIndex));
+        if (!idx || for_each_dir_entry(img, bpb, fat, cluster, index_insert, idx) < 0) {
+            free_dir_index(idx);
+            return scan_directory(img, bpb, fat, cluster, name11, entry_out);
+        }
+        cache->dirs[cluster] = idx;
+        cache->indexed++;
+    }
+
+    const uint8_t *e = index_lookup(idx, name11);
+    if (!e) return -1;
+    memcpy(entry_out, e, 32);
+    return 0;
+}
+
+// Caché de índices de directorio, indexada por cluster (0 = raíz)
+int init_FAT16_dircache(FAT16_DirCache *cache) {
+    cache->dirs = calloc(FAT16_MAX_CLUSTERS, sizeof(FAT16_DirIndex *));
+    cache->seen = calloc(FAT16_MAX_CLUSTERS / 8, 1);
+    cache->indexed = 0;
+    if (!cache->dirs || !cache->seen) {
+        free(cache->dirs);
+        free(cache->seen);
+        perror("malloc failed");
+        return -1;
+    }
+    return 0;
+}
+
+void free_FAT16_dircache(FAT16_DirCache *cache) {
+    if (!cache->dirs) return;
+    for (uint32_t i = 0; i < FAT16_MAX_CLUSTERS && cache->indexed; i++) {
+        if (cache->dirs[i]) {
+            free_dir_index(cache->dirs[i]);
+            cache->indexed--;
+        }
+    }
+    free(cache->dirs);
+    free(cache->seen);
+    cache->dirs = NULL;
+    cache->seen = NULL;
+}
+
+// Extrae de la cadena el siguiente tramo de clusters consecutivos a partir de *cur.
+// Deja en *cur el cluster que sigue al tramo; devuelve 0 si no quedan tramos
+int next_FAT16_run(FAT16_Table *fat, uint16_t *cur, FAT16_Run *run) {
+    if (*cur < 2 || *cur >= 0xFFF8 || *cur >= fat->count) return 0;
+
+    run->start = *cur;
+    run->length = 1;
+    uint16_t next = next_FAT16_cluster(fat, *cur);
+    while (next == run->start + run->length && run->length < fat->count) {
+        run->length++;
+        next = next_FAT16_cluster(fat, next);
+    }
+    *cur = next;
+    return 1;
+}
+
+// Vuelca el fichero tramo a tramo: cada tramo contiguo sale con una sola transferencia.
+// Devuelve los bytes volcados (menos que size si la cadena se corta) o -1 en error
+int64_t dump_FAT16_file(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t start, uint32_t size, int out_fd) {
     uint32_t root_dir_sectors = ((bpb->RootEntries * 32) + bpb->BytesPerSector - 1) / bpb->BytesPerSector;
     uint32_t first_data_sector = bpb->ReservedSectors + bpb->NumFATs * bpb->FATSize16 + root_dir_sectors;
+    size_t cl_sz = bpb->SectorsPerCluster * bpb->BytesPerSector;
     uint32_t remaining = size;
     uint16_t cur = start;
-    while (cur < 0xFFF8 && remaining > 0) {
-        uint32_t first_sector = ((cur - 2) * bpb->SectorsPerCluster) + first_data_sector;
-        size_t cl_sz = bpb->SectorsPerCluster * bpb->BytesPerSector;
-        size_t toread = remaining < cl_sz ? remaining : cl_sz;
-        uint8_t *buf = malloc(cl_sz);
-        lseek(fd, first_sector * bpb->BytesPerSector, SEEK_SET);
-        read(fd, buf, toread);
-        fwrite(buf, 1, toread, stdout);
-        free(buf);
+    uint32_t clusters = 0;
+    FAT16_Run run;
+
+    while (remaining > 0 && clusters <= fat->count && next_FAT16_run(fat, &cur, &run)) {
+        uint32_t first_sector = ((run.start - 2) * bpb->SectorsPerCluster) + first_data_sector;
+        uint64_t run_bytes = (uint64_t)run.length * cl_sz;
+        uint32_t toread = remaining < run_bytes ? remaining : (uint32_t)run_bytes;
+        if (image_copy_out(img, (uint64_t)first_sector * bpb->BytesPerSector, toread, out_fd) < 0) {
+            perror("Error al volcar el fichero");
+            return -1;
+        }
         remaining -= toread;
-        // siguiente cluster
-        off_t fat_off = bpb->ReservedSectors * bpb->BytesPerSector + cur * 2;
-        lseek(fd, fat_off, SEEK_SET);
-        read(fd, &cur, 2);
+        clusters += run.length;
     }
+    return size - remaining;
 }
 
-// --cat para FAT16
-int cat_FAT16(const char *image_path, const FAT16_BPB *bpb, const char *filepath) {
-    int fd = open(image_path, O_RDONLY);
-    if (fd < 0) { perror("open"); return -1; }
-
+// Resuelve una ruta componente a componente desde la raíz y deja su entrada en entry.
+// Con --stats cuenta como recorrido
+int resolve_FAT16_path(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, FAT16_DirCache *cache, const char *filepath, uint8_t entry[32]) {
+    STATS_START(t0);
     // Tokenizar ruta por '/' y buscar recursivamente
     char *path = strdup(filepath);
     char *tok = strtok(path, "/");      // Separa ruta con '\0' para recorrerla
     uint16_t cluster = 0;
-    uint8_t entry[32];
     uint8_t name11[11];
 
+    if (!tok) {
+        free(path);
+        return -1;
+    }
+
     // Recorrer cada componente de la ruta
     while (tok) {
         format_name(tok, name11);   // Formatear nombre a FAT16
 
         // Buscamos la entrada del archivo o directorio en el cluster actual
-        if (find_entry(fd, bpb, cluster, name11, entry) < 0) {
+        if (find_entry(img, bpb, fat, cache, cluster, name11, entry) < 0) {
             fprintf(stderr, "No encontrado: %s\n", tok);
             free(path);
-            close(fd);
             return -1;
         }
-        // Para siguiente, si es directorio, actualizar cluster; sino, mostrar archivo
+        // Para siguiente, si es directorio, actualizar cluster
         cluster = entry[26] | (entry[27] << 8);
         tok = strtok(NULL, "/");
-        if (!tok) {
-            // última componente: extraer tamaño y dumps
-            uint32_t fsize = entry[28] | (entry[29]<<8) | (entry[30]<<16) | (entry[31]<<24);
-            dump_file(fd, bpb, cluster, fsize);
-        }
     }
     free(path);
+    STATS_TIME(TIMER_TRAVERSAL, t0);
+    return 0;
+}
+
+// Como resolve_FAT16_path, pero la raíz (sin entrada propia) se sintetiza como directorio
+int lookup_FAT16_stat(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, FAT16_DirCache *cache, const char *filepath, uint8_t entry[32]) {
+    if (strspn(filepath, "/") == strlen(filepath)) {
+        memset(entry, 0, 32);
+        entry[11] = ATTR_DIRECTORY;
+        return 0;
+    }
+    return resolve_FAT16_path(img, bpb, fat, cache, filepath, entry);
+}
+
+// --cat para FAT16
+int cat_FAT16(Image *img, const FAT16_BPB *bpb, const char *filepath) {
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) {
+        return -1;
+    }
+
+    FAT16_DirCache cache;
+    if (init_FAT16_dircache(&cache) < 0) {
+        free_FAT16_table(&fat);
+        return -1;
+    }
+
+    uint8_t entry[32];
+    if (resolve_FAT16_path(img, bpb, &fat, &cache, filepath, entry) < 0) {
+        free_FAT16_dircache(&cache);
+        free_FAT16_table(&fat);
+        return -1;
+    }
+
+    // última componente: extraer tamaño y dumps
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    uint32_t fsize = entry[28] | (entry[29]<<8) | (entry[30]<<16) | (entry[31]<<24);
+    fflush(stdout);
+    int64_t done = dump_FAT16_file(img, bpb, &fat, cluster, fsize, STDOUT_FILENO);
+    if (done >= 0 && done != fsize) {
+        fprintf(stderr, "La cadena de clusters de %s es más corta que su tamaño (%lld de %u bytes)\n",
+                filepath, (long long)done, fsize);
+    }
+
+    free_FAT16_dircache(&cache);
+    free_FAT16_table(&fat);
+    return done == fsize ? 0 : -1;
+}
+
+// --check-fat para FAT16: compara la cadena de un archivo con la segunda copia de la FAT
+int check_FAT16_chain(Image *img, const FAT16_BPB *bpb, const char *filepath) {
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) {
+        return -1;
+    }
+
+    uint8_t entry[32];
+    int result = -1;
+    if (resolve_FAT16_path(img, bpb, &fat, NULL, filepath, entry) == 0) {
+        uint16_t cluster = entry[26] | (entry[27] << 8);
+        int mismatches = verify_FAT16_chain(img, bpb, &fat, cluster);
+        if (mismatches == 0) {
+            printf("Cadena de %s consistente en ambas copias de la FAT\n", filepath);
+            result = 0;
+        } else if (mismatches > 0) {
+            printf("Cadena de %s: %d clusters difieren entre FAT1 y FAT2\n", filepath, mismatches);
+            result = 1;
+        }
+    }
+
+    free_FAT16_table(&fat);
+    return result;
+}
+
+// Fecha y hora de FAT (hora local, sin zona) a segundos Unix como si fueran UTC (0 sin fecha)
+uint32_t FAT16_time(uint16_t date, uint16_t time) {
+    if (date == 0) return 0;
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 80 + (date >> 9);
+    tm.tm_mon = ((date >> 5) & 0x0F) - 1;
+    tm.tm_mday = date & 0x1F;
+    tm.tm_hour = time >> 11;
+    tm.tm_min = (time >> 5) & 0x3F;
+    tm.tm_sec = (time & 0x1F) * 2;
+    return (uint32_t)timegm(&tm);
+}
+
+// Escribe los metadatos de una entrada de directorio en out
+void print_FAT16_stat(const char *path, const uint8_t entry[32], FILE *out) {
+    uint8_t attr = entry[11];
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    uint32_t fsize = entry[28] | (entry[29]<<8) | (entry[30]<<16) | (entry[31]<<24);
+    uint16_t time = entry[22] | (entry[23] << 8);
+    uint16_t date = entry[24] | (entry[25] << 8);
+
+    fprintf(out, "File: %s\n", path);
+    fprintf(out, "Type: %s\n", (attr & ATTR_DIRECTORY) ? "directory" : "regular file");
+    fprintf(out, "Attributes: 0x%02X%s%s%s%s\n", attr,
+            (attr & 0x01) ? " read-only" : "", (attr & 0x02) ? " hidden" : "",
+            (attr & 0x04) ? " system" : "", (attr & 0x20) ? " archive" : "");
+    fprintf(out, "First cluster: %u\n", cluster);
+    fprintf(out, "Size: %u\n", fsize);
+    // Fecha: bits 15-9 año desde 1980, 8-5 mes, 4-0 día; hora: 15-11 h, 10-5 min, 4-0 s/2
+    // (la raíz no tiene entrada propia y no guarda fecha)
+    if (date != 0) fprintf(out, "Modify: %04u-%02u-%02u %02u:%02u:%02u\n",
+            1980 + (date >> 9), (date >> 5) & 0x0F, date & 0x1F,
+            time >> 11, (time >> 5) & 0x3F, (time & 0x1F) * 2);
+}
+
+// --stat para FAT16
+int stat_FAT16(Image *img, const FAT16_BPB *bpb, const char *filepath) {
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) {
+        return -1;
+    }
+
+    uint8_t entry[32];
+    int result = lookup_FAT16_stat(img, bpb, &fat, NULL, filepath, entry);
+    if (result == 0) print_FAT16_stat(filepath, entry, stdout);
+
+    free_FAT16_table(&fat);
+    return result;
+}
+
+
+// --du: totales por directorio sumados de abajo arriba
+typedef struct {
+    DuCtx du;                   // Debe ir primero (lo usa du_finish)
+    Image *img;
+    const FAT16_BPB *bpb;
+    FAT16_Table *fat;
+} DuJobCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+} DuEntryCtx;
+
+// Bytes que ocupa la cadena que empieza en start según la FAT en memoria
+static uint64_t chain_bytes(const DuJobCtx *ctx, uint16_t start) {
+    uint64_t clusters = 0;
+    uint16_t cur = start;
+    FAT16_Run run;
+    while (clusters <= ctx->fat->count && next_FAT16_run(ctx->fat, &cur, &run)) clusters += run.length;
+    return clusters * ctx->bpb->SectorsPerCluster * ctx->bpb->BytesPerSector;
+}
+
+// Suma una entrada de fichero: lo reservado sale de la longitud de su cadena
+static void du_add_entry(const DuJobCtx *ctx, DuDir *dir, const uint8_t *entry) {
+    uint16_t first_cluster = entry[26] | (entry[27] << 8);
+    uint32_t size = entry[28] | (entry[29] << 8) | (entry[30] << 16) | ((uint32_t)entry[31] << 24);
+    dir->allocated += chain_bytes(ctx, first_cluster);
+    dir->logical += size;
+    dir->files++;
+}
+
+static int du_job_entry(const uint8_t *entry, void *arg) {
+    DuEntryCtx *de = arg;
+    DuJobCtx *ctx = de->walk->ctx;
+    WalkNode *node = de->node;
+    DuDir *dir = node->data;
+
+    if (entry[0] == '.') return 0;                          // "." y ".."
+    if ((entry[11] & 0x08) && !(entry[11] & ATTR_DIRECTORY)) return 0;   // Etiqueta de volumen
+
+    if (entry[11] & ATTR_DIRECTORY) {
+        // Cada subdirectorio es una tarea; sus totales se suman aquí al cerrarse
+        uint16_t firstCluster = entry[26] | (entry[27] << 8);
+        if (firstCluster != 0) {
+            char name[13];
+            int len = format_entry_name(entry, name);
+            DuDir *child = du_dir_new(dir->path, name, len);
+            if (child && !walk_child_data(de->walk, node, firstCluster, node->depth + 1, child)) {
+                du_dir_free(child);
+            }
+        }
+        return 0;
+    }
+    du_add_entry(ctx, dir, entry);
+    return 0;
+}
+
+static void du_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    DuJobCtx *ctx = walk->ctx;
+    DuDir *dir = node->data;
+    if (!dir) return;
+
+    // El propio directorio ocupa su cadena (la raíz, su región fija)
+    if (node->key == 0) {
+        const FAT16_BPB *bpb = ctx->bpb;
+        uint32_t root_dir_sectors = ((bpb->RootEntries * 32) + bpb->BytesPerSector - 1) / bpb->BytesPerSector;
+        dir->allocated += (uint64_t)root_dir_sectors * bpb->BytesPerSector;
+    } else {
+        dir->allocated += chain_bytes(ctx, (uint16_t)node->key);
+    }
+    DuEntryCtx de = { walk, node };
+    for_each_dir_entry(ctx->img, ctx->bpb, ctx->fat, (uint16_t)node->key, du_job_entry, &de);
+}
+
+// Escribe en out los totales de cada directorio bajo path, de abajo arriba;
+// si path es un fichero, una sola línea con los suyos
+int du_FAT16_tree(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, const char *path,
+                  int jobs, int max_depth, OutWriter *out) {
+    uint8_t entry[32];
+    if (lookup_FAT16_stat(img, bpb, fat, NULL, path, entry) < 0) return -1;
+
+    DuJobCtx ctx = { { max_depth }, img, bpb, fat };
+    DuDir *root = du_root_new(path);
+    if (!root) return -1;
+
+    if (!(entry[11] & ATTR_DIRECTORY)) {
+        du_add_entry(&ctx, root, entry);
+        du_print(out, root);
+        du_dir_free(root);
+        return 0;
+    }
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    return walk_run_postorder(jobs, du_job, du_finish, &ctx, cluster, root, 0, out);
+}
+
+// --du para FAT16
+int du_FAT16(Image *img, const FAT16_BPB *bpb, const char *path, int jobs, int max_depth) {
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) {
+        return -1;
+    }
+
+    OutWriter out;
+    if (out_init(&out, STDOUT_FILENO) < 0) {
+        free_FAT16_table(&fat);
+        return -1;
+    }
+    fflush(stdout);
+    int ret = du_FAT16_tree(img, bpb, &fat, path, jobs, max_depth, &out);
+
+    out_free(&out);
+    free_FAT16_table(&fat);
+    return ret;
+}
+
+
+// --find: coincidencias con su ruta completa, en el orden del árbol.
+// En FAT16 la entrada ya trae todo lo que miran los predicados: no hay más lecturas
+typedef struct {
+    const FindQuery *q;
+    Image *img;
+    const FAT16_BPB *bpb;
+    FAT16_Table *fat;
+} FindJobCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+} FindEntryCtx;
+
+static int find_job_entry(const uint8_t *entry, void *arg) {
+    FindEntryCtx *fe = arg;
+    FindJobCtx *ctx = fe->walk->ctx;
+    WalkNode *node = fe->node;
+    const char *parent = node->data;
+
+    if (walk_stopped(fe->walk)) return 1;
+    if (entry[0] == '.') return 0;                                       // "." y ".."
+    if ((entry[11] & 0x08) && !(entry[11] & ATTR_DIRECTORY)) return 0;   // Etiqueta de volumen
+
+    char name[13];
+    int len = format_entry_name(entry, name);
+    int is_dir = (entry[11] & ATTR_DIRECTORY) != 0;
+    uint32_t size = entry[28] | (entry[29] << 8) | (entry[30] << 16) | ((uint32_t)entry[31] << 24);
+    uint32_t mtime = FAT16_time(entry[24] | (entry[25] << 8), entry[22] | (entry[23] << 8));
+
+    if (find_match_name(ctx->q, name, len) && find_match_type(ctx->q, is_dir, !is_dir) &&
+        find_match_meta(ctx->q, size, mtime)) {
+        find_emit(node, parent, name, len);
+    }
+
+    uint16_t firstCluster = entry[26] | (entry[27] << 8);
+    if (is_dir && firstCluster != 0) {
+        char *child = find_join(parent, name, len);
+        if (child && !walk_child_data(fe->walk, node, firstCluster, node->depth + 1, child)) free(child);
+    }
+    return 0;
+}
+
+static void find_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    FindJobCtx *ctx = walk->ctx;
+    if (!node->data) return;
+    FindEntryCtx fe = { walk, node };
+    for_each_dir_entry(ctx->img, ctx->bpb, ctx->fat, (uint16_t)node->key, find_job_entry, &fe);
+}
+
+// Escribe en out la ruta de cada entrada bajo path que cumple q
+int find_FAT16_tree(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, const char *path,
+                    const FindQuery *q, int jobs, OutWriter *out) {
+    uint8_t entry[32];
+    if (lookup_FAT16_stat(img, bpb, fat, NULL, path, entry) < 0) return -1;
+    if (!(entry[11] & ATTR_DIRECTORY)) {
+        fprintf(stderr, "No es un directorio: %s\n", path);
+        return -1;
+    }
+
+    char *root_path = find_root(path);
+    if (!root_path) return -1;
+
+    FindJobCtx ctx = { q, img, bpb, fat };
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    return walk_run_postorder(jobs, find_job, find_finish, &ctx, cluster, root_path, q->max_results, out);
+}
+
+// --find para FAT16 (los nombres se comparan sin distinguir mayúsculas)
+int find_FAT16(Image *img, const FAT16_BPB *bpb, const char *path, FindQuery *q, int jobs) {
+    if (find_prepare(q, 1) < 0) return -1;
+
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) {
+        find_free(q);
+        return -1;
+    }
+
+    OutWriter out;
+    int ret = -1;
+    if (out_init(&out, STDOUT_FILENO) == 0) {
+        fflush(stdout);
+        ret = find_FAT16_tree(img, bpb, &fat, path, q, jobs, &out);
+        out_free(&out);
+    }
+    free_FAT16_table(&fat);
+    find_free(q);
+    return ret;
+}
+
+
+// --fragmentation: una pasada secuencial por la FAT, un recorrido del árbol y una
+// resolución de todas las cadenas a la vez (cada cluster se visita una sola vez)
+#define FRAG_BROKEN 0x01        // La cadena acaba en un cluster libre, malo o fuera de rango
+#define FRAG_CYCLE 0x02         // La cadena vuelve sobre sí misma
+
+// Entrada encontrada en el recorrido
+typedef struct {
+    char *path;
+    uint16_t start;
+    uint8_t is_dir;
+} FragFile;
+
+typedef struct {
+    Image *img;
+    const FAT16_BPB *bpb;
+    FAT16_Table *fat;
+    uint32_t max_cluster;       // Último cluster de datos
+    uint16_t *refs;             // Entradas de directorio que empiezan en cada cluster (atómico)
+    uint32_t bad_starts;        // Entradas con el primer cluster fuera de rango (atómico)
+    pthread_mutex_t lock;       // Protege files
+    FragFile *files;
+    size_t nfiles, cap;
+} FragCtx;
+
+// Resultado de cada cluster al resolver las cadenas: lo que queda desde él hasta el final
+typedef struct {
+    uint32_t length;            // Clusters
+    uint32_t breaks;            // Saltos a un cluster que no es el siguiente
+    uint16_t shared;            // Primer cluster compartido que se alcanza (0 = ninguno)
+    uint8_t flags;
+    uint8_t state;              // 0 = sin visitar, 1 = en la pila, 2 = resuelto
+    uint8_t loop_entry;         // Uno de los enlaces que llegan aquí es el que cierra un ciclo
+} FragChain;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+} FragEntryCtx;
+
+// Un cluster forma parte de una cadena si está en rango y ocupado (ni libre ni malo)
+static int frag_is_node(const FragCtx *ctx, uint32_t c) {
+    if (c < 2 || c > ctx->max_cluster) return 0;
+    uint16_t v = ctx->fat->entries[c];
+    return v != 0 && v != 0xFFF7;
+}
+
+static void frag_add_file(FragCtx *ctx, char *path, uint16_t start, int is_dir) {
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->nfiles == ctx->cap) {
+        size_t cap = ctx->cap ? ctx->cap * 2 : 256;
+        FragFile *files = realloc(ctx->files, cap * sizeof(FragFile));
+        if (!files) {
+            pthread_mutex_unlock(&ctx->lock);
+            free(path);
+            return;
+        }
+        ctx->files = files;
+        ctx->cap = cap;
+    }
+    ctx->files[ctx->nfiles++] = (FragFile){ path, start, (uint8_t)is_dir };
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static int frag_job_entry(const uint8_t *entry, void *arg) {
+    FragEntryCtx *fe = arg;
+    FragCtx *ctx = fe->walk->ctx;
+    WalkNode *node = fe->node;
+    const char *parent = node->data;
+
+    if (entry[0] == '.') return 0;                                       // "." y ".."
+    if ((entry[11] & 0x08) && !(entry[11] & ATTR_DIRECTORY)) return 0;   // Etiqueta de volumen
+
+    char name[13];
+    int len = format_entry_name(entry, name);
+    int is_dir = (entry[11] & ATTR_DIRECTORY) != 0;
+    uint16_t start = entry[26] | (entry[27] << 8);
+    char *path = find_join(parent, name, len);
+    if (!path) return 0;
+
+    // Sólo se baja a un directorio la primera vez que se ve su cluster: un directorio
+    // enlazado dos veces (o con un ciclo) no se recorre de nuevo
+    int first = 0;
+    if (start >= 2 && start <= ctx->max_cluster) {
+        first = __atomic_fetch_add(&ctx->refs[start], 1, __ATOMIC_RELAXED) == 0;
+    } else if (start != 0) {
+        __atomic_add_fetch(&ctx->bad_starts, 1, __ATOMIC_RELAXED);
+    }
+
+    if (is_dir && first) {
+        char *child = strdup(path);
+        if (child && !walk_child_data(fe->walk, node, start, node->depth + 1, child)) free(child);
+    }
+    frag_add_file(ctx, path, start, is_dir);
+    return 0;
+}
+
+static void frag_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    FragCtx *ctx = walk->ctx;
+    if (!node->data) return;
+    FragEntryCtx fe = { walk, node };
+    for_each_dir_entry(ctx->img, ctx->bpb, ctx->fat, (uint16_t)node->key, frag_job_entry, &fe);
+}
+
+// Mapa de bits de clusters ocupados (bit i = entrada i) a partir de n entradas de la FAT
+static void build_used_bitmap(const uint16_t *entries, uint32_t n, uint8_t *bits) {
+    uint32_t i = 0;
+#ifdef __SSE2__
+    // 16 entradas por vuelta: se comparan con 0 y se empaquetan en 16 bits
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(entries + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(entries + i + 8));
+        __m128i free_mask = _mm_packs_epi16(_mm_cmpeq_epi16(a, zero), _mm_cmpeq_epi16(b, zero));
+        uint16_t used = (uint16_t)~_mm_movemask_epi8(free_mask);
+        memcpy(bits + i / 8, &used, sizeof(used));
+    }
+#endif
+    for (; i < n; i++) {
+        if (entries[i]) bits[i / 8] |= (uint8_t)(1u << (i % 8));
+    }
+}
+
+// Resuelve todas las cadenas de una vez: desde cada cluster sin resolver se avanza hasta
+// uno ya resuelto o el final, y se deshace la pila acumulando longitud, saltos y estado.
+// Devuelve el número de ciclos encontrados
+static uint32_t frag_resolve(const FragCtx *ctx, const uint8_t *indeg, FragChain *chain, uint16_t *stack) {
+    const uint16_t *e = ctx->fat->entries;
+    uint32_t cycles = 0;
+
+    for (uint32_t c = 2; c <= ctx->max_cluster; c++) {
+        if (chain[c].state || !frag_is_node(ctx, c)) continue;
+
+        uint32_t sp = 0, x = c;
+        while (frag_is_node(ctx, x) && chain[x].state == 0) {
+            chain[x].state = 1;
+            stack[sp++] = (uint16_t)x;
+            x = e[x];
+        }
+
+        // El enlace que cierra un ciclo no cuenta como salto ni como cruce con otra cadena
+        FragChain base = { 0, 0, 0, 0, 2, 0 };
+        int closing = 0;
+        if (!frag_is_node(ctx, x)) {
+            base.flags = x >= 0xFFF8 ? 0 : FRAG_BROKEN;
+        } else if (chain[x].state == 2) {
+            base = chain[x];
+        } else {
+            base.flags = FRAG_CYCLE;
+            chain[x].loop_entry = 1;
+            closing = 1;
+            cycles++;
+        }
+
+        while (sp > 0) {
+            uint16_t y = stack[--sp];
+            uint16_t next = e[y];
+            FragChain *ch = &chain[y];
+            ch->length = base.length + 1;
+            ch->breaks = base.breaks + (!closing && frag_is_node(ctx, next) && next != y + 1);
+            ch->flags = base.flags;
+            ch->shared = indeg[y] + ctx->refs[y] - ch->loop_entry >= 2 ? y : base.shared;
+            ch->state = 2;
+            base = *ch;
+            closing = 0;
+        }
+    }
+    return cycles;
+}
+
+static int cmp_frag_file(const void *a, const void *b) {
+    return strcmp(((const FragFile *)a)->path, ((const FragFile *)b)->path);
+}
+
+// --fragmentation para FAT16: fragmentos por fichero, tramos libres, cadenas perdidas,
+// clusters compartidos por varias cadenas, ciclos y cadenas rotas
+int fragmentation_FAT16(Image *img, const FAT16_BPB *bpb, int jobs, FILE *out) {
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) return -1;
+
+    FragCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.img = img;
+    ctx.bpb = bpb;
+    ctx.fat = &fat;
+    ctx.max_cluster = calculate_cluster_count(bpb) + 1;
+    if (ctx.max_cluster >= fat.count) ctx.max_cluster = fat.count - 1;
+    if (ctx.max_cluster > 0xFFF6) ctx.max_cluster = 0xFFF6;
+    uint32_t nclusters = ctx.max_cluster - 1;
+    pthread_mutex_init(&ctx.lock, NULL);
+
+    size_t slots = (size_t)ctx.max_cluster + 1;
+    ctx.refs = calloc(slots, sizeof(uint16_t));
+    uint8_t *indeg = calloc(slots, 1);
+    uint8_t *used = calloc((nclusters + 7) / 8 + 2, 1);
+    uint8_t *reached = calloc(slots, 1);
+    FragChain *chain = calloc(slots, sizeof(FragChain));
+    uint16_t *stack = malloc(slots * sizeof(uint16_t));
+    int ret = -1;
+    if (!ctx.refs || !indeg || !used || !reached || !chain || !stack) {
+        perror("calloc");
+        goto out;
+    }
+
+    // 1) Pasada por la FAT: ocupados (vectorizado), tramos libres y cuántas cadenas llegan a cada cluster
+    build_used_bitmap(fat.entries + 2, nclusters, used);
+    uint64_t allocated = bitmap_count_set(used, nclusters);
+    BitmapExtents free_runs;
+    bitmap_free_extents(used, nclusters, &free_runs);
+    bitmap_extents_close(&free_runs);
+
+    uint32_t bad = 0;
+    for (uint32_t c = 2; c <= ctx.max_cluster; c++) {
+        uint16_t v = fat.entries[c];
+        if (v == 0xFFF7) bad++;
+        else if (v >= 2 && v <= ctx.max_cluster && indeg[v] < 2) indeg[v]++;
+    }
+
+    // 2) Recorrido del árbol: quién empieza en cada cluster
+    char *root_path = find_root("/");
+    OutWriter ow;
+    if (!root_path || out_init(&ow, STDOUT_FILENO) < 0) {
+        free(root_path);
+        goto out;
+    }
+    fflush(stdout);
+    int walk_ret = walk_run_postorder(jobs, frag_job, find_finish, &ctx, 0, root_path, 0, &ow);
+    out_free(&ow);
+    if (walk_ret < 0) goto out;
+
+    // 3) Cadenas: longitud, saltos y clusters compartidos desde cada cluster
+    uint32_t cycles = frag_resolve(&ctx, indeg, chain, stack);
+
+    // Lo que no se alcanza desde ninguna entrada está perdido; cada cluster se marca una vez
+    for (size_t i = 0; i < ctx.nfiles; i++) {
+        uint32_t x = ctx.files[i].start;
+        while (frag_is_node(&ctx, x) && !reached[x]) {
+            reached[x] = 1;
+            x = fat.entries[x];
+        }
+    }
+    uint32_t lost_clusters = 0, lost_chains = 0, shared = 0, broken = 0;
+    for (uint32_t c = 2; c <= ctx.max_cluster; c++) {
+        if (!frag_is_node(&ctx, c)) continue;
+        if (indeg[c] + ctx.refs[c] - chain[c].loop_entry >= 2) shared++;
+        if (indeg[c] == 0 && ctx.refs[c] == 0 && (chain[c].flags & FRAG_BROKEN)) broken++;
+        if (reached[c]) continue;
+        lost_clusters++;
+        if (indeg[c] == 0) lost_chains++;
+    }
+
+    // Fragmentos por fichero
+    uint64_t frag_hist[BITMAP_HIST_BUCKETS] = { 0 }, largest = 0;
+    uint64_t files = 0, dirs = 0, fragmented = 0, fragments = 0;
+    for (size_t i = 0; i < ctx.nfiles; i++) {
+        const FragFile *f = &ctx.files[i];
+        if (f->is_dir) {
+            dirs++;
+            continue;
+        }
+        files++;
+        if (!frag_is_node(&ctx, f->start)) continue;
+        const FragChain *ch = &chain[f->start];
+        if (ch->flags & FRAG_BROKEN) broken++;
+        fragments += ch->breaks + 1;
+        if (ch->breaks) fragmented++;
+        bitmap_hist_add(frag_hist, &largest, ch->breaks + 1);
+    }
+
+    uint32_t cluster_size = bpb->SectorsPerCluster * bpb->BytesPerSector;
+    fprintf(out, "--- FAT16 Fragmentation ---\n");
+    fprintf(out, "Clusters: %u (%u bytes each)\n", nclusters, cluster_size);
+    fprintf(out, "Used: %llu\n", (unsigned long long)(allocated - bad));
+    fprintf(out, "Free: %llu\n", (unsigned long long)(nclusters - allocated));
+    fprintf(out, "Bad: %u\n\n", bad);
+
+    fprintf(out, "FILES\n");
+    fprintf(out, "  Files: %llu\n", (unsigned long long)files);
+    fprintf(out, "  Directories: %llu\n", (unsigned long long)dirs);
+    fprintf(out, "  Fragmented: %llu\n", (unsigned long long)fragmented);
+    fprintf(out, "  Fragments: %llu\n", (unsigned long long)fragments);
+    fprintf(out, "FRAGMENTS PER FILE\n");
+    bitmap_print_hist(out, frag_hist);
+    fprintf(out, "FREE RUNS (clusters)\n");
+    uint64_t runs = bitmap_print_hist(out, free_runs.hist);
+    fprintf(out, "  Runs: %llu\n", (unsigned long long)runs);
+    fprintf(out, "  Largest: %llu\n", (unsigned long long)free_runs.largest);
+    fprintf(out, "CHAINS\n");
+    fprintf(out, "  Lost chains: %u (%u clusters)\n", lost_chains, lost_clusters);
+    fprintf(out, "  Cross-linked clusters: %u\n", shared);
+    fprintf(out, "  Cycles: %u\n", cycles);
+    fprintf(out, "  Broken chains: %u\n", broken);
+    fprintf(out, "  Invalid first clusters: %u\n", ctx.bad_starts);
+
+    // Ficheros y directorios fragmentados o dañados, por ruta: fragmentos, clusters, ruta y estado
+    fprintf(out, "\nFRAGMENTED OR DAMAGED (fragments, clusters, path)\n");
+    qsort(ctx.files, ctx.nfiles, sizeof(FragFile), cmp_frag_file);
+    for (size_t i = 0; i < ctx.nfiles; i++) {
+        const FragFile *f = &ctx.files[i];
+        if (f->start == 0) continue;
+        if (!frag_is_node(&ctx, f->start)) {
+            fprintf(out, "  0\t0\t%s\tinvalid-start\n", f->path);
+            continue;
+        }
+        const FragChain *ch = &chain[f->start];
+        if (!ch->breaks && !ch->shared && !ch->flags) continue;
+        fprintf(out, "  %u\t%u\t%s", ch->breaks + 1, ch->length, f->path);
+        if (ch->shared) fprintf(out, "\tcross-linked");
+        if (ch->flags & FRAG_CYCLE) fprintf(out, "\tcycle");
+        if (ch->flags & FRAG_BROKEN) fprintf(out, "\tbroken");
+        fputc('\n', out);
+    }
+    ret = 0;
+
+out:
+    for (size_t i = 0; i < ctx.nfiles; i++) free(ctx.files[i].path);
+    free(ctx.files);
+    pthread_mutex_destroy(&ctx.lock);
+    free(ctx.refs);
+    free(indeg);
+    free(used);
+    free(reached);
+    free(chain);
+    free(stack);
+    free_FAT16_table(&fat);
+    return ret;
+}
+
+
+// --undelete-scan: la raíz y la región de datos se leen en trozos grandes y secuenciales, en
+// paralelo, sin seguir cadenas; así también sirve cuando la FAT está dañada
+#define UNDEL_CHUNK_BYTES (4u << 20)
+
+// Entrada borrada encontrada, con el directorio que la contiene (cluster 0 = raíz)
+typedef struct {
+    uint16_t dir_cluster;
+    uint16_t slot;              // Posición de la entrada dentro del cluster (o de la raíz)
+    uint8_t slack;              // Está después de la marca de fin (0x00) del directorio
+    uint8_t entry[32];
+} UndelEntry;
+
+typedef struct {
+    uint32_t max_cluster;       // Último cluster de datos
+    size_t cluster_size;
+    uint64_t data_offset;       // Byte donde empieza el cluster 2
+} UndelCtx;
+
+// Trozo de la región de datos que analiza una tarea: [first, end) en clusters
+typedef struct {
+    Image *img;
+    const UndelCtx *ctx;
+    uint32_t first, end;
+    UndelEntry *found;
+    size_t nfound, cap;
+    uint32_t dirs;              // Clusters que parecen de directorio
+    int error;
+} UndelChunk;
+
+// Una entrada 8.3 parece real si su nombre sólo tiene caracteres válidos (en disco van en
+// mayúsculas), los atributos y el byte de mayúsculas no usan bits reservados, el cluster está
+// en rango y la fecha es posible
+static int undel_plausible(const uint8_t *e, uint32_t max_cluster) {
+    static const char bad_chars[] = "\"*+,./:;<=>?[\\]|";
+    if (e[11] == 0x0F) return e[26] == 0 && e[27] == 0;    // LFN: sin cluster
+    if (e[11] & 0xC0 || e[12] & ~0x18) return 0;
+    for (int i = 0; i < 11; i++) {
+        uint8_t c = e[i];
+        if (i == 0 && (c == 0xE5 || c == 0x05 || c == '.')) continue;
+        if (i == 1 && c == '.' && e[0] == '.') continue;
+        if (c < 0x20 || c == 0x7F || (c >= 'a' && c <= 'z') || (c < 0x80 && strchr(bad_chars, c))) return 0;
+    }
+    if (e[0] == '.' && !(e[11] & ATTR_DIRECTORY)) return 0;
+    uint16_t cluster = e[26] | (e[27] << 8);
+    if (cluster == 1 || cluster > max_cluster) return 0;
+    uint16_t date = e[24] | (e[25] << 8);
+    if (date) {
+        unsigned month = (date >> 5) & 0x0F, day = date & 0x1F;
+        if (month < 1 || month > 12 || day < 1) return 0;
+    }
+    return 1;
+}
+
+static int undel_is_empty(const uint8_t *e) {
+    for (int i = 0; i < DIR_ENTRY_SIZE; i++) {
+        if (e[i]) return 0;
+    }
+    return 1;
+}
+
+static int undel_add(UndelChunk *chunk, uint16_t dir_cluster, size_t slot, int slack, const uint8_t *e) {
+    if (chunk->nfound == chunk->cap) {
+        size_t cap = chunk->cap ? chunk->cap * 2 : 64;
+        UndelEntry *found = realloc(chunk->found, cap * sizeof(UndelEntry));
+        if (!found) {
+            perror("realloc");
+            return -1;
+        }
+        chunk->found = found;
+        chunk->cap = cap;
+    }
+    UndelEntry *u = &chunk->found[chunk->nfound++];
+    u->dir_cluster = dir_cluster;
+    u->slot = (uint16_t)slot;
+    u->slack = (uint8_t)slack;
+    memcpy(u->entry, e, 32);
+    return 0;
+}
+
+// Recorre un directorio entero, también lo que queda detrás de la marca de fin. Delante de
+// ella se apuntan las entradas 0xE5; detrás, cualquier entrada que parezca real (ya no la
+// alcanza nadie). Con check != 0 sólo se acepta si todo lo de delante de la marca parece una
+// entrada y hay al menos una. Devuelve 1 si es un directorio, 0 si no y -1 si hay error
+static int undel_scan_dir(UndelChunk *chunk, uint16_t dir_cluster, const uint8_t *buf, size_t len, int check) {
+    uint32_t max_cluster = chunk->ctx->max_cluster;
+    size_t live = 0;
+    size_t end = len;
+
+    for (size_t i = 0; i < len; i += DIR_ENTRY_SIZE) {
+        if (buf[i] == 0x00) {
+            end = i;
+            break;
+        }
+        if (check && !undel_plausible(buf + i, max_cluster)) return 0;
+        live++;
+    }
+    if (check && live == 0) return 0;
+
+    for (size_t i = 0; i < len; i += DIR_ENTRY_SIZE) {
+        const uint8_t *e = buf + i;
+        int slack = i >= end;
+        if (e[11] == 0x0F) continue;
+        if (slack ? undel_is_empty(e) || !undel_plausible(e, max_cluster) || e[0] == '.' : e[0] != 0xE5) continue;
+        if (undel_add(chunk, dir_cluster, i / DIR_ENTRY_SIZE, slack, e) < 0) return -1;
+    }
+    return 1;
+}
+
+// Tarea: un único trozo grande de la región de datos, cluster a cluster
+static void undel_chunk_task(void *arg, int worker) {
+    (void)worker;
+    UndelChunk *chunk = arg;
+    const UndelCtx *ctx = chunk->ctx;
+    uint64_t offset = ctx->data_offset + (uint64_t)(chunk->first - 2) * ctx->cluster_size;
+
+    ImageView view;
+    const uint8_t *buf = image_get(chunk->img, offset, (size_t)(chunk->end - chunk->first) * ctx->cluster_size, &view);
+    if (!buf) {
+        chunk->error = 1;
+        return;
+    }
+    for (uint32_t c = chunk->first; c < chunk->end; c++) {
+        int r = undel_scan_dir(chunk, (uint16_t)c, buf + (size_t)(c - chunk->first) * ctx->cluster_size,
+                               ctx->cluster_size, 1);
+        if (r < 0) {
+            chunk->error = 1;
+            break;
+        }
+        chunk->dirs += r;
+    }
+    image_put(chunk->img, &view);
+}
+
+// Estado de los clusters que ocuparía el fichero si fuera contiguo: "free" si todos están
+// libres en la FAT, "partial" si sólo algunos, "in-use" si ninguno; "none" sin datos
+static const char *undel_state(const FAT16_Table *fat, const UndelCtx *ctx, uint16_t start, uint32_t size,
+                               uint32_t *nclusters) {
+    *nclusters = (uint32_t)(((uint64_t)size + ctx->cluster_size - 1) / ctx->cluster_size);
+    if (start == 0 || size == 0) return "none";
+    if (start < 2 || (uint64_t)start + *nclusters - 1 > ctx->max_cluster) return "invalid";
+    uint32_t free_clusters = 0;
+    for (uint32_t i = 0; i < *nclusters; i++) {
+        if (fat->entries[start + i] == 0) free_clusters++;
+    }
+    if (free_clusters == *nclusters) return "free";
+    return free_clusters ? "partial" : "in-use";
+}
+
+// Recupera el fichero suponiendo que ocupaba clusters contiguos desde el primero
+static int undel_recover(Image *img, const UndelCtx *ctx, const UndelEntry *u, const char *name, const char *dir) {
+    uint16_t start = u->entry[26] | (u->entry[27] << 8);
+    uint32_t size = u->entry[28] | (u->entry[29] << 8) | (u->entry[30] << 16) | ((uint32_t)u->entry[31] << 24);
+
+    // El nombre lleva el directorio y la posición para que no choquen dos borrados iguales
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%u_%u_%s", dir, u->dir_cluster, u->slot, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    int ret = image_copy_out(img, ctx->data_offset + (uint64_t)(start - 2) * ctx->cluster_size, size, fd);
+    if (ret < 0) perror(path);
     close(fd);
+    return ret;
+}
+
+// --undelete-scan para FAT16: entradas borradas de la raíz y de cualquier cluster que parezca
+// de directorio, con su primer cluster, tamaño y si esos clusters siguen libres. Con recover_dir
+// se recuperan además los ficheros en ese directorio, suponiendo que eran contiguos
+int undelete_scan_FAT16(Image *img, const FAT16_BPB *bpb, int jobs, const char *recover_dir, FILE *out) {
+    // El directorio de recuperación se crea una sola vez, antes de escanear
+    if (recover_dir && mkdir(recover_dir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "No se puede crear %s: %s\n", recover_dir, strerror(errno));
+        return -1;
+    }
+
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) return -1;
+
+    uint32_t root_dir_sectors = ((bpb->RootEntries * 32) + (bpb->BytesPerSector - 1)) / bpb->BytesPerSector;
+    uint32_t root_sector = bpb->ReservedSectors + (bpb->NumFATs * bpb->FATSize16);
+    UndelCtx ctx;
+    ctx.cluster_size = (size_t)bpb->SectorsPerCluster * bpb->BytesPerSector;
+    ctx.data_offset = (uint64_t)(root_sector + root_dir_sectors) * bpb->BytesPerSector;
+    ctx.max_cluster = calculate_cluster_count(bpb) + 1;
+    if (ctx.max_cluster >= fat.count) ctx.max_cluster = fat.count - 1;
+    if (ctx.max_cluster > 0xFFF6) ctx.max_cluster = 0xFFF6;
+    if (img->size && ctx.data_offset < img->size) {
+        uint64_t in_image = (img->size - ctx.data_offset) / ctx.cluster_size + 1;
+        if (in_image < ctx.max_cluster) ctx.max_cluster = (uint32_t)in_image;
+    }
+
+    // El trozo 0 es la raíz; el resto se reparte la región de datos
+    uint32_t per_chunk = UNDEL_CHUNK_BYTES / ctx.cluster_size;
+    if (per_chunk == 0) per_chunk = 1;
+    uint32_t nclusters = ctx.max_cluster >= 2 ? ctx.max_cluster - 1 : 0;
+    size_t nchunks = 1 + (nclusters + per_chunk - 1) / per_chunk;
+    UndelChunk *chunks = calloc(nchunks, sizeof(UndelChunk));
+    if (!chunks) {
+        perror("calloc");
+        free_FAT16_table(&fat);
+        return -1;
+    }
+    for (size_t i = 0; i < nchunks; i++) {
+        chunks[i].img = img;
+        chunks[i].ctx = &ctx;
+        if (i == 0) continue;
+        chunks[i].first = 2 + (uint32_t)(i - 1) * per_chunk;
+        chunks[i].end = chunks[i].first + per_chunk;
+        if (chunks[i].end > ctx.max_cluster + 1) chunks[i].end = ctx.max_cluster + 1;
+    }
+
+    ImageView view;
+    const uint8_t *root = image_get_block(img, (uint64_t)root_sector * bpb->BytesPerSector,
+                                          (size_t)root_dir_sectors * bpb->BytesPerSector, CACHE_DATA, &view);
+    if (!root || undel_scan_dir(&chunks[0], 0, root, (size_t)root_dir_sectors * bpb->BytesPerSector, 0) < 0) {
+        chunks[0].error = 1;
+    }
+    if (root) image_put(img, &view);
+
+    Pool *pool = jobs > 1 ? pool_create(jobs) : NULL;
+    for (size_t i = 1; i < nchunks; i++) {
+        if (pool) pool_submit(pool, undel_chunk_task, &chunks[i]);
+        else undel_chunk_task(&chunks[i], 0);
+    }
+    if (pool) {
+        pool_wait(pool);
+        pool_destroy(pool);
+    }
+
+    int ret = 0;
+    uint64_t deleted = 0, free_entries = 0, recovered = 0;
+    uint32_t dirs = 0;
+    fprintf(out, "--- FAT16 Deleted Entries ---\n");
+    fprintf(out, "DIRECTORY\tSLOT\tNAME\tTYPE\tCLUSTER\tSIZE\tCLUSTERS\tSTATE\n");
+    // Los trozos van en orden de disco, así que la salida no depende de los hilos
+    for (size_t i = 0; i < nchunks; i++) {
+        if (chunks[i].error) ret = -1;
+        dirs += chunks[i].dirs;
+        for (size_t k = 0; k < chunks[i].nfound; k++) {
+            const UndelEntry *u = &chunks[i].found[k];
+            uint8_t e[32];
+            memcpy(e, u->entry, 32);
+            if (e[0] == 0xE5) e[0] = '?';
+            else if (e[0] == 0x05) e[0] = 0xE5;
+            char name[13];
+            format_entry_name(e, name);
+            uint16_t start = e[26] | (e[27] << 8);
+            uint32_t size = e[28] | (e[29] << 8) | (e[30] << 16) | ((uint32_t)e[31] << 24);
+            int is_dir = e[11] & ATTR_DIRECTORY;
+            uint32_t needed;
+            const char *state = undel_state(&fat, &ctx, start, is_dir ? (uint32_t)ctx.cluster_size : size, &needed);
+
+            if (u->dir_cluster) fprintf(out, "%u", u->dir_cluster);
+            else fprintf(out, "root");
+            fprintf(out, "\t%u%s\t%s\t%s\t%u\t%u\t%u\t%s\n", u->slot, u->slack ? "*" : "", name,
+                    is_dir ? "dir" : "file", start, size, needed, state);
+            deleted++;
+            if (strcmp(state, "free") == 0) free_entries++;
+
+            // '?' y '/' no sirven en un nombre de fichero de salida
+            if (recover_dir && !is_dir && strcmp(state, "none") && strcmp(state, "invalid")) {
+                for (char *c = name; *c; c++) {
+                    if (*c == '?' || *c == '/') *c = '_';
+                }
+                if (undel_recover(img, &ctx, u, name, recover_dir) == 0) recovered++;
+                else ret = -1;
+            }
+        }
+        free(chunks[i].found);
+    }
+
+    fprintf(out, "\nDirectory clusters: %u\n", dirs);
+    fprintf(out, "Deleted entries: %llu (%llu with all clusters free)\n", (unsigned long long)deleted,
+            (unsigned long long)free_entries);
+    if (recover_dir) fprintf(out, "Recovered: %llu files in %s\n", (unsigned long long)recovered, recover_dir);
+
+    free(chunks);
+    free_FAT16_table(&fat);
+    return ret;
+}
+
+
+// --extract: un recorrido en paralelo llena la lista y luego se copian los ficheros
+typedef struct {
+    ExtractList list;           // Al principio: la copia recibe la lista y llega al contexto
+    Image *img;
+    const FAT16_BPB *bpb;
+    FAT16_Table *fat;
+} ExtractJobCtx;
+
+typedef struct {
+    Walk *walk;
+    WalkNode *node;
+} ExtractEntryCtx;
+
+// Copia la cadena del fichero; la fecha ya viene de su entrada de directorio
+static int extract_copy(ExtractList *list, ExtractItem *item, int fd) {
+    ExtractJobCtx *ctx = (ExtractJobCtx *)list;
+    if (fd < 0) return 0;
+    int64_t done = dump_FAT16_file(ctx->img, ctx->bpb, ctx->fat, (uint16_t)item->key, (uint32_t)item->size, fd);
+    return done == (int64_t)item->size ? 0 : -1;
+}
+
+// Fecha de modificación de una entrada (-1 si no tiene)
+static int64_t entry_mtime(const uint8_t *entry) {
+    uint16_t date = entry[24] | (entry[25] << 8);
+    uint16_t time = entry[22] | (entry[23] << 8);
+    return date ? (int64_t)FAT16_time(date, time) : -1;
+}
+
+static int extract_job_entry(const uint8_t *entry, void *arg) {
+    ExtractEntryCtx *ee = arg;
+    ExtractJobCtx *ctx = ee->walk->ctx;
+    WalkNode *node = ee->node;
+
+    if (entry[0] == '.') return 0;                          // "." y ".."
+    if ((entry[11] & 0x08) && !(entry[11] & ATTR_DIRECTORY)) return 0;   // Etiqueta de volumen
+
+    char name[13];
+    int len = format_entry_name(entry, name);
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    uint32_t size = entry[28] | (entry[29] << 8) | (entry[30] << 16) | ((uint32_t)entry[31] << 24);
+    int is_dir = (entry[11] & ATTR_DIRECTORY) != 0;
+    if (is_dir && cluster == 0) return 0;
+
+    char *path = find_join(node->data, name, len);
+    if (!path) return 0;
+    if (is_dir) {
+        // El hijo recorre su directorio con su propia copia de la ruta
+        char *child = strdup(path);
+        if (child && !walk_child_data(ee->walk, node, cluster, node->depth + 1, child)) free(child);
+    }
+    extract_add(&ctx->list, path, cluster, is_dir ? 0 : size, entry_mtime(entry), is_dir);
     return 0;
 }
+
+static void extract_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    ExtractJobCtx *ctx = walk->ctx;
+    if (!node->data) return;
+    ExtractEntryCtx ee = { walk, node };
+    for_each_dir_entry(ctx->img, ctx->bpb, ctx->fat, (uint16_t)node->key, extract_job_entry, &ee);
+}
+
+// Añade a la lista el directorio cluster y todo lo que cuelga de él, con rutas bajo root
+static int extract_walk(ExtractJobCtx *ctx, uint16_t cluster, int64_t mtime, const char *root, int jobs) {
+    if (extract_add(&ctx->list, strdup(root), cluster, 0, mtime, 1) < 0) return -1;
+
+    OutWriter out;
+    if (out_init_mem(&out) < 0) return -1;
+    char *data = strdup(root);
+    int ret = data ? walk_run_postorder(jobs, extract_job, find_finish, ctx, cluster, data, 0, &out) : -1;
+    out_free(&out);
+    return ret;
+}
+
+// --extract para FAT16: restaura path (un fichero o un subárbol entero) dentro de dest
+int extract_FAT16(Image *img, const FAT16_BPB *bpb, const char *path, const char *dest, int jobs) {
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) return -1;
+
+    ExtractJobCtx ctx;
+    uint8_t entry[32];
+    if (extract_init(&ctx.list, extract_copy) < 0 || lookup_FAT16_stat(img, bpb, &fat, NULL, path, entry) < 0) {
+        free_FAT16_table(&fat);
+        return -1;
+    }
+    ctx.img = img;
+    ctx.bpb = bpb;
+    ctx.fat = &fat;
+
+    int ret = -1;
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    if (!(entry[11] & ATTR_DIRECTORY)) {
+        // Un solo fichero: se deja en dest con su nombre 8.3
+        char name[13];
+        int len = format_entry_name(entry, name);
+        uint32_t size = entry[28] | (entry[29] << 8) | (entry[30] << 16) | ((uint32_t)entry[31] << 24);
+        if (mkdir(dest, 0755) < 0 && errno != EEXIST) perror(dest);
+        else if (extract_add(&ctx.list, find_join(dest, name, len), cluster, size, entry_mtime(entry), 0) == 0) ret = 0;
+    } else {
+        ret = extract_walk(&ctx, cluster, entry_mtime(entry), dest, jobs);
+    }
+
+    if (ret == 0) ret = extract_run(&ctx.list, jobs);
+    fprintf(stderr, "Extraídos: %zu entradas, %llu bytes, %llu omitidas\n", ctx.list.count,
+            (unsigned long long)ctx.list.bytes, (unsigned long long)ctx.list.skipped);
+    extract_free(&ctx.list);
+    free_FAT16_table(&fat);
+    return ret;
+}
+
+
+// --hash: cada tramo de la cadena va directo al resumen. Una cadena más corta que el
+// tamaño de la entrada (o con un bucle) deja el fichero sin resumen
+static int hash_chain(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t start, uint64_t size, HashCtx *h) {
+    uint32_t root_dir_sectors = ((bpb->RootEntries * 32) + bpb->BytesPerSector - 1) / bpb->BytesPerSector;
+    uint32_t first_data_sector = bpb->ReservedSectors + bpb->NumFATs * bpb->FATSize16 + root_dir_sectors;
+    size_t cl_sz = bpb->SectorsPerCluster * bpb->BytesPerSector;
+    uint64_t remaining = size;
+    uint16_t cur = start;
+    uint32_t clusters = 0;
+    FAT16_Run run;
+
+    while (remaining > 0 && clusters <= fat->count && next_FAT16_run(fat, &cur, &run)) {
+        uint32_t first_sector = ((run.start - 2) * bpb->SectorsPerCluster) + first_data_sector;
+        uint64_t run_bytes = (uint64_t)run.length * cl_sz;
+        uint64_t len = remaining < run_bytes ? remaining : run_bytes;
+        if (hash_image(h, img, (uint64_t)first_sector * bpb->BytesPerSector, len) < 0) return -1;
+        remaining -= len;
+        clusters += run.length;
+    }
+    return remaining ? -1 : 0;
+}
+
+static int hash_file(ExtractList *list, ExtractItem *item, HashCtx *h) {
+    ExtractJobCtx *ctx = (ExtractJobCtx *)list;
+    return hash_chain(ctx->img, ctx->bpb, ctx->fat, (uint16_t)item->key, item->size, h);
+}
+
+// --hash para FAT16: manifiesto de los ficheros de path (por defecto la raíz)
+int hash_FAT16(Image *img, const FAT16_BPB *bpb, const char *path, int algo, int jobs) {
+    FAT16_Table fat;
+    if (load_FAT16_table(img, bpb, &fat) < 0) return -1;
+
+    ExtractJobCtx ctx;
+    uint8_t entry[32];
+    if (extract_init(&ctx.list, NULL) < 0 || lookup_FAT16_stat(img, bpb, &fat, NULL, path, entry) < 0) {
+        free_FAT16_table(&fat);
+        return -1;
+    }
+    ctx.img = img;
+    ctx.bpb = bpb;
+    ctx.fat = &fat;
+
+    int ret = -1;
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    char *root = find_root(path);
+    if (root && !(entry[11] & ATTR_DIRECTORY)) {
+        uint32_t size = entry[28] | (entry[29] << 8) | (entry[30] << 16) | ((uint32_t)entry[31] << 24);
+        ret = extract_add(&ctx.list, root, cluster, size, -1, 0);
+        root = NULL;
+    } else if (root) {
+        ret = extract_walk(&ctx, cluster, -1, root, jobs);
+    }
+    free(root);
+
+    if (ret == 0) ret = hash_manifest(&ctx.list, algo, jobs, hash_file, stdout);
+    extract_free(&ctx.list);
+    free_FAT16_table(&fat);
+    return ret;
+}
+
+
+// --diff: los dos árboles se recorren a la vez, un nodo por cada par de directorios comunes
+typedef struct {
+    DiffCtx diff;               // Al principio: la comparación de ficheros recibe el contexto
+    Image *img[2];
+    const FAT16_BPB *bpb[2];
+    FAT16_Table fat[2];
+} DiffJobCtx;
+
+typedef struct {
+    DiffJobCtx *ctx;
+    DiffList *list;
+} DiffEntryCtx;
+
+static int diff_job_entry(const uint8_t *entry, void *arg) {
+    DiffEntryCtx *de = arg;
+
+    if (entry[0] == '.') return 0;                          // "." y ".."
+    if ((entry[11] & 0x08) && !(entry[11] & ATTR_DIRECTORY)) return 0;   // Etiqueta de volumen
+
+    char name[13];
+    int len = format_entry_name(entry, name);
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    int is_dir = (entry[11] & ATTR_DIRECTORY) != 0;
+    if (is_dir && cluster == 0) return 0;
+    diff_list_add(de->list, name, len, cluster, is_dir, entry);
+    return 0;
+}
+
+// La cadena de start es la misma en las dos FAT durante los clusters que ocupa el fichero
+static int same_chain(DiffJobCtx *ctx, uint16_t start, uint32_t clusters) {
+    uint16_t a = start, b = start;
+    for (uint32_t i = 0; i < clusters && a == b; i++) {
+        if (a < 2 || a >= 0xFFF8) break;
+        a = next_FAT16_cluster(&ctx->fat[0], a);
+        b = next_FAT16_cluster(&ctx->fat[1], b);
+    }
+    return a == b;
+}
+
+// Si la entrada (salvo la fecha de acceso) y la cadena coinciden, el fichero no se lee.
+// Si no, con el mismo tamaño se comparan los resúmenes del contenido
+static int diff_file(DiffCtx *dc, const DiffEntry *a, const DiffEntry *b) {
+    DiffJobCtx *ctx = (DiffJobCtx *)dc;
+    uint32_t size = a->raw[28] | (a->raw[29] << 8) | (a->raw[30] << 16) | ((uint32_t)a->raw[31] << 24);
+    size_t cl_sz = ctx->bpb[0]->SectorsPerCluster * ctx->bpb[0]->BytesPerSector;
+
+    if (memcmp(a->raw, b->raw, 18) == 0 && memcmp(a->raw + 20, b->raw + 20, 12) == 0 &&
+        same_chain(ctx, (uint16_t)a->key, (uint32_t)((size + cl_sz - 1) / cl_sz))) {
+        __atomic_add_fetch(&dc->quick, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if (memcmp(a->raw + 28, b->raw + 28, 4) != 0) return 1;
+
+    char digest[2][HASH_HEX_MAX + 1];
+    const DiffEntry *e[2] = { a, b };
+    for (int s = 0; s < 2; s++) {
+        HashCtx h;
+        hash_init(&h, HASH_XXH64);
+        if (hash_chain(ctx->img[s], ctx->bpb[s], &ctx->fat[s], (uint16_t)e[s]->key, size, &h) < 0) return -1;
+        hash_final(&h, digest[s]);
+    }
+    __atomic_add_fetch(&dc->hashed, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dc->hashed_bytes, 2 * (uint64_t)size, __ATOMIC_RELAXED);
+    return strcmp(digest[0], digest[1]) != 0;
+}
+
+static void diff_job(Walk *walk, WalkNode *node, int worker) {
+    (void)worker;
+    DiffJobCtx *ctx = walk->ctx;
+    const DiffDir *dir = node->data;
+    if (!dir) return;
+
+    uint16_t cluster[2] = { (uint16_t)node->key, (uint16_t)dir->key_b };
+    DiffList lists[2];
+    memset(lists, 0, sizeof(lists));
+    int ok = 1;
+    for (int s = 0; s < 2 && ok; s++) {
+        DiffEntryCtx de = { ctx, &lists[s] };
+        if (for_each_dir_entry(ctx->img[s], ctx->bpb[s], &ctx->fat[s], cluster[s], diff_job_entry, &de) < 0) ok = 0;
+    }
+
+    if (ok) diff_merge(walk, node, &lists[0], &lists[1]);
+    else __atomic_add_fetch(&ctx->diff.errors, 1, __ATOMIC_RELAXED);
+    diff_list_free(&lists[0]);
+    diff_list_free(&lists[1]);
+}
+
+// --diff para FAT16: rutas añadidas, borradas y modificadas de la imagen A a la B
+int diff_FAT16(Image *img_a, const FAT16_BPB *bpb_a, Image *img_b, const FAT16_BPB *bpb_b, int jobs) {
+    DiffJobCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.diff.file = diff_file;
+    ctx.img[0] = img_a;
+    ctx.img[1] = img_b;
+    ctx.bpb[0] = bpb_a;
+    ctx.bpb[1] = bpb_b;
+    if (bpb_a->SectorsPerCluster != bpb_b->SectorsPerCluster || bpb_a->BytesPerSector != bpb_b->BytesPerSector) {
+        fprintf(stderr, "Las dos imágenes no tienen el mismo tamaño de cluster\n");
+        return -1;
+    }
+    if (load_FAT16_table(img_a, bpb_a, &ctx.fat[0]) < 0) return -1;
+    if (load_FAT16_table(img_b, bpb_b, &ctx.fat[1]) < 0) {
+        free_FAT16_table(&ctx.fat[0]);
+        return -1;
+    }
+
+    int ret = -1;
+    OutWriter out;
+    DiffDir *root = diff_dir_new("/", 0);
+    if (root && out_init(&out, STDOUT_FILENO) == 0) {
+        fflush(stdout);
+        ret = walk_run_postorder(jobs, diff_job, diff_finish, &ctx, 0, root, 0, &out);
+        out_free(&out);
+        diff_summary(&ctx.diff, stderr);
+    } else if (root) {
+        free(root->path);
+        free(root);
+    }
+
+    free_FAT16_table(&ctx.fat[0]);
+    free_FAT16_table(&ctx.fat[1]);
+    return ret < 0 || ctx.diff.errors ? -1 : 0;
+}
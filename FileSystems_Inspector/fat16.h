@@ -2,11 +2,18 @@
 #define FAT16_H
 
 #include <stdint.h>
+#include <stdio.h>
+
+#include "image.h"
+#include "out.h"
+#include "find.h"
 
 
 #define FAT16_BPB_OFFSET 0
 #define ATTR_DIRECTORY 0x10
 #define DIR_ENTRY_SIZE 32
+#define FAT16_MAX_CLUSTERS 65536
+#define FAT16_DIR_BATCH 64
 
 
 // Estructura del BPB (BIOS Parameter Block) para FAT16
@@ -35,6 +42,37 @@ typedef struct {
 } FAT16_BPB;
 #pragma pack(pop)       // Restaura la configuración de alineación previa (antes del push)
 
+// Tabla FAT cargada en memoria una sola vez para seguir cadenas de clusters
+typedef struct {
+    const uint16_t *entries;    // Copia principal de la FAT (FAT #1)
+    uint16_t *owned;            // Copia en memoria propia (NULL si apunta a la proyección)
+    uint32_t count;             // Número de entradas de la tabla
+} FAT16_Table;
+
+// Tramo de clusters consecutivos dentro de una cadena
+typedef struct {
+    uint16_t start;             // Primer cluster del tramo
+    uint32_t length;            // Número de clusters contiguos
+} FAT16_Run;
+
+// Índice de un directorio: tabla hash (direccionamiento abierto) de nombre 8.3 a entrada
+typedef struct {
+    uint32_t *slots;            // Posición + 1 en entries (0 = hueco libre)
+    uint32_t nslots;            // Potencia de 2
+    uint8_t (*entries)[32];     // Copia de las entradas vivas del directorio
+    uint32_t count;
+} FAT16_DirIndex;
+
+// Índices de los directorios visitados en una sesión, por cluster (0 = raíz)
+typedef struct {
+    FAT16_DirIndex **dirs;
+    uint8_t *seen;              // Bit por cluster: directorio ya recorrido una vez
+    uint32_t indexed;           // Directorios con índice construido
+} FAT16_DirCache;
+
+// Callback por entrada de directorio (32 bytes): devuelve != 0 para parar
+typedef int (*FAT16_EntryFn)(const uint8_t *entry, void *ctx);
+
 typedef struct {
     char name[12];      // Nombre legible del archivo/directorio
     uint8_t attr;       // Atributos (archivo, directorio, permisos)
@@ -42,11 +80,43 @@ typedef struct {
 } FAT16_DirEntry;
 
 
-int detect_FAT16(const char *device, FAT16_BPB *bpb);
-void print_FAT16_info(const FAT16_BPB *bpb);
+int probe_FAT16(const uint8_t *buf, size_t len, FAT16_BPB *bpb);
+void print_FAT16_info(const FAT16_BPB *bpb, FILE *out);
+
+int print_FAT16_tree(Image *img, const FAT16_BPB *bpb, int jobs);
+
+int cat_FAT16(Image *img, const FAT16_BPB *bpb, const char *filepath);
+int check_FAT16_chain(Image *img, const FAT16_BPB *bpb, const char *filepath);
+int stat_FAT16(Image *img, const FAT16_BPB *bpb, const char *filepath);
+int du_FAT16(Image *img, const FAT16_BPB *bpb, const char *path, int jobs, int max_depth);
+int find_FAT16(Image *img, const FAT16_BPB *bpb, const char *path, FindQuery *q, int jobs);
+int extract_FAT16(Image *img, const FAT16_BPB *bpb, const char *path, const char *dest, int jobs);
+int hash_FAT16(Image *img, const FAT16_BPB *bpb, const char *path, int algo, int jobs);
+int diff_FAT16(Image *img_a, const FAT16_BPB *bpb_a, Image *img_b, const FAT16_BPB *bpb_b, int jobs);
+int fragmentation_FAT16(Image *img, const FAT16_BPB *bpb, int jobs, FILE *out);
+int undelete_scan_FAT16(Image *img, const FAT16_BPB *bpb, int jobs, const char *recover_dir, FILE *out);
 
-void print_FAT16_tree(const char *image_path, const FAT16_BPB *bpb);
+int tree_FAT16(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, int jobs, OutWriter *out);
+int du_FAT16_tree(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, const char *path,
+                  int jobs, int max_depth, OutWriter *out);
+int resolve_FAT16_path(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, FAT16_DirCache *cache,
+                       const char *filepath, uint8_t entry[32]);
+int lookup_FAT16_stat(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, FAT16_DirCache *cache,
+                      const char *filepath, uint8_t entry[32]);
+int64_t dump_FAT16_file(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t start, uint32_t size, int out_fd);
+void print_FAT16_stat(const char *path, const uint8_t entry[32], FILE *out);
 
-int cat_FAT16(const char *image_path, const FAT16_BPB *bpb, const char *filepath);
+int load_FAT16_table(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat);
+uint16_t next_FAT16_cluster(FAT16_Table *fat, uint16_t cluster);
+int for_each_dir_entry(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t cluster,
+                       FAT16_EntryFn fn, void *ctx);
+int format_entry_name(const uint8_t *entry, char out[13]);
+void format_name(const char *input, uint8_t out11[11]);
+uint32_t FAT16_time(uint16_t date, uint16_t time);
+int init_FAT16_dircache(FAT16_DirCache *cache);
+void free_FAT16_dircache(FAT16_DirCache *cache);
+int next_FAT16_run(FAT16_Table *fat, uint16_t *cur, FAT16_Run *run);
+int verify_FAT16_chain(Image *img, const FAT16_BPB *bpb, FAT16_Table *fat, uint16_t start);
+void free_FAT16_table(FAT16_Table *fat);
 
 #endif
\ No newline at end of file
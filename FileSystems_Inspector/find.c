@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include "find.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <time.h>
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+// Tamaño con sufijo opcional k, M o G (potencias de 1024)
+static int parse_size(const char *s, uint64_t *out) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s) return -1;
+    switch (*end) {
+        case 'k': case 'K': v <<= 10; end++; break;
+        case 'm': case 'M': v <<= 20; end++; break;
+        case 'g': case 'G': v <<= 30; end++; break;
+    }
+    if (*end != '\0') return -1;
+    *out = v;
+    return 0;
+}
+
+// Instante en segundos Unix, "AAAA-MM-DD" o "AAAA-MM-DD HH:MM:SS" (UTC)
+static int parse_time(const char *s, int64_t *out) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(s, "%Y-%m-%d %H:%M:%S", &tm);
+    if (!end) {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(s, "%Y-%m-%d", &tm);
+    }
+    if (end && *end == '\0') {
+        *out = timegm(&tm);
+        return 0;
+    }
+
+    char *num_end;
+    long long v = strtoll(s, &num_end, 10);
+    if (num_end == s || *num_end != '\0') return -1;
+    *out = v;
+    return 0;
+}
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Reconoce una opción de --find. Devuelve 1 si la consume, 0 si no es suya y -1 si arg no vale
+int find_parse_option(FindQuery *q, const char *opt, const char *arg) {
+    if (strcmp(opt, "--name") == 0) {
+        if (!arg) goto bad;
+        q->name = arg;
+        return 1;
+    }
+    if (strcmp(opt, "--regex") == 0) {
+        if (!arg) goto bad;
+        q->regex_src = arg;
+        return 1;
+    }
+    if (strcmp(opt, "--size") == 0) {
+        if (!arg) goto bad;
+        q->size_op = (arg[0] == '+' || arg[0] == '-') ? arg[0] : '=';
+        if (parse_size(arg + (q->size_op != '='), &q->size) < 0) goto bad;
+        return 1;
+    }
+    if (strcmp(opt, "--type") == 0) {
+        if (!arg || (strcmp(arg, "f") != 0 && strcmp(arg, "d") != 0)) goto bad;
+        q->type = arg[0];
+        return 1;
+    }
+    if (strcmp(opt, "--newer") == 0) {
+        if (!arg || parse_time(arg, &q->newer) < 0) goto bad;
+        q->has_newer = 1;
+        return 1;
+    }
+    if (strcmp(opt, "--max-results") == 0) {
+        if (!arg || atol(arg) < 1) goto bad;
+        q->max_results = atol(arg);
+        return 1;
+    }
+    return 0;
+
+bad:
+    fprintf(stderr, "Valor no válido para %s%s%s\n", opt, arg ? ": " : "", arg ? arg : "");
+    return -1;
+}
+
+// Compila la expresión regular (sin distinguir mayúsculas si casefold)
+int find_prepare(FindQuery *q, int casefold) {
+    q->casefold = casefold;
+    if (!q->regex_src) return 0;
+    int rc = regcomp(&q->regex, q->regex_src, REG_EXTENDED | REG_NOSUB | (casefold ? REG_ICASE : 0));
+    if (rc != 0) {
+        char msg[128];
+        regerror(rc, &q->regex, msg, sizeof(msg));
+        fprintf(stderr, "Expresión regular no válida: %s\n", msg);
+        return -1;
+    }
+    q->has_regex = 1;
+    return 0;
+}
+
+void find_free(FindQuery *q) {
+    if (q->has_regex) regfree(&q->regex);
+    q->has_regex = 0;
+}
+
+// Predicados que solo necesitan el nombre de la entrada de directorio
+int find_match_name(const FindQuery *q, const char *name, size_t len) {
+    if (!q->name && !q->has_regex) return 1;
+
+    char buf[256];
+    if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    if (q->name && fnmatch(q->name, buf, q->casefold ? FNM_CASEFOLD : 0) != 0) return 0;
+    if (q->has_regex && regexec(&q->regex, buf, 0, NULL, 0) != 0) return 0;
+    return 1;
+}
+
+int find_match_type(const FindQuery *q, int is_dir, int is_reg) {
+    if (q->type == 'd') return is_dir;
+    if (q->type == 'f') return is_reg;
+    return 1;
+}
+
+// Hay predicados que necesitan el inodo (tamaño o fecha)
+int find_needs_meta(const FindQuery *q) {
+    return q->size_op != 0 || q->has_newer;
+}
+
+int find_match_meta(const FindQuery *q, uint64_t size, int64_t mtime) {
+    if (q->size_op == '+' && !(size > q->size)) return 0;
+    if (q->size_op == '-' && !(size < q->size)) return 0;
+    if (q->size_op == '=' && size != q->size) return 0;
+    if (q->has_newer && !(mtime > q->newer)) return 0;
+    return 1;
+}
+
+// Ruta del directorio de partida como "/a/b" (la raíz es "/")
+char *find_root(const char *path) {
+    while (*path == '/') path++;
+    size_t len = strlen(path);
+    while (len > 0 && path[len - 1] == '/') len--;
+    return find_join("", path, len);
+}
+
+// Ruta de una entrada a partir de la de su directorio ("/" para la raíz)
+char *find_join(const char *parent, const char *name, size_t len) {
+    size_t plen = strlen(parent);
+    int slash = plen == 0 || parent[plen - 1] != '/';
+    char *path = malloc(plen + slash + len + 1);
+    if (!path) return NULL;
+    memcpy(path, parent, plen);
+    if (slash) path[plen] = '/';
+    memcpy(path + plen + slash, name, len);
+    path[plen + slash + len] = '\0';
+    return path;
+}
+
+// Añade una coincidencia a la salida del directorio que se está recorriendo
+void find_emit(WalkNode *node, const char *parent, const char *name, size_t len) {
+    size_t plen = strlen(parent);
+    walk_append(node, parent, plen);
+    if (plen == 0 || parent[plen - 1] != '/') walk_append(node, "/", 1);
+    walk_append(node, name, len);
+    walk_append(node, "\n", 1);
+}
+
+// Cierre de cada directorio: solo libera su ruta (las coincidencias ya salieron en preorden)
+void find_finish(Walk *walk, WalkNode *node, OutWriter *out) {
+    (void)walk;
+    (void)out;
+    free(node->data);
+    node->data = NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef FIND_H
+#define FIND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <regex.h>
+
+#include "walk.h"
+#include "out.h"
+
+
+// Predicados de --find; los que faltan no filtran
+typedef struct {
+    const char *name;           // Patrón glob sobre el nombre (--name)
+    const char *regex_src;      // Expresión regular extendida sobre el nombre (--regex)
+    regex_t regex;
+    int has_regex;              // regex compilada
+    char size_op;               // '+' mayor, '-' menor, '=' igual (0 = sin filtro)
+    uint64_t size;
+    char type;                  // 'f' fichero regular, 'd' directorio (0 = cualquiera)
+    int has_newer;
+    int64_t newer;              // Modificado después de este instante (segundos Unix)
+    long max_results;           // 0 = sin límite
+    int casefold;               // Nombres sin distinguir mayúsculas (FAT16)
+} FindQuery;
+
+
+int find_parse_option(FindQuery *q, const char *opt, const char *arg);
+int find_prepare(FindQuery *q, int casefold);
+void find_free(FindQuery *q);
+int find_match_name(const FindQuery *q, const char *name, size_t len);
+int find_match_type(const FindQuery *q, int is_dir, int is_reg);
+int find_needs_meta(const FindQuery *q);
+int find_match_meta(const FindQuery *q, uint64_t size, int64_t mtime);
+char *find_root(const char *path);
+char *find_join(const char *parent, const char *name, size_t len);
+void find_emit(WalkNode *node, const char *parent, const char *name, size_t len);
+void find_finish(Walk *walk, WalkNode *node, OutWriter *out);
+
+#endif
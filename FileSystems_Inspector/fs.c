@@ -0,0 +1,136 @@
+#include "fs.h"
+#include <stdio.h>
+#include <string.h>
+
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+// --- EXT2 ---
+static int ext2_probe(const uint8_t *buf, size_t len, Filesystem *fs) {
+    return probe_EXT2(buf, len, &fs->sb);
+}
+
+static void ext2_info(const Filesystem *fs, FILE *out) {
+    print_EXT2_info(&fs->sb, out);
+}
+
+static int ext2_tree(Image *img, const Filesystem *fs, int jobs) {
+    return print_EXT2_tree(img, &fs->sb, jobs);
+}
+
+static int ext2_cat(Image *img, const Filesystem *fs, const char *path) {
+    return cat_EXT2(img, &fs->sb, path);
+}
+
+static int ext2_stat(Image *img, const Filesystem *fs, const char *path) {
+    return stat_EXT2(img, &fs->sb, path);
+}
+
+static int ext2_du(Image *img, const Filesystem *fs, const char *path, int jobs, int max_depth) {
+    return du_EXT2(img, &fs->sb, path, jobs, max_depth);
+}
+
+static int ext2_find(Image *img, const Filesystem *fs, const char *path, FindQuery *q, int jobs) {
+    return find_EXT2(img, &fs->sb, path, q, jobs);
+}
+
+static int ext2_extract(Image *img, const Filesystem *fs, const char *path, const char *dest, int jobs) {
+    return extract_EXT2(img, &fs->sb, path, dest, jobs);
+}
+
+static int ext2_hash(Image *img, const Filesystem *fs, const char *path, int algo, int jobs) {
+    return hash_EXT2(img, &fs->sb, path, algo, jobs);
+}
+
+static int ext2_diff(Image *img_a, const Filesystem *fs_a, Image *img_b, const Filesystem *fs_b, int jobs) {
+    return diff_EXT2(img_a, &fs_a->sb, img_b, &fs_b->sb, jobs);
+}
+
+// --- FAT16 ---
+static int fat16_probe(const uint8_t *buf, size_t len, Filesystem *fs) {
+    return probe_FAT16(buf, len, &fs->bpb);
+}
+
+static void fat16_info(const Filesystem *fs, FILE *out) {
+    print_FAT16_info(&fs->bpb, out);
+}
+
+static int fat16_tree(Image *img, const Filesystem *fs, int jobs) {
+    return print_FAT16_tree(img, &fs->bpb, jobs);
+}
+
+static int fat16_cat(Image *img, const Filesystem *fs, const char *path) {
+    return cat_FAT16(img, &fs->bpb, path);
+}
+
+static int fat16_stat(Image *img, const Filesystem *fs, const char *path) {
+    return stat_FAT16(img, &fs->bpb, path);
+}
+
+static int fat16_du(Image *img, const Filesystem *fs, const char *path, int jobs, int max_depth) {
+    return du_FAT16(img, &fs->bpb, path, jobs, max_depth);
+}
+
+static int fat16_find(Image *img, const Filesystem *fs, const char *path, FindQuery *q, int jobs) {
+    return find_FAT16(img, &fs->bpb, path, q, jobs);
+}
+
+static int fat16_extract(Image *img, const Filesystem *fs, const char *path, const char *dest, int jobs) {
+    return extract_FAT16(img, &fs->bpb, path, dest, jobs);
+}
+
+static int fat16_hash(Image *img, const Filesystem *fs, const char *path, int algo, int jobs) {
+    return hash_FAT16(img, &fs->bpb, path, algo, jobs);
+}
+
+static int fat16_diff(Image *img_a, const Filesystem *fs_a, Image *img_b, const Filesystem *fs_b, int jobs) {
+    return diff_FAT16(img_a, &fs_a->bpb, img_b, &fs_b->bpb, jobs);
+}
+
+static const FsDriver ext2_driver = {
+    "EXT2", FS_EXT2, ext2_probe, ext2_info, ext2_tree, ext2_cat, ext2_stat, ext2_du, ext2_find, ext2_extract,
+    ext2_hash, ext2_diff
+};
+
+static const FsDriver fat16_driver = {
+    "FAT16", FS_FAT16, fat16_probe, fat16_info, fat16_tree, fat16_cat, fat16_stat, fat16_du, fat16_find,
+    fat16_extract, fat16_hash, fat16_diff
+};
+
+// Se prueban en orden: el primero que reconoce la cabecera se queda con la imagen
+static const FsDriver *const drivers[] = { &ext2_driver, &fat16_driver };
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Lee una sola vez el principio de la imagen y se lo pasa a cada driver.
+// Devuelve 1 si alguno lo reconoce, 0 si ninguno y -1 si no se puede leer
+int fs_detect(Image *img, Filesystem *fs) {
+    memset(fs, 0, sizeof(*fs));
+
+    uint8_t buf[FS_PROBE_SIZE];
+    size_t len = sizeof(buf);
+    if (img->size && img->size < len) len = img->size;
+    if (image_read(img, buf, len, 0) < 0) {
+        perror("Error al leer la cabecera de la imagen");
+        return -1;
+    }
+
+    for (size_t i = 0; i < sizeof(drivers) / sizeof(drivers[0]); i++) {
+        if (drivers[i]->probe(buf, len, fs) == 1) {
+            fs->drv = drivers[i];
+            return 1;
+        }
+    }
+    memset(fs, 0, sizeof(*fs));
+    return 0;
+}
+
+// El sistema detectado es del tipo dado (FS_EXT2 / FS_FAT16)
+int fs_is(const Filesystem *fs, int type) {
+    return fs->drv && fs->drv->type == type;
+}
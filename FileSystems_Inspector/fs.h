@@ -0,0 +1,52 @@
+#ifndef FS_H
+#define FS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "image.h"
+#include "find.h"
+#include "ext2.h"
+#include "fat16.h"
+
+
+// Bytes del principio de la imagen que se leen una vez para reconocer el sistema de archivos
+#define FS_PROBE_SIZE 4096
+
+#define FS_EXT2 1
+#define FS_FAT16 2
+
+typedef struct FsDriver FsDriver;
+
+// Sistema de archivos reconocido: su driver y la cabecera leída al detectarlo
+typedef struct {
+    const FsDriver *drv;        // NULL si ningún driver lo reconoce
+    union {
+        EXT2_Superblock sb;
+        FAT16_BPB bpb;
+    };
+} Filesystem;
+
+// Operaciones de un formato. probe mira el buffer compartido y devuelve 1 si es suyo;
+// el resto trabaja sobre la imagen ya abierta
+struct FsDriver {
+    const char *name;
+    int type;                   // FS_EXT2 / FS_FAT16
+    int (*probe)(const uint8_t *buf, size_t len, Filesystem *fs);
+    void (*info)(const Filesystem *fs, FILE *out);
+    int (*tree)(Image *img, const Filesystem *fs, int jobs);
+    int (*cat)(Image *img, const Filesystem *fs, const char *path);
+    int (*stat)(Image *img, const Filesystem *fs, const char *path);
+    int (*du)(Image *img, const Filesystem *fs, const char *path, int jobs, int max_depth);
+    int (*find)(Image *img, const Filesystem *fs, const char *path, FindQuery *q, int jobs);
+    int (*extract)(Image *img, const Filesystem *fs, const char *path, const char *dest, int jobs);
+    int (*hash)(Image *img, const Filesystem *fs, const char *path, int algo, int jobs);
+    int (*diff)(Image *img_a, const Filesystem *fs_a, Image *img_b, const Filesystem *fs_b, int jobs);
+};
+
+
+int fs_detect(Image *img, Filesystem *fs);
+int fs_is(const Filesystem *fs, int type);
+
+#endif
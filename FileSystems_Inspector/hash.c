@@ -0,0 +1,437 @@
+#include "hash.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HASH_X86 1
+#endif
+
+// Resúmenes de contenido para --hash: CRC32C, XXH64 y SHA-256. CRC32C usa la instrucción
+// crc32 de SSE4.2 y SHA-256 las extensiones SHA si la CPU las tiene (se elige una vez)
+
+// Trozo de imagen que se pide de una vez al resumir un tramo
+#define HASH_READ_CHUNK (1u << 20)
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+#define ROTR32(x, r) (((x) >> (r)) | ((x) << (32 - (r))))
+
+static const uint64_t XXH_P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH_P2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH_P3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH_P4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH_P5 = 0x27D4EB2F165667C5ULL;
+
+static const uint32_t SHA_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Estado compartido por los hilos de hash_manifest
+typedef struct {
+    HashFileFn fn;
+    int algo;
+    char (*digests)[HASH_HEX_MAX + 1];     // Alineado con los elementos de la lista
+    uint64_t bytes;             // Bytes resumidos (atómico)
+    int errors;                 // Ficheros que no se han podido leer enteros (atómico)
+} HashRun;
+
+typedef uint32_t (*CrcFn)(uint32_t crc, const uint8_t *p, size_t len);
+typedef void (*ShaBlocksFn)(uint32_t h[8], const uint8_t *p, size_t nblocks);
+
+static uint32_t crc_table[256];
+static CrcFn crc_fn;
+static ShaBlocksFn sha_fn;
+static const char *crc_name;
+static const char *sha_name;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static uint64_t load64(const uint8_t *p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+static uint32_t load32(const uint8_t *p) {
+    uint32_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+static uint32_t load32_be(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// --- CRC32C (polinomio de Castagnoli, reflejado) ---
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *p, size_t len) {
+    for (size_t i = 0; i < len; i++) crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef HASH_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len) {
+    size_t i = 0;
+#ifdef __x86_64__
+    uint64_t c = crc;
+    for (; i + 8 <= len; i += 8) c = _mm_crc32_u64(c, load64(p + i));
+    crc = (uint32_t)c;
+#endif
+    for (; i + 4 <= len; i += 4) crc = _mm_crc32_u32(crc, load32(p + i));
+    for (; i < len; i++) crc = _mm_crc32_u8(crc, p[i]);
+    return crc;
+}
+#endif
+
+// --- XXH64 ---
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    acc = ROTL64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+// Consume bloques de 32 bytes; devuelve los bytes consumidos
+static size_t xxh_stripes(uint64_t v[4], const uint8_t *p, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        v[0] = xxh_round(v[0], load64(p + i));
+        v[1] = xxh_round(v[1], load64(p + i + 8));
+        v[2] = xxh_round(v[2], load64(p + i + 16));
+        v[3] = xxh_round(v[3], load64(p + i + 24));
+    }
+    return i;
+}
+
+// --- SHA-256 ---
+static void sha256_blocks_c(uint32_t h[8], const uint8_t *p, size_t nblocks) {
+    for (size_t b = 0; b < nblocks; b++, p += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) w[i] = load32_be(p + 4 * i);
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = h[0], bb = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = hh + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + SHA_K[i] + w[i];
+            uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & bb) ^ (a & c) ^ (bb & c));
+            hh = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = bb;
+            bb = a;
+            a = t1 + t2;
+        }
+        h[0] += a;
+        h[1] += bb;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += hh;
+    }
+}
+
+#ifdef HASH_X86
+// Cuatro rondas por grupo con sha256rnds2; el calendario de mensajes se completa con
+// sha256msg1/msg2 sobre cuatro registros que rotan
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_blocks_ni(uint32_t h[8], const uint8_t *p, size_t nblocks) {
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xB1);   // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]), 0x1B); // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);                                   // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                        // CDGH
+
+    for (size_t b = 0; b < nblocks; b++, p += 64) {
+        __m128i abef = state0, cdgh = state1;
+        __m128i msg[4];
+        for (int i = 0; i < 16; i++) {
+            if (i < 4) msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * i)), mask);
+            __m128i m = _mm_add_epi32(msg[i % 4], _mm_loadu_si128((const __m128i *)&SHA_K[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+            if (i >= 3 && i < 15) {
+                __m128i next = _mm_add_epi32(msg[(i + 1) % 4], _mm_alignr_epi8(msg[i % 4], msg[(i + 3) % 4], 4));
+                msg[(i + 1) % 4] = _mm_sha256msg2_epu32(next, msg[i % 4]);
+            }
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+            if (i >= 1 && i < 13) msg[(i + 3) % 4] = _mm_sha256msg1_epu32(msg[(i + 3) % 4], msg[i % 4]);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);             // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);          // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);       // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);          // HGFE
+    _mm_storeu_si128((__m128i *)&h[0], state0);
+    _mm_storeu_si128((__m128i *)&h[4], state1);
+}
+#endif
+
+static void choose_kernels(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & -(c & 1));
+        crc_table[i] = c;
+    }
+    crc_fn = crc32c_table;
+    crc_name = "table";
+    sha_fn = sha256_blocks_c;
+    sha_name = "scalar";
+#ifdef HASH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc_fn = crc32c_sse42;
+        crc_name = "sse4.2";
+    }
+    // __builtin_cpu_supports no conoce "sha": se mira CPUID.(EAX=7,ECX=0):EBX[29]
+    unsigned eax, ebx, ecx, edx;
+    __asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+    unsigned max_leaf = eax;
+    if (max_leaf >= 7 && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3")) {
+        __asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+        if (ebx & (1u << 29)) {
+            sha_fn = sha256_blocks_ni;
+            sha_name = "sha-ni";
+        }
+    }
+#endif
+}
+
+static void hash_item(ExtractList *list, size_t index, void *arg) {
+    HashRun *run = arg;
+    ExtractItem *item = &list->items[index];
+    HashCtx h;
+    hash_init(&h, run->algo);
+    if (run->fn(list, item, &h) < 0) {
+        fprintf(stderr, "No se ha podido leer entero %s\n", item->path);
+        strcpy(run->digests[index], "-");
+        __atomic_add_fetch(&run->errors, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    hash_final(&h, run->digests[index]);
+    __atomic_add_fetch(&run->bytes, item->size, __ATOMIC_RELAXED);
+}
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Algoritmo de --algo (-1 si no se conoce)
+int hash_algo_parse(const char *name) {
+    if (strcmp(name, "crc32c") == 0) return HASH_CRC32C;
+    if (strcmp(name, "xxh64") == 0) return HASH_XXH64;
+    if (strcmp(name, "sha256") == 0) return HASH_SHA256;
+    return -1;
+}
+
+const char *hash_algo_name(int algo) {
+    switch (algo) {
+        case HASH_CRC32C: return "crc32c";
+        case HASH_XXH64:  return "xxh64";
+        default:          return "sha256";
+    }
+}
+
+// Núcleo elegido para esta CPU
+const char *hash_kernel_name(int algo) {
+    pthread_once(&kernel_once, choose_kernels);
+    switch (algo) {
+        case HASH_CRC32C: return crc_name;
+        case HASH_XXH64:  return "scalar";
+        default:          return sha_name;
+    }
+}
+
+void hash_init(HashCtx *h, int algo) {
+    pthread_once(&kernel_once, choose_kernels);
+    memset(h, 0, sizeof(*h));
+    h->algo = algo;
+    switch (algo) {
+    case HASH_CRC32C:
+        h->crc = 0xFFFFFFFFu;
+        break;
+    case HASH_XXH64:
+        h->xxh.v[0] = XXH_P1 + XXH_P2;
+        h->xxh.v[1] = XXH_P2;
+        h->xxh.v[2] = 0;
+        h->xxh.v[3] = -XXH_P1;
+        break;
+    default: {
+        static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+        memcpy(h->sha.h, iv, sizeof(iv));
+        break;
+    }
+    }
+}
+
+// Añade len bytes al resumen. XXH64 y SHA-256 guardan aparte lo que no llena un bloque
+void hash_update(HashCtx *h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    if (h->algo == HASH_CRC32C) {
+        h->crc = crc_fn(h->crc, p, len);
+        h->total += len;
+        return;
+    }
+
+    size_t block = h->algo == HASH_XXH64 ? 32 : 64;
+    uint8_t *mem = h->algo == HASH_XXH64 ? h->xxh.mem : h->sha.mem;
+    size_t fill = h->total % block;
+    h->total += len;
+
+    if (fill) {
+        size_t take = block - fill < len ? block - fill : len;
+        memcpy(mem + fill, p, take);
+        p += take;
+        len -= take;
+        if (fill + take < block) return;
+        if (h->algo == HASH_XXH64) xxh_stripes(h->xxh.v, mem, block);
+        else sha_fn(h->sha.h, mem, 1);
+    }
+
+    size_t whole = len - len % block;
+    if (h->algo == HASH_XXH64) xxh_stripes(h->xxh.v, p, whole);
+    else sha_fn(h->sha.h, p, whole / 64);
+    memcpy(mem, p + whole, len - whole);
+}
+
+// Añade len bytes a cero (huecos de ficheros dispersos) sin leerlos de ningún sitio
+void hash_zeros(HashCtx *h, uint64_t len) {
+    static const uint8_t zeros[64 << 10];
+    while (len > 0) {
+        size_t n = len < sizeof(zeros) ? (size_t)len : sizeof(zeros);
+        hash_update(h, zeros, n);
+        len -= n;
+    }
+}
+
+// Añade len bytes de la imagen desde offset, por trozos grandes y sin pasar por la caché
+int hash_image(HashCtx *h, Image *img, uint64_t offset, uint64_t len) {
+    while (len > 0) {
+        size_t n = len < HASH_READ_CHUNK ? (size_t)len : HASH_READ_CHUNK;
+        ImageView view;
+        const uint8_t *data = image_get(img, offset, n, &view);
+        if (!data) return -1;
+        hash_update(h, data, n);
+        image_put(img, &view);
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Cierra el resumen y lo deja en hexadecimal (CRC32C y XXH64 como número, SHA-256 por bytes)
+void hash_final(HashCtx *h, char hex[HASH_HEX_MAX + 1]) {
+    if (h->algo == HASH_CRC32C) {
+        snprintf(hex, HASH_HEX_MAX + 1, "%08x", h->crc ^ 0xFFFFFFFFu);
+        return;
+    }
+
+    if (h->algo == HASH_XXH64) {
+        const uint64_t *v = h->xxh.v;
+        uint64_t acc;
+        if (h->total >= 32) {
+            acc = ROTL64(v[0], 1) + ROTL64(v[1], 7) + ROTL64(v[2], 12) + ROTL64(v[3], 18);
+            for (int i = 0; i < 4; i++) acc = xxh_merge(acc, v[i]);
+        } else {
+            acc = XXH_P5;
+        }
+        acc += h->total;
+
+        const uint8_t *p = h->xxh.mem;
+        size_t left = h->total % 32;
+        for (; left >= 8; p += 8, left -= 8) {
+            acc ^= xxh_round(0, load64(p));
+            acc = ROTL64(acc, 27) * XXH_P1 + XXH_P4;
+        }
+        if (left >= 4) {
+            acc ^= (uint64_t)load32(p) * XXH_P1;
+            acc = ROTL64(acc, 23) * XXH_P2 + XXH_P3;
+            p += 4;
+            left -= 4;
+        }
+        for (; left > 0; p++, left--) {
+            acc ^= *p * XXH_P5;
+            acc = ROTL64(acc, 11) * XXH_P1;
+        }
+        acc ^= acc >> 33;
+        acc *= XXH_P2;
+        acc ^= acc >> 29;
+        acc *= XXH_P3;
+        acc ^= acc >> 32;
+        snprintf(hex, HASH_HEX_MAX + 1, "%016llx", (unsigned long long)acc);
+        return;
+    }
+
+    // SHA-256: 0x80, ceros y la longitud en bits (big-endian) al final del último bloque
+    uint64_t bits = h->total * 8;
+    uint8_t pad[72] = { 0x80 };
+    size_t fill = h->total % 64;
+    size_t padlen = (fill < 56 ? 56 : 120) - fill;
+    for (int i = 0; i < 8; i++) pad[padlen + i] = (uint8_t)(bits >> (56 - 8 * i));
+    hash_update(h, pad, padlen + 8);
+    for (int i = 0; i < 8; i++) snprintf(hex + 8 * i, 9, "%08x", h->sha.h[i]);
+}
+
+// --hash: resume en jobs hilos los ficheros de la lista y escribe en out el manifiesto
+// "ruta<TAB>tamaño<TAB>resumen" ordenado por ruta. Devuelve -1 si algún fichero falla
+int hash_manifest(ExtractList *list, int algo, int jobs, HashFileFn fn, FILE *out) {
+    HashRun run = { fn, algo, NULL, 0, 0 };
+    run.digests = calloc(list->count ? list->count : 1, sizeof(*run.digests));
+    if (!run.digests) {
+        perror("calloc");
+        return -1;
+    }
+
+    extract_sort(list);
+    if (extract_for_each(list, jobs, hash_item, &run) < 0) {
+        free(run.digests);
+        return -1;
+    }
+
+    size_t files = 0;
+    uint64_t written = 0;
+    STATS_START(t0);
+    for (size_t i = 0; i < list->count; i++) {
+        const ExtractItem *item = &list->items[i];
+        if (item->is_dir) continue;
+        int n = fprintf(out, "%s\t%llu\t%s\n", item->path, (unsigned long long)item->size, run.digests[i]);
+        if (n > 0) written += n;
+        files++;
+    }
+    fflush(out);
+    STATS_WRITE(written, t0);
+    fprintf(stderr, "Resumen %s (%s): %zu ficheros, %llu bytes, %llu omitidos\n", hash_algo_name(algo),
+            hash_kernel_name(algo), files, (unsigned long long)run.bytes, (unsigned long long)list->skipped);
+
+    free(run.digests);
+    return run.errors ? -1 : 0;
+}
@@ -0,0 +1,51 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <stdio.h>
+
+#include "image.h"
+#include "extract.h"
+
+
+#define HASH_CRC32C 0
+#define HASH_XXH64 1
+#define HASH_SHA256 2
+
+// Longitud máxima del resumen en hexadecimal (SHA-256), sin el terminador
+#define HASH_HEX_MAX 64
+
+// Estado de un resumen que se va alimentando por trozos
+typedef struct {
+    int algo;
+    uint64_t total;             // Bytes recibidos
+    union {
+        uint32_t crc;
+        struct {
+            uint64_t v[4];
+            uint8_t mem[32];
+        } xxh;
+        struct {
+            uint32_t h[8];
+            uint8_t mem[64];
+        } sha;
+    };
+} HashCtx;
+
+// Resume el contenido de item en h (y deja en item->size su tamaño). Devuelve 0 o -1
+typedef int (*HashFileFn)(ExtractList *list, ExtractItem *item, HashCtx *h);
+
+
+int hash_algo_parse(const char *name);
+const char *hash_algo_name(int algo);
+const char *hash_kernel_name(int algo);
+void hash_init(HashCtx *h, int algo);
+void hash_update(HashCtx *h, const void *data, size_t len);
+void hash_zeros(HashCtx *h, uint64_t len);
+int hash_image(HashCtx *h, Image *img, uint64_t offset, uint64_t len);
+void hash_final(HashCtx *h, char hex[HASH_HEX_MAX + 1]);
+int hash_manifest(ExtractList *list, int algo, int jobs, HashFileFn fn, FILE *out);
+
+#endif
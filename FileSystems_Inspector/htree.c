@@ -0,0 +1,152 @@
+#include "htree.h"
+#include <string.h>
+
+// Hashes de nombre de los directorios indexados de EXT2/EXT3 (los mismos que calcula el
+// kernel): el índice se ordena por ellos y una búsqueda sólo tiene que bajar por él
+
+#define ROL32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+// Hash "legacy" (dx_hack_hash). Los caracteres se toman con o sin signo según la versión
+static uint32_t legacy_hash(const char *name, size_t len, int is_unsigned) {
+    uint32_t hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    for (size_t i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+        uint32_t hash = hash1 + (hash0 ^ ((uint32_t)c * 7152373u));
+        if (hash & 0x80000000u) hash -= 0x7fffffff;
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+// Empaqueta hasta num*4 bytes del nombre en palabras de 32 bits, rellenando con la longitud
+static void str2hashbuf(const char *msg, size_t len, uint32_t *buf, int num, int is_unsigned) {
+    uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+    uint32_t val = pad;
+
+    if (len > (size_t)num * 4) len = (size_t)num * 4;
+    for (size_t i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+        val = (uint32_t)c + (val << 8);
+        if (i % 4 == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) *buf++ = val;
+    while (--num >= 0) *buf++ = pad;
+}
+
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = ROL32(a, s))
+#define K1 0u
+#define K2 013240474631u
+#define K3 015666365641u
+
+// MD4 reducido a tres rondas de ocho pasos
+static void half_md4_transform(uint32_t buf[4], const uint32_t in[8]) {
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    ROUND(F, a, b, c, d, in[0] + K1, 3);
+    ROUND(F, d, a, b, c, in[1] + K1, 7);
+    ROUND(F, c, d, a, b, in[2] + K1, 11);
+    ROUND(F, b, c, d, a, in[3] + K1, 19);
+    ROUND(F, a, b, c, d, in[4] + K1, 3);
+    ROUND(F, d, a, b, c, in[5] + K1, 7);
+    ROUND(F, c, d, a, b, in[6] + K1, 11);
+    ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+    ROUND(G, a, b, c, d, in[1] + K2, 3);
+    ROUND(G, d, a, b, c, in[3] + K2, 5);
+    ROUND(G, c, d, a, b, in[5] + K2, 9);
+    ROUND(G, b, c, d, a, in[7] + K2, 13);
+    ROUND(G, a, b, c, d, in[0] + K2, 3);
+    ROUND(G, d, a, b, c, in[2] + K2, 5);
+    ROUND(G, c, d, a, b, in[4] + K2, 9);
+    ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+    ROUND(H, a, b, c, d, in[3] + K3, 3);
+    ROUND(H, d, a, b, c, in[7] + K3, 9);
+    ROUND(H, c, d, a, b, in[2] + K3, 11);
+    ROUND(H, b, c, d, a, in[6] + K3, 15);
+    ROUND(H, a, b, c, d, in[1] + K3, 3);
+    ROUND(H, d, a, b, c, in[5] + K3, 9);
+    ROUND(H, c, d, a, b, in[0] + K3, 11);
+    ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+// 16 vueltas de TEA sobre las dos primeras palabras
+static void tea_transform(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+
+    for (int n = 0; n < 16; n++) {
+        sum += 0x9E3779B9u;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Calcula el hash de un nombre con la versión y la semilla (s_hash_seed) del sistema de
+// archivos. El bit bajo queda a 0: en el índice marca colisiones. Devuelve -1 si la versión
+// no se conoce
+int htree_hash(const char *name, size_t len, int version, const uint32_t seed[4], uint32_t *hash) {
+    // Semilla por defecto de MD4, salvo que el superbloque traiga una distinta de cero
+    uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    if (seed && (seed[0] | seed[1] | seed[2] | seed[3])) memcpy(buf, seed, sizeof(buf));
+
+    uint32_t in[8];
+    uint32_t h;
+    int is_unsigned = version >= HTREE_HASH_LEGACY_UNSIGNED;
+
+    switch (version) {
+    case HTREE_HASH_LEGACY:
+    case HTREE_HASH_LEGACY_UNSIGNED:
+        h = legacy_hash(name, len, is_unsigned);
+        break;
+    case HTREE_HASH_HALF_MD4:
+    case HTREE_HASH_HALF_MD4_UNSIGNED:
+        for (size_t off = 0; off < len; off += 32) {
+            str2hashbuf(name + off, len - off, in, 8, is_unsigned);
+            half_md4_transform(buf, in);
+        }
+        h = buf[1];
+        break;
+    case HTREE_HASH_TEA:
+    case HTREE_HASH_TEA_UNSIGNED:
+        for (size_t off = 0; off < len; off += 16) {
+            str2hashbuf(name + off, len - off, in, 4, is_unsigned);
+            tea_transform(buf, in);
+        }
+        h = buf[0];
+        break;
+    default:
+        return -1;
+    }
+
+    h &= ~1u;
+    if (h == HTREE_EOF_HASH) h = HTREE_EOF_HASH - 2;
+    *hash = h;
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef HTREE_H
+#define HTREE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Versiones de hash de los directorios indexados (dx_root_info.hash_version)
+#define HTREE_HASH_LEGACY 0
+#define HTREE_HASH_HALF_MD4 1
+#define HTREE_HASH_TEA 2
+#define HTREE_HASH_LEGACY_UNSIGNED 3
+#define HTREE_HASH_HALF_MD4_UNSIGNED 4
+#define HTREE_HASH_TEA_UNSIGNED 5
+
+// Hash que marca el final del índice: ningún nombre puede tenerlo
+#define HTREE_EOF_HASH 0xFFFFFFFEu
+
+
+int htree_hash(const char *name, size_t len, int version, const uint32_t seed[4], uint32_t *hash);
+
+#endif
@@ -0,0 +1,678 @@
+#define _GNU_SOURCE
+#include "image.h"
+#include "uring.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+// Cada hilo guarda sus propios buffers libres: el recorrido paralelo no comparte nada
+static pthread_key_t free_bufs_key;
+static pthread_once_t free_bufs_once = PTHREAD_ONCE_INIT;
+
+static void free_buffer_list(void *head) {
+    ImageBuffer *b = head;
+    while (b) {
+        ImageBuffer *next = b->next;
+        free(b->data);
+        free(b);
+        b = next;
+    }
+}
+
+static void create_free_bufs_key(void) {
+    pthread_key_create(&free_bufs_key, free_buffer_list);
+}
+
+static ImageBuffer *get_free_bufs(void) {
+    pthread_once(&free_bufs_once, create_free_bufs_key);
+    return pthread_getspecific(free_bufs_key);
+}
+
+static void give_buffer(ImageBuffer *b) {
+    b->next = get_free_bufs();
+    pthread_setspecific(free_bufs_key, b);
+}
+
+// Saca un buffer libre de al menos len bytes (o crea uno nuevo)
+static ImageBuffer *take_buffer(size_t len) {
+    ImageBuffer *head = get_free_bufs();
+    ImageBuffer **prev = &head;
+    for (ImageBuffer *b = head; b; prev = &b->next, b = b->next) {
+        if (b->capacity >= len) {
+            *prev = b->next;
+            pthread_setspecific(free_bufs_key, head);
+            return b;
+        }
+    }
+
+    // Ninguno sirve: se amplía el primero libre o se crea uno
+    ImageBuffer *b = head;
+    if (b) {
+        pthread_setspecific(free_bufs_key, b->next);
+    } else {
+        b = calloc(1, sizeof(ImageBuffer));
+        if (!b) return NULL;
+    }
+    uint8_t *data = realloc(b->data, len);
+    if (!data) {
+        free(b->data);
+        free(b);
+        return NULL;
+    }
+    b->data = data;
+    b->capacity = len;
+    return b;
+}
+
+// Lee len bytes completos en offset, reintentando lecturas parciales
+static int read_full(int fd, void *dst, size_t len, uint64_t offset) {
+    uint8_t *p = dst;
+    while (len > 0) {
+        STATS_START(t);
+        ssize_t n = pread(fd, p, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            errno = EIO;
+            return -1;
+        }
+        STATS_READ(offset, (uint64_t)n, t);
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Escribe len bytes completos en out_fd
+static int write_full(int out_fd, const uint8_t *p, size_t len) {
+    while (len > 0) {
+        STATS_START(t);
+        ssize_t n = write(out_fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        STATS_WRITE((uint64_t)n, t);
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Alineación de offsets, longitudes y buffers con O_DIRECT
+#define IMAGE_DIRECT_ALIGN 4096u
+
+// Lee de la imagen respetando O_DIRECT: el rango se amplía a bloques alineados
+// en un buffer alineado y se copia la parte pedida
+static int read_at(Image *img, void *dst, size_t len, uint64_t offset) {
+    if (!img->direct) return read_full(img->fd, dst, len, offset);
+
+    uint64_t start = offset & ~(uint64_t)(IMAGE_DIRECT_ALIGN - 1);
+    size_t span = (offset - start + len + IMAGE_DIRECT_ALIGN - 1) & ~(size_t)(IMAGE_DIRECT_ALIGN - 1);
+    void *bounce;
+    if (posix_memalign(&bounce, IMAGE_DIRECT_ALIGN, span) != 0) return -1;
+
+    // El último bloque puede quedar tras el final de la imagen: basta con tener lo pedido
+    uint8_t *p = bounce;
+    size_t need = offset - start + len, got = 0;
+    int ret = 0;
+    while (got < need) {
+        STATS_START(t);
+        ssize_t n = pread(img->fd, p + got, span - got, (off_t)(start + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            ret = -1;
+            break;
+        }
+        STATS_READ(start + got, (uint64_t)n, t);
+        got += n;
+    }
+    if (ret == 0) memcpy(dst, p + (offset - start), len);
+    free(bounce);
+    return ret;
+}
+
+// Copia en el kernel con copy_file_range (solo entre ficheros regulares).
+// Devuelve los bytes copiados; el resto se copia por otra vía
+static uint64_t copy_in_kernel(Image *img, uint64_t offset, uint64_t len, int out_fd) {
+    loff_t in_off = offset;
+    uint64_t done = 0;
+    while (done < len) {
+        STATS_START(t);
+        ssize_t n = copy_file_range(img->fd, &in_off, out_fd, NULL, len - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        STATS_COPY(offset + done, (uint64_t)n, t);
+        done += n;
+    }
+    return done;
+}
+
+static int read_for_cache(void *ctx, void *dst, size_t len, uint64_t offset) {
+    Image *img = ctx;
+    return read_at(img, dst, len, offset);
+}
+
+// Anillo de io_uring de cada hilo: lo comparten los lotes anidados del mismo hilo
+// (un recorrido recursivo abre un lote dentro de la entrega de otro)
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static atomic_int ring_unavailable;
+
+static void free_ring(void *arg) {
+    Uring *ring = arg;
+    if (!ring) return;
+    uring_free(ring);
+    free(ring);
+}
+
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, free_ring);
+}
+
+static Uring *thread_ring(Image *img) {
+    if (img->io_depth < 2 || atomic_load(&ring_unavailable)) return NULL;
+    pthread_once(&ring_once, create_ring_key);
+    Uring *ring = pthread_getspecific(ring_key);
+    if (ring) return ring;
+
+    ring = malloc(sizeof(Uring));
+    if (!ring || uring_init(ring, img->io_depth) < 0) {
+        free(ring);
+        // Kernel sin io_uring (o prohibido): se avisa una vez y se sigue en síncrono
+        if (atomic_exchange(&ring_unavailable, 1) == 0) {
+            fprintf(stderr, "io_uring no disponible (%s): lecturas síncronas\n", strerror(errno));
+        }
+        return NULL;
+    }
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+// Hueco de un lote: una lectura en vuelo o terminada pendiente de entregar
+typedef struct BatchSlot {
+    struct Batch *batch;
+    int state;              // SLOT_FREE / SLOT_BUSY / SLOT_DONE / SLOT_FAILED
+    size_t index;           // Petición que ocupa el hueco
+    uint8_t *buf;           // Buffer propio (alineado para O_DIRECT)
+    size_t cap;
+    uint64_t start;         // Rango realmente leído (alineado con O_DIRECT)
+    size_t span;
+    const uint8_t *data;    // Datos de la petición (en buf o en la caché)
+    CacheEntry *entry;
+    uint64_t t0;            // Momento en que se encoló (--stats)
+} BatchSlot;
+
+enum { SLOT_FREE, SLOT_BUSY, SLOT_DONE, SLOT_FAILED };
+
+typedef struct Batch {
+    Image *img;
+    const ImageReq *reqs;
+    BatchSlot *slots;
+    unsigned nslots;
+    unsigned inflight;
+} Batch;
+
+// Termina una lectura: completa con pread lo que el kernel no devolvió y la guarda en la caché
+static void finish_slot(BatchSlot *slot, int res) {
+    Batch *b = slot->batch;
+    const ImageReq *r = &b->reqs[slot->index];
+    size_t lead = r->offset - slot->start;
+    b->inflight--;
+    if (res > 0) STATS_READ(slot->start, (uint64_t)res, slot->t0);
+
+    if (res < 0 || (size_t)res < lead + r->len) {
+        // Lectura corta, operación no soportada o error: se rehace por la vía síncrona
+        if (read_at(b->img, slot->buf + lead, r->len, r->offset) < 0) {
+            slot->state = SLOT_FAILED;
+            return;
+        }
+    }
+    slot->data = slot->buf + lead;
+    if (b->img->cache && r->cls != IMAGE_UNCACHED) {
+        slot->entry = cache_insert(b->img->cache, r->offset, r->len, r->cls, slot->data);
+        if (slot->entry) slot->data = slot->entry->data;
+    }
+    slot->state = SLOT_DONE;
+}
+
+// Saca una finalización del anillo: puede ser de este lote o de uno anidado por encima
+static int reap_one(Uring *ring) {
+    uint64_t user_data;
+    int res;
+    if (uring_wait(ring, &user_data, &res) < 0) return -1;
+    finish_slot((BatchSlot *)(uintptr_t)user_data, res);
+    return 0;
+}
+
+// Pone la petición i en un hueco libre: de la caché, al anillo o leída en el momento
+static int start_slot(Batch *b, Uring *ring, BatchSlot *slot, size_t i) {
+    const ImageReq *r = &b->reqs[i];
+    Image *img = b->img;
+    slot->index = i;
+    slot->entry = NULL;
+
+    if (img->size && (r->offset > img->size || r->len > img->size - r->offset)) {
+        fprintf(stderr, "Lectura fuera de la imagen: offset %llu, %zu bytes\n",
+                (unsigned long long)r->offset, r->len);
+        return -1;
+    }
+    if (img->cache && r->cls != IMAGE_UNCACHED) {
+        slot->entry = cache_lookup(img->cache, r->offset, r->len, r->cls);
+        if (slot->entry) {
+            slot->data = slot->entry->data;
+            slot->state = SLOT_DONE;
+            return 0;
+        }
+    }
+
+    uint64_t align = img->direct ? IMAGE_DIRECT_ALIGN : 1;
+    slot->start = r->offset & ~(align - 1);
+    slot->span = (r->offset - slot->start + r->len + align - 1) & ~(align - 1);
+    if (slot->cap < slot->span) {
+        free(slot->buf);
+        slot->buf = NULL;
+        slot->cap = 0;
+        if (posix_memalign((void **)&slot->buf, IMAGE_DIRECT_ALIGN, slot->span) != 0) return -1;
+        slot->cap = slot->span;
+    }
+
+    b->inflight++;
+    slot->state = SLOT_BUSY;
+    STATS_STAMP(slot->t0);
+    if (uring_prep_read(ring, img->fd, slot->buf, slot->span, slot->start, (uintptr_t)slot) < 0) {
+        finish_slot(slot, -1);
+    }
+    return 0;
+}
+
+static void release_slot(Batch *b, BatchSlot *slot) {
+    if (slot->entry) cache_release(b->img->cache, slot->entry);
+    slot->entry = NULL;
+    slot->state = SLOT_FREE;
+}
+
+// Siguiente hueco para entregar: el de la petición next en orden o cualquiera terminado
+static BatchSlot *next_ready(Batch *b, int ordered, size_t next) {
+    for (unsigned k = 0; k < b->nslots; k++) {
+        BatchSlot *slot = &b->slots[k];
+        if (slot->state != SLOT_DONE && slot->state != SLOT_FAILED) continue;
+        if (!ordered || slot->index == next) return slot;
+    }
+    return NULL;
+}
+
+// Lote con io_uring: hasta nslots lecturas en vuelo; se entregan según terminan
+// (o en el orden del lote si ordered) y cada hueco entregado se reutiliza
+static int read_batch_uring(Image *img, Uring *ring, unsigned nslots, const ImageReq *reqs, size_t n,
+                            int ordered, ImageReqFn fn, void *ctx) {
+    Batch b = { img, reqs, NULL, nslots, 0 };
+    b.slots = calloc(b.nslots, sizeof(BatchSlot));
+    if (!b.slots) return -1;
+    for (unsigned k = 0; k < b.nslots; k++) b.slots[k].batch = &b;
+
+    size_t next_submit = 0, next_deliver = 0, delivered = 0;
+    int ret = 0;
+    while (delivered < n && ret == 0) {
+        // 1) Llenar los huecos libres
+        for (unsigned k = 0; k < b.nslots && next_submit < n && ret == 0; k++) {
+            if (b.slots[k].state == SLOT_FREE) ret = start_slot(&b, ring, &b.slots[k], next_submit++);
+        }
+        if (ret != 0 || uring_submit(ring) < 0) {
+            ret = -1;
+            break;
+        }
+
+        // 2) Entregar lo que ya está listo
+        int progress = 0;
+        BatchSlot *slot;
+        while (ret == 0 && (slot = next_ready(&b, ordered, next_deliver)) != NULL) {
+            if (slot->state == SLOT_FAILED) {
+                ret = -1;
+                break;
+            }
+            ret = fn(slot->index, slot->data, reqs[slot->index].len, ctx);
+            release_slot(&b, slot);
+            delivered++;
+            next_deliver++;
+            progress = 1;
+        }
+
+        // 3) Sin nada que entregar: esperar a la siguiente finalización
+        if (!progress && ret == 0 && delivered < n && reap_one(ring) < 0) ret = -1;
+    }
+
+    // Las lecturas aún en vuelo escriben en los buffers del lote: hay que esperarlas
+    while (b.inflight > 0 && reap_one(ring) == 0) {
+    }
+    for (unsigned k = 0; k < b.nslots; k++) {
+        if (b.slots[k].entry) cache_release(img->cache, b.slots[k].entry);
+        free(b.slots[k].buf);
+    }
+    free(b.slots);
+    return ret;
+}
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Abre la imagen y la proyecta en memoria si es un fichero regular.
+// Los dispositivos de bloques y entradas no proyectables usan pread.
+int image_open(Image *img, const char *path) {
+    memset(img, 0, sizeof(*img));
+    img->fd = open(path, O_RDONLY);
+    if (img->fd == -1) {
+        perror("Error al abrir el dispositivo");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(img->fd, &st) == -1) {
+        perror("fstat");
+        close(img->fd);
+        return -1;
+    }
+
+    if (S_ISBLK(st.st_mode)) {
+        uint64_t bytes;
+        if (ioctl(img->fd, BLKGETSIZE64, &bytes) == 0) img->size = bytes;
+        return 0;
+    }
+
+    img->size = st.st_size;
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, img->fd, 0);
+        if (map != MAP_FAILED) img->map = map;
+    }
+    return 0;
+}
+
+// Pasa la imagen a modo pread con una caché de bloques de budget bytes:
+// la memoria usada queda acotada aunque la imagen sea mucho mayor que la RAM
+int image_enable_cache(Image *img, size_t budget) {
+    BlockCache *cache = cache_create(budget);
+    if (!cache) {
+        perror("Error al crear la caché de bloques");
+        return -1;
+    }
+    if (img->map) {
+        munmap((void *)img->map, img->size);
+        img->map = NULL;
+    }
+    img->cache = cache;
+    return 0;
+}
+
+// Configura la E/S: depth > 1 lecturas en vuelo con io_uring (si el kernel lo admite)
+// y direct para leer con O_DIRECT sin pasar por la caché de páginas.
+// Las dos dejan la imagen en modo pread: con la proyección no habría E/S que encolar
+int image_set_io(Image *img, unsigned depth, int direct) {
+    if (direct) {
+        int flags = fcntl(img->fd, F_GETFL);
+        if (flags < 0 || fcntl(img->fd, F_SETFL, flags | O_DIRECT) < 0) {
+            perror("No se pudo activar O_DIRECT");
+            return -1;
+        }
+        img->direct = 1;
+    }
+    img->io_depth = depth;
+    if ((depth > 1 || direct) && img->map) {
+        munmap((void *)img->map, img->size);
+        img->map = NULL;
+    }
+    return 0;
+}
+
+void image_close(Image *img) {
+    if (img->map) munmap((void *)img->map, img->size);
+    cache_destroy(img->cache);
+    img->cache = NULL;
+    free_buffer_list(get_free_bufs());
+    pthread_setspecific(free_bufs_key, NULL);
+    if (img->io_depth > 1) {
+        pthread_once(&ring_once, create_ring_key);
+        free_ring(pthread_getspecific(ring_key));
+        pthread_setspecific(ring_key, NULL);
+    }
+    close(img->fd);
+    img->fd = -1;
+    img->map = NULL;
+}
+
+// Devuelve un puntero a len bytes en offset sin copiar si la imagen está proyectada;
+// si no, los lee en un buffer reutilizable. Hay que liberar la vista con image_put.
+const uint8_t *image_get(Image *img, uint64_t offset, size_t len, ImageView *view) {
+    view->data = NULL;
+    view->buf = NULL;
+    view->entry = NULL;
+
+    if (img->size && (offset > img->size || len > img->size - offset)) {
+        fprintf(stderr, "Lectura fuera de la imagen: offset %llu, %zu bytes\n",
+                (unsigned long long)offset, len);
+        return NULL;
+    }
+
+    if (img->map) {
+        STATS_ADD(STAT_VIEWS, 1);
+        STATS_ADD(STAT_VIEW_BYTES, len);
+        view->data = img->map + offset;
+        return view->data;
+    }
+
+    ImageBuffer *b = take_buffer(len);
+    if (!b) {
+        perror("malloc failed");
+        return NULL;
+    }
+    if (read_at(img, b->data, len, offset) < 0) {
+        perror("Error reading image");
+        give_buffer(b);
+        return NULL;
+    }
+    view->buf = b;
+    view->data = b->data;
+    return view->data;
+}
+
+// Como image_get, para bloques de metadatos o datos del sistema de archivos:
+// con caché activa se sirven desde ella (cls = CACHE_META tiene prioridad al expulsar)
+const uint8_t *image_get_block(Image *img, uint64_t offset, size_t len, int cls, ImageView *view) {
+    if (!img->cache) return image_get(img, offset, len, view);
+
+    if (img->size && (offset > img->size || len > img->size - offset)) {
+        fprintf(stderr, "Lectura fuera de la imagen: offset %llu, %zu bytes\n",
+                (unsigned long long)offset, len);
+        view->data = NULL;
+        return NULL;
+    }
+    CacheEntry *e = cache_get(img->cache, offset, len, cls, read_for_cache, img);
+    if (!e) return image_get(img, offset, len, view);    // No cacheable: lectura directa
+    view->buf = NULL;
+    view->entry = e;
+    view->data = e->data;
+    return view->data;
+}
+
+// Devuelve el buffer de la vista (si lo hay) a la lista de libres del hilo
+// o suelta su referencia al bloque de la caché
+void image_put(Image *img, ImageView *view) {
+    if (view->buf) give_buffer(view->buf);
+    if (view->entry) cache_release(img->cache, view->entry);
+    view->buf = NULL;
+    view->entry = NULL;
+    view->data = NULL;
+}
+
+// Lee un lote de rangos y entrega cada uno a fn. Con la imagen proyectada o sin io_uring
+// se entregan en orden según se leen; con io_uring se mantienen hasta io_depth lecturas
+// en vuelo y se entregan según terminan, salvo con ordered (entonces en el orden del lote).
+// Devuelve 0, el valor > 0 con el que fn paró o -1 si hubo un error
+int image_read_batch(Image *img, const ImageReq *reqs, size_t n, int ordered, ImageReqFn fn, void *ctx) {
+    if (n == 0) return 0;
+    Uring *ring = img->map ? NULL : thread_ring(img);
+    if (ring && n > 1) {
+        // Los lotes anidados (un directorio dentro de otro) comparten el anillo: entre
+        // todos no pueden pasar de su tamaño o se perderían finalizaciones
+        unsigned room = ring->entries > ring->inflight ? ring->entries - ring->inflight : 0;
+        unsigned nslots = img->io_depth < room ? img->io_depth : room;
+        if (nslots > n) nslots = (unsigned)n;
+        if (nslots > 1) return read_batch_uring(img, ring, nslots, reqs, n, ordered, fn, ctx);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        ImageView view;
+        const uint8_t *data = reqs[i].cls == IMAGE_UNCACHED
+                                  ? image_get(img, reqs[i].offset, reqs[i].len, &view)
+                                  : image_get_block(img, reqs[i].offset, reqs[i].len, reqs[i].cls, &view);
+        if (!data) return -1;
+        int ret = fn(i, data, reqs[i].len, ctx);
+        image_put(img, &view);
+        if (ret != 0) return ret;
+    }
+    return 0;
+}
+
+// Avisa al kernel de que se va a leer [offset, offset + len): con la imagen proyectada
+// se adelantan las páginas con madvise y en modo pread con posix_fadvise.
+// Es sólo una pista: los errores se ignoran
+void image_prefetch(Image *img, uint64_t offset, uint64_t len) {
+    if (len == 0 || (img->size && offset >= img->size)) return;
+    if (img->size && len > img->size - offset) len = img->size - offset;
+
+    if (img->map) {
+        uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+        uint64_t start = offset & ~(page - 1);
+        madvise((void *)(img->map + start), len + (offset - start), MADV_WILLNEED);
+        return;
+    }
+    posix_fadvise(img->fd, (off_t)offset, (off_t)len, POSIX_FADV_WILLNEED);
+}
+
+// Copia len bytes en offset a dst
+int image_read(Image *img, void *dst, size_t len, uint64_t offset) {
+    if (img->size && (offset > img->size || len > img->size - offset)) {
+        errno = EIO;
+        return -1;
+    }
+    if (img->map) {
+        STATS_ADD(STAT_VIEWS, 1);
+        STATS_ADD(STAT_VIEW_BYTES, len);
+        memcpy(dst, img->map + offset, len);
+        return 0;
+    }
+    return read_at(img, dst, len, offset);
+}
+
+// Tamaño del buffer reutilizado cuando hay que copiar con pread + write
+#define IMAGE_COPY_CHUNK (4u << 20)
+
+// Copias por lotes: trozos más pequeños (uno por lectura en vuelo) y cuántos por lote
+#define IMAGE_BATCH_CHUNK (256u << 10)
+#define IMAGE_COPY_WINDOW 64
+
+// Vuelca len bytes de la imagen desde offset a out_fd con el menor número de copias:
+// copy_file_range entre ficheros, write directo desde la proyección o sendfile,
+// y como último recurso pread + write con un buffer grande reutilizado
+static int write_chunk(size_t index, const uint8_t *data, size_t len, void *ctx) {
+    (void)index;
+    return write_full(*(int *)ctx, data, len) < 0 ? -1 : 0;
+}
+
+// Copia por lotes de trozos: con io_uring se lee por delante de lo que se escribe
+static int copy_out_batched(Image *img, uint64_t offset, uint64_t len, int out_fd) {
+    ImageReq reqs[IMAGE_COPY_WINDOW];
+    while (len > 0) {
+        size_t n = 0;
+        for (; n < IMAGE_COPY_WINDOW && len > 0; n++) {
+            size_t chunk = len < IMAGE_BATCH_CHUNK ? len : IMAGE_BATCH_CHUNK;
+            reqs[n] = (ImageReq){ offset, chunk, IMAGE_UNCACHED };
+            offset += chunk;
+            len -= chunk;
+        }
+        if (image_read_batch(img, reqs, n, 1, write_chunk, &out_fd) != 0) return -1;
+    }
+    return 0;
+}
+
+int image_copy_out(Image *img, uint64_t offset, uint64_t len, int out_fd) {
+    if (img->size && (offset > img->size || len > img->size - offset)) {
+        errno = EIO;
+        return -1;
+    }
+
+    // Con O_DIRECT o io_uring no se usan las copias en el kernel: pasarían por la caché
+    // de páginas o no dejarían encolar lecturas
+    if (img->direct || img->io_depth > 1) return copy_out_batched(img, offset, len, out_fd);
+
+    uint64_t done = copy_in_kernel(img, offset, len, out_fd);
+    offset += done;
+    len -= done;
+    if (len == 0) return 0;
+
+    if (img->map) {
+        STATS_ADD(STAT_VIEWS, 1);
+        STATS_ADD(STAT_VIEW_BYTES, len);
+        return write_full(out_fd, img->map + offset, len);
+    }
+
+    while (len > 0) {
+        off_t in_off = offset;
+        STATS_START(t);
+        ssize_t n = sendfile(out_fd, img->fd, &in_off, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        STATS_COPY(offset, (uint64_t)n, t);
+        offset += n;
+        len -= n;
+    }
+    if (len == 0) return 0;
+
+    ImageBuffer *b = take_buffer(IMAGE_COPY_CHUNK);
+    if (!b) return -1;
+    int ret = 0;
+    while (len > 0 && ret == 0) {
+        size_t chunk = len < IMAGE_COPY_CHUNK ? len : IMAGE_COPY_CHUNK;
+        ret = read_full(img->fd, b->data, chunk, offset);
+        if (ret == 0) ret = write_full(out_fd, b->data, chunk);
+        offset += chunk;
+        len -= chunk;
+    }
+    give_buffer(b);
+    return ret;
+}
+
+// Escribe len bytes de buf en out_fd (datos que no están en la imagen tal cual)
+int image_write_bytes(int out_fd, const void *buf, size_t len) {
+    return write_full(out_fd, buf, len);
+}
+
+// Escribe len bytes a cero en out_fd (huecos de ficheros dispersos) sin leer la imagen
+int image_write_zeros(int out_fd, uint64_t len) {
+    static const uint8_t zeros[64 * 1024];
+    while (len > 0) {
+        size_t chunk = len < sizeof(zeros) ? len : sizeof(zeros);
+        if (write_full(out_fd, zeros, chunk) < 0) return -1;
+        len -= chunk;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cache.h"
+
+
+// Buffer de respaldo para el modo pread (se reutiliza entre lecturas del mismo hilo)
+typedef struct ImageBuffer {
+    uint8_t *data;
+    size_t capacity;
+    struct ImageBuffer *next;
+} ImageBuffer;
+
+// Imagen o dispositivo abierto una sola vez y compartido por FAT16 y EXT2
+typedef struct {
+    int fd;
+    uint64_t size;          // Tamaño en bytes (0 si no se conoce)
+    const uint8_t *map;     // Proyección de solo lectura (NULL en modo pread)
+    BlockCache *cache;      // Caché de bloques con memoria acotada (NULL si no se usa)
+    unsigned io_depth;      // Lecturas en vuelo con io_uring (0 = lecturas síncronas)
+    int direct;             // Abierta con O_DIRECT: lecturas alineadas, sin caché de páginas
+} Image;
+
+// Petición de una lectura por lotes
+typedef struct {
+    uint64_t offset;
+    size_t len;
+    int cls;                // Clase para la caché (CACHE_META / CACHE_DATA / IMAGE_UNCACHED)
+} ImageReq;
+
+// Lecturas de paso (copias grandes) que no deben desplazar bloques de la caché
+#define IMAGE_UNCACHED (-1)
+
+// Recibe cada lectura completada (index es su posición en el lote):
+// devuelve 0 para seguir, >0 para parar y <0 si hay error
+typedef int (*ImageReqFn)(size_t index, const uint8_t *data, size_t len, void *ctx);
+
+// Vista sobre un rango de la imagen: apunta a la proyección o a un buffer propio
+typedef struct {
+    const uint8_t *data;
+    ImageBuffer *buf;
+    CacheEntry *entry;      // Bloque de la caché referenciado por la vista
+} ImageView;
+
+
+int image_open(Image *img, const char *path);
+void image_close(Image *img);
+int image_enable_cache(Image *img, size_t budget);
+int image_set_io(Image *img, unsigned depth, int direct);
+
+const uint8_t *image_get(Image *img, uint64_t offset, size_t len, ImageView *view);
+const uint8_t *image_get_block(Image *img, uint64_t offset, size_t len, int cls, ImageView *view);
+void image_put(Image *img, ImageView *view);
+int image_read(Image *img, void *dst, size_t len, uint64_t offset);
+int image_read_batch(Image *img, const ImageReq *reqs, size_t n, int ordered, ImageReqFn fn, void *ctx);
+void image_prefetch(Image *img, uint64_t offset, uint64_t len);
+int image_copy_out(Image *img, uint64_t offset, uint64_t len, int out_fd);
+int image_write_bytes(int out_fd, const void *buf, size_t len);
+int image_write_zeros(int out_fd, uint64_t len);
+
+#endif
@@ -7,34 +7,154 @@
 #include <sys/stat.h>
 #include <time.h>
 
-#include "fat16.h"
-#include "ext2.h"
+#include "image.h"
+#include "fs.h"
+#include "batch.h"
+#include "catalog.h"
+#include "hash.h"
+#include "stats.h"
 
 
+// Opciones globales que pueden aparecer en cualquier posición
+typedef struct {
+    int jobs;           // Hilos para recorrer el árbol (1 = secuencial)
+    long cache_mb;      // Presupuesto de la caché de bloques (0 = sin caché, imagen proyectada)
+    int io_depth;       // Lecturas en vuelo con io_uring (<= 1 = lecturas síncronas)
+    int direct;         // Leer con O_DIRECT, sin la caché de páginas
+    int max_depth;      // --du: profundidad máxima de los directorios escritos (-1 = todos)
+    const char *catalog;    // Catálogo de --index con el que resolver rutas y el árbol (NULL = ninguno)
+    int algo;           // --hash: HASH_CRC32C, HASH_XXH64 o HASH_SHA256
+    int stats;          // --stats: resumen de lecturas y tiempos por stderr al terminar
+    const char *trace;  // --trace: fichero con la traza en formato de Chrome (NULL = ninguno)
+    FindQuery find;     // Predicados de --find
+} Options;
 
+// Extrae las opciones globales de argv y deja solo la opción principal y sus argumentos
+static int extract_options(int *argc, char *argv[], Options *opts) {
+    opts->jobs = 1;
+    opts->cache_mb = 0;
+    opts->io_depth = 0;
+    opts->direct = 0;
+    opts->max_depth = -1;
+    opts->catalog = NULL;
+    opts->algo = HASH_CRC32C;
+    opts->stats = 0;
+    opts->trace = NULL;
+    memset(&opts->find, 0, sizeof(opts->find));
 
-int main(int argc, char *argv[]) {
-    if (argc != 3 && argc != 4) {
-        printf("Uso: %s --option <dispositivo_o_imagen>\n", argv[0]);
-        return 1;
+    int out = 1;
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= *argc || atoi(argv[i + 1]) < 1) {
+                fprintf(stderr, "--jobs necesita un número de hilos >= 1\n");
+                return -1;
+            }
+            opts->jobs = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--cache-mb") == 0) {
+            if (i + 1 >= *argc || atol(argv[i + 1]) < 1) {
+                fprintf(stderr, "--cache-mb necesita un tamaño en MB >= 1\n");
+                return -1;
+            }
+            opts->cache_mb = atol(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--io-depth") == 0) {
+            if (i + 1 >= *argc || atoi(argv[i + 1]) < 1 || atoi(argv[i + 1]) > 4096) {
+                fprintf(stderr, "--io-depth necesita un número entre 1 y 4096\n");
+                return -1;
+            }
+            opts->io_depth = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--max-depth") == 0) {
+            if (i + 1 >= *argc || argv[i + 1][0] < '0' || argv[i + 1][0] > '9') {
+                fprintf(stderr, "--max-depth necesita una profundidad >= 0\n");
+                return -1;
+            }
+            opts->max_depth = atoi(argv[++i]);
+            continue;
+        }
+        int used = find_parse_option(&opts->find, argv[i], i + 1 < *argc ? argv[i + 1] : NULL);
+        if (used < 0) return -1;
+        if (used) {
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "--catalog") == 0) {
+            if (i + 1 >= *argc) {
+                fprintf(stderr, "--catalog necesita la ruta de un catálogo creado con --index\n");
+                return -1;
+            }
+            opts->catalog = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--algo") == 0) {
+            if (i + 1 >= *argc || hash_algo_parse(argv[i + 1]) < 0) {
+                fprintf(stderr, "--algo necesita crc32c, xxh64 o sha256\n");
+                return -1;
+            }
+            opts->algo = hash_algo_parse(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--direct") == 0) {
+            opts->direct = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--stats") == 0) {
+            opts->stats = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 >= *argc) {
+                fprintf(stderr, "--trace necesita la ruta del fichero de la traza\n");
+                return -1;
+            }
+            opts->trace = argv[++i];
+            continue;
+        }
+        argv[out++] = argv[i];
     }
+    *argc = out;
+    argv[out] = NULL;
+    return 0;
+}
 
-    if (strcmp(argv[1], "--info") == 0) {
-        // MMOSTRAR INFO DEL FILESYSTEM
 
-		EXT2_Superblock sb;
-		if (detect_EXT2(argv[2], &sb) == 1) {
-			print_EXT2_info(&sb);
-			return 0;
-		}
+// Abre una imagen con las opciones de lectura de la línea de órdenes
+static int open_image(const char *path, const Options *opts, Image *img) {
+    if (image_open(img, path) < 0) {
+        return -1;
+    }
+    if ((opts->io_depth > 1 || opts->direct) && image_set_io(img, opts->io_depth, opts->direct) < 0) {
+        image_close(img);
+        return -1;
+    }
+    if (opts->cache_mb > 0 && image_enable_cache(img, (size_t)opts->cache_mb << 20) < 0) {
+        image_close(img);
+        return -1;
+    }
+    return 0;
+}
 
+// Abre el catálogo de --catalog. Si está caducado se avisa y se sigue sin él (devuelve 0);
+// devuelve 1 si está abierto y -1 si no se puede usar
+static int open_catalog(const Options *opts, Image *img, const Filesystem *fs, Catalog *cat) {
+    if (!opts->catalog) return 0;
+    int ret = catalog_open(cat, opts->catalog, img, fs);
+    if (ret == -2) return 0;
+    return ret < 0 ? -1 : 1;
+}
 
-        FAT16_BPB bpb;
-        if (detect_FAT16(argv[2], &bpb) == 1) {
-            print_FAT16_info(&bpb);
+static int run_option(int argc, char *argv[], Image *img, const Filesystem *fs, const Options *opts) {
+    if (strcmp(argv[1], "--info") == 0) {
+        // MMOSTRAR INFO DEL FILESYSTEM
+        if (fs->drv) {
+            fs->drv->info(fs, stdout);
             return 0;
         }
-    
+
         // Ninguno fue detectado
         printf("\nNot supported file system. Only FAT16 and EXT2 are supported.\n");
         return 1;
@@ -43,16 +163,17 @@ int main(int argc, char *argv[]) {
     if (strcmp(argv[1], "--tree") == 0) {
         // MOSTRAR ÁRBOL DE DIRECTORIOS
 
-        EXT2_Superblock sb;
-    	if (detect_EXT2(argv[2], &sb) == 1) {
-        	print_EXT2_tree(argv[2], &sb);
-        	return 0;
-    	}
+        Catalog cat;
+        int use_cat = open_catalog(opts, img, fs, &cat);
+        if (use_cat < 0) return 1;
+        if (use_cat) {
+            int ret = catalog_tree(&cat);
+            catalog_close(&cat);
+            return ret == 0 ? 0 : 1;
+        }
 
-        FAT16_BPB bpb;
-        if (detect_FAT16(argv[2], &bpb) == 1) {
-            print_FAT16_tree(argv[2], &bpb);
-            return 0;
+        if (fs->drv) {
+            return fs->drv->tree(img, fs, opts->jobs) == 0 ? 0 : 1;
         }
         // Filesystem no soportado
         printf("\nNot supported file system. Only FAT16 and EXT2 are supported.\n");
@@ -61,18 +182,236 @@ int main(int argc, char *argv[]) {
 
     if (strcmp(argv[1], "--cat") == 0) {
         if (argc != 4) {
-            fprintf(stderr, "Uso: %s --cat <FAT16_img> <file>\n", argv[0]);
+            fprintf(stderr, "Uso: %s --cat <img> <file>\n", argv[0]);
+            return 1;
+        }
+
+        Catalog cat;
+        int use_cat = open_catalog(opts, img, fs, &cat);
+        if (use_cat < 0) return 1;
+        if (use_cat) {
+            int ret = catalog_cat(&cat, img, fs, argv[3]);
+            catalog_close(&cat);
+            return ret == 0 ? 0 : 1;
+        }
+
+        if (!fs->drv) {
+            fprintf(stderr, "No es FAT16 ni EXT2: %s\n", argv[2]);
+            return 1;
+        }
+        return fs->drv->cat(img, fs, argv[3]) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--stat") == 0) {
+        // MOSTRAR METADATOS DE UN ARCHIVO O DIRECTORIO
+        if (argc != 4) {
+            fprintf(stderr, "Uso: %s --stat <img> <path>\n", argv[0]);
+            return 1;
+        }
+
+        if (!fs->drv) {
+            fprintf(stderr, "No es FAT16 ni EXT2: %s\n", argv[2]);
+            return 1;
+        }
+        return fs->drv->stat(img, fs, argv[3]) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--find") == 0) {
+        // BUSCAR ENTRADAS POR NOMBRE, TAMAÑO, TIPO O FECHA (RUTAS COMPLETAS)
+        const char *path = argc == 4 ? argv[3] : "/";
+        FindQuery q = opts->find;
+
+        Catalog cat;
+        int use_cat = open_catalog(opts, img, fs, &cat);
+        if (use_cat < 0) return 1;
+        if (use_cat) {
+            int ret = catalog_find(&cat, path, &q);
+            catalog_close(&cat);
+            return ret == 0 ? 0 : 1;
+        }
+
+        if (!fs->drv) {
+            fprintf(stderr, "No es FAT16 ni EXT2: %s\n", argv[2]);
+            return 1;
+        }
+        return fs->drv->find(img, fs, path, &q, opts->jobs) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--extract") == 0) {
+        // RESTAURAR UN FICHERO O UN SUBÁRBOL EN UN DIRECTORIO DEL HOST
+        if (argc != 5) {
+            fprintf(stderr, "Uso: %s --extract <img> <ruta> <destino>\n", argv[0]);
+            return 1;
+        }
+        if (!fs->drv) {
+            fprintf(stderr, "No es FAT16 ni EXT2: %s\n", argv[2]);
+            return 1;
+        }
+        return fs->drv->extract(img, fs, argv[3], argv[4], opts->jobs) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--hash") == 0) {
+        // MANIFIESTO ORDENADO DE RUTA, TAMAÑO Y RESUMEN DE CADA FICHERO
+        const char *path = argc == 4 ? argv[3] : "/";
+
+        if (!fs->drv) {
+            fprintf(stderr, "No es FAT16 ni EXT2: %s\n", argv[2]);
+            return 1;
+        }
+        return fs->drv->hash(img, fs, path, opts->algo, opts->jobs) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--diff") == 0) {
+        // RUTAS AÑADIDAS, BORRADAS Y MODIFICADAS ENTRE DOS IMÁGENES DEL MISMO SISTEMA DE ARCHIVOS
+        if (argc != 4) {
+            fprintf(stderr, "Uso: %s --diff <imgA> <imgB>\n", argv[0]);
+            return 1;
+        }
+        if (!fs->drv) {
+            fprintf(stderr, "No es FAT16 ni EXT2: %s\n", argv[2]);
+            return 1;
+        }
+
+        Image img_b;
+        Filesystem fs_b;
+        if (open_image(argv[3], opts, &img_b) < 0) return 1;
+        STATS_START(t0);
+        if (fs_detect(&img_b, &fs_b) < 0 || fs_b.drv != fs->drv) {
+            fprintf(stderr, "%s no es %s como %s\n", argv[3], fs->drv->name, argv[2]);
+            image_close(&img_b);
+            return 1;
+        }
+        STATS_TIME(TIMER_DETECT, t0);
+        int ret = fs->drv->diff(img, fs, &img_b, &fs_b, opts->jobs);
+        if (img_b.cache) {
+            fflush(stdout);
+            cache_print_stats(img_b.cache, stderr);
+        }
+        image_close(&img_b);
+        return ret == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--index") == 0) {
+        // CATÁLOGO DE METADATOS PARA CONSULTAS REPETIDAS
+        if (argc != 4) {
+            fprintf(stderr, "Uso: %s --index <img> <catalog>\n", argv[0]);
+            return 1;
+        }
+        if (!fs->drv) {
+            fprintf(stderr, "\nNot supported file system. Only FAT16 and EXT2 are supported.\n");
+            return 1;
+        }
+        return catalog_write(img, fs, argv[3], opts->jobs) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--du") == 0) {
+        // USO DE DISCO POR DIRECTORIO (SUBÁRBOLES SUMADOS EN PARALELO)
+        const char *path = argc == 4 ? argv[3] : "/";
+
+        if (!fs->drv) {
+            fprintf(stderr, "No es FAT16 ni EXT2: %s\n", argv[2]);
+            return 1;
+        }
+        return fs->drv->du(img, fs, path, opts->jobs, opts->max_depth) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--verify-counts") == 0 || strcmp(argv[1], "--bitmap-stats") == 0) {
+        // LIBRES REALES SEGÚN LOS MAPAS DE BITS FRENTE A DESCRIPTORES Y SUPERBLOQUE
+        if (!fs_is(fs, FS_EXT2)) {
+            fprintf(stderr, "No es EXT2: %s\n", argv[2]);
+            return 1;
+        }
+        int histogram = strcmp(argv[1], "--bitmap-stats") == 0;
+        int ret = bitmap_stats_EXT2(img, &fs->sb, opts->jobs, histogram, stdout);
+        // --verify-counts falla si alguna cuenta no cuadra; --bitmap-stats sólo si hay error
+        return ret < 0 || (ret > 0 && !histogram) ? 1 : 0;
+    }
+
+    if (strcmp(argv[1], "--fragmentation") == 0) {
+        // FRAGMENTACIÓN Y CADENAS DAÑADAS DE UNA FAT16
+        if (!fs_is(fs, FS_FAT16)) {
+            fprintf(stderr, "No es FAT16: %s\n", argv[2]);
+            return 1;
+        }
+        return fragmentation_FAT16(img, &fs->bpb, opts->jobs, stdout) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--undelete-scan") == 0) {
+        // ENTRADAS BORRADAS DE UNA FAT16 (Y RECUPERACIÓN OPCIONAL EN UN DIRECTORIO)
+        if (!fs_is(fs, FS_FAT16)) {
+            fprintf(stderr, "No es FAT16: %s\n", argv[2]);
+            return 1;
+        }
+        const char *recover_dir = argc == 4 ? argv[3] : NULL;
+        return undelete_scan_FAT16(img, &fs->bpb, opts->jobs, recover_dir, stdout) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "--batch") == 0) {
+        // MODO SERVIDOR: ÓRDENES POR STDIN SOBRE LA IMAGEN YA ABIERTA
+        return run_batch(img, fs, opts->jobs);
+    }
+
+    if (strcmp(argv[1], "--check-fat") == 0) {
+        // COMPARAR LA CADENA DE UN ARCHIVO CON LA SEGUNDA COPIA DE LA FAT
+        if (argc != 4) {
+            fprintf(stderr, "Uso: %s --check-fat <FAT16_img> <file>\n", argv[0]);
             return 1;
         }
-        FAT16_BPB bpb;
-        if (detect_FAT16(argv[2], &bpb) != 1) {
+        if (!fs_is(fs, FS_FAT16)) {
             fprintf(stderr, "No es FAT16: %s\n", argv[2]);
             return 1;
         }
-        return cat_FAT16(argv[2], &bpb, argv[3]);
+        return check_FAT16_chain(img, &fs->bpb, argv[3]) == 0 ? 0 : 1;
     }
 
     // En caso de que no se reconozca la opción
     printf("\nError: %s is not a valid option.\n", argv[1]);
     return 1;
 }
+
+int main(int argc, char *argv[]) {
+    Options opts;
+    if (extract_options(&argc, argv, &opts) < 0) {
+        return 1;
+    }
+
+    if (argc != 3 && argc != 4 && !(argc == 5 && strcmp(argv[1], "--extract") == 0)) {
+        printf("Uso: %s --option <dispositivo_o_imagen> [--jobs N] [--cache-mb N] [--io-depth N] [--direct] [--max-depth N] [--catalog F] [--stats] [--trace F]\n", argv[0]);
+        printf("     %s --find <img> [ruta] [--name GLOB] [--regex RE] [--size [+-]N[kMG]] [--type f|d] [--newer TS] [--max-results N]\n", argv[0]);
+        printf("     %s --extract <img> <ruta> <destino>\n", argv[0]);
+        printf("     %s --hash <img> [ruta] [--algo crc32c|xxh64|sha256]\n", argv[0]);
+        printf("     %s --diff <imgA> <imgB>\n", argv[0]);
+        return 1;
+    }
+    if ((opts.stats || opts.trace) && stats_enable(opts.stats, opts.trace) < 0) {
+        return 1;
+    }
+
+    // La imagen se abre una sola vez y la comparten todas las opciones
+    Image img;
+    if (open_image(argv[2], &opts, &img) < 0) {
+        return 1;
+    }
+
+    // El sistema de archivos se reconoce una sola vez, con una única lectura de la cabecera
+    Filesystem fs;
+    STATS_START(t0);
+    if (fs_detect(&img, &fs) < 0) {
+        image_close(&img);
+        return 1;
+    }
+    STATS_TIME(TIMER_DETECT, t0);
+
+    int ret = run_option(argc, argv, &img, &fs, &opts);
+    if (img.cache) {
+        fflush(stdout);
+        cache_print_stats(img.cache, stderr);
+    }
+    fflush(stdout);
+    if (stats_finish(stderr) < 0) {
+        ret = 1;
+    }
+
+    image_close(&img);
+    return ret;
+}
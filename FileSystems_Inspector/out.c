@@ -0,0 +1,132 @@
+#include "out.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+// Sangría de cada nivel del árbol
+#define INDENT_UNIT "│   "
+#define INDENT_UNIT_LEN (sizeof(INDENT_UNIT) - 1)
+
+// Prefijo con INDENT_LEVELS niveles ya concatenados: la sangría de cualquier
+// profundidad es un trozo de esta cadena, sin formatear nada por línea
+static char indent_buf[INDENT_LEVELS * INDENT_UNIT_LEN];
+static pthread_once_t indent_once = PTHREAD_ONCE_INIT;
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static void fill_indent(void) {
+    for (int i = 0; i < INDENT_LEVELS; i++) {
+        memcpy(indent_buf + i * INDENT_UNIT_LEN, INDENT_UNIT, INDENT_UNIT_LEN);
+    }
+}
+
+static void build_indent(void) {
+    pthread_once(&indent_once, fill_indent);
+}
+
+static void write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        STATS_START(t);
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            return;
+        }
+        STATS_WRITE((uint64_t)n, t);
+        p += n;
+        len -= n;
+    }
+}
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+int out_init(OutWriter *w, int fd) {
+    build_indent();
+    w->fd = fd;
+    w->len = 0;
+    w->cap = OUT_BUFFER_SIZE;
+    w->buf = malloc(w->cap);
+    if (!w->buf) {
+        perror("malloc failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Salida a memoria: el buffer crece en lugar de volcarse (para respuestas con longitud)
+int out_init_mem(OutWriter *w) {
+    if (out_init(w, -1) < 0) return -1;
+    return 0;
+}
+
+void out_write(OutWriter *w, const char *s, size_t len) {
+    if (len == 0) return;
+    if (w->fd < 0 && w->len + len > w->cap) {
+        size_t cap = w->cap * 2;
+        while (cap < w->len + len) cap *= 2;
+        char *buf = realloc(w->buf, cap);
+        if (!buf) {
+            perror("malloc failed");
+            return;
+        }
+        w->buf = buf;
+        w->cap = cap;
+    }
+    if (w->len + len > w->cap) {
+        out_flush(w);
+        // Bloques más grandes que el buffer salen directamente
+        if (len > w->cap) {
+            write_all(w->fd, s, len);
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, s, len);
+    w->len += len;
+}
+
+// Devuelve la sangría de hasta INDENT_LEVELS niveles como trozo del prefijo precalculado
+const char *indent_prefix(int depth, size_t *len) {
+    build_indent();
+    if (depth > INDENT_LEVELS) depth = INDENT_LEVELS;
+    if (depth < 0) depth = 0;
+    *len = depth * INDENT_UNIT_LEN;
+    return indent_buf;
+}
+
+void out_indent(OutWriter *w, int depth) {
+    while (depth > 0) {
+        size_t len;
+        const char *prefix = indent_prefix(depth, &len);
+        out_write(w, prefix, len);
+        depth -= INDENT_LEVELS;
+    }
+}
+
+// Una línea del árbol: sangría + rama + nombre + salto de línea
+void out_line(OutWriter *w, int depth, const char *branch, size_t branch_len, const char *name, size_t name_len) {
+    out_indent(w, depth);
+    out_write(w, branch, branch_len);
+    out_write(w, name, name_len);
+    out_write(w, "\n", 1);
+}
+
+void out_flush(OutWriter *w) {
+    if (w->fd < 0) return;
+    if (w->len) write_all(w->fd, w->buf, w->len);
+    w->len = 0;
+}
+
+void out_free(OutWriter *w) {
+    out_flush(w);
+    free(w->buf);
+    w->buf = NULL;
+}
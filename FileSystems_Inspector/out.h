@@ -0,0 +1,29 @@
+#ifndef OUT_H
+#define OUT_H
+
+#include <stddef.h>
+
+
+#define OUT_BUFFER_SIZE (1u << 20)
+#define INDENT_LEVELS 64        // Niveles del prefijo de sangría precalculado
+
+// Salida con buffer grande propio: se vuelca a fd con write de gran tamaño
+// (con fd < 0 todo se queda en memoria)
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len, cap;
+} OutWriter;
+
+
+int out_init(OutWriter *w, int fd);
+int out_init_mem(OutWriter *w);
+void out_write(OutWriter *w, const char *s, size_t len);
+void out_indent(OutWriter *w, int depth);
+void out_line(OutWriter *w, int depth, const char *branch, size_t branch_len, const char *name, size_t name_len);
+void out_flush(OutWriter *w);
+void out_free(OutWriter *w);
+
+const char *indent_prefix(int depth, size_t *len);
+
+#endif
@@ -0,0 +1,208 @@
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Índice del hilo del pool que ejecuta el código (-1 fuera del pool)
+static __thread int current_worker = -1;
+
+typedef struct {
+    Pool *pool;
+    int id;
+} WorkerArg;
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static int deque_push(PoolDeque *dq, PoolTask task) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail - dq->head == dq->cap) {
+        // Cola llena: se duplica conservando el orden
+        size_t new_cap = dq->cap ? dq->cap * 2 : 64;
+        PoolTask *items = malloc(new_cap * sizeof(PoolTask));
+        if (!items) {
+            pthread_mutex_unlock(&dq->lock);
+            return -1;
+        }
+        for (size_t i = dq->head; i < dq->tail; i++) items[i - dq->head] = dq->items[i % dq->cap];
+        free(dq->items);
+        dq->items = items;
+        dq->tail -= dq->head;
+        dq->head = 0;
+        dq->cap = new_cap;
+    }
+    dq->items[dq->tail % dq->cap] = task;
+    dq->tail++;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+// El dueño saca la tarea más reciente (recorrido en profundidad, buena localidad)
+static int deque_pop(PoolDeque *dq, PoolTask *out) {
+    int ok = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        dq->tail--;
+        *out = dq->items[dq->tail % dq->cap];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+// Los demás roban la tarea más antigua (suele ser la de un subárbol más grande)
+static int deque_steal(PoolDeque *dq, PoolTask *out) {
+    int ok = 0;
+    if (pthread_mutex_trylock(&dq->lock) != 0) return 0;
+    if (dq->tail > dq->head) {
+        *out = dq->items[dq->head % dq->cap];
+        dq->head++;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+static int take_task(Pool *pool, int id, PoolTask *out) {
+    if (deque_pop(&pool->deques[id], out)) return 1;
+    for (int i = 1; i < pool->nthreads; i++) {
+        if (deque_steal(&pool->deques[(id + i) % pool->nthreads], out)) return 1;
+    }
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    WorkerArg *wa = arg;
+    Pool *pool = wa->pool;
+    int id = wa->id;
+    free(wa);
+    current_worker = id;
+
+    for (;;) {
+        PoolTask task;
+        if (take_task(pool, id, &task)) {
+            __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+            task.fn(task.arg, id);
+
+            if (__atomic_sub_fetch(&pool->outstanding, 1, __ATOMIC_SEQ_CST) == 0) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->idle_cond);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+
+        // Sin trabajo: dormir hasta que alguien encole o se pare el pool.
+        // sleepers se anuncia antes de mirar queued para no perder avisos de pool_submit
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) <= 0 && !pool->stop) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        int stop = pool->stop && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) <= 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+Pool *pool_create(int nthreads) {
+    if (nthreads < 1) nthreads = 1;
+
+    Pool *pool = calloc(1, sizeof(Pool));
+    if (!pool) return NULL;
+    pool->nthreads = nthreads;
+    pool->threads = calloc(nthreads, sizeof(pthread_t));
+    pool->deques = calloc(nthreads, sizeof(PoolDeque));
+    if (!pool->threads || !pool->deques) {
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+    for (int i = 0; i < nthreads; i++) pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        WorkerArg *wa = malloc(sizeof(WorkerArg));
+        if (wa) {
+            wa->pool = pool;
+            wa->id = i;
+        }
+        if (!wa || pthread_create(&pool->threads[i], NULL, worker_main, wa) != 0) {
+            perror("No se pudo crear el hilo");
+            free(wa);
+            pool->nthreads = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+// Encola una tarea: desde un hilo del pool va a su propia cola, desde fuera se reparte
+void pool_submit(Pool *pool, PoolTaskFn fn, void *arg) {
+    PoolTask task = { fn, arg };
+    int id = current_worker;
+    if (pool->nthreads > 0 && (id < 0 || id >= pool->nthreads)) {
+        id = __atomic_fetch_add(&pool->next_deque, 1, __ATOMIC_RELAXED) % pool->nthreads;
+    }
+
+    __atomic_add_fetch(&pool->outstanding, 1, __ATOMIC_SEQ_CST);
+    if (pool->nthreads == 0 || deque_push(&pool->deques[id], task) < 0) {
+        // Sin hilos o sin memoria: se ejecuta en el acto
+        fn(arg, current_worker);
+        __atomic_sub_fetch(&pool->outstanding, 1, __ATOMIC_SEQ_CST);
+        return;
+    }
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Espera a que terminen todas las tareas encoladas (incluidas las que estas encolen)
+void pool_wait(Pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (__atomic_load_n(&pool->outstanding, __ATOMIC_SEQ_CST) > 0) {
+        pthread_cond_wait(&pool->idle_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(Pool *pool) {
+    if (!pool) return;
+    pool_wait(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++) pthread_join(pool->threads[i], NULL);
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].items);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+int pool_worker_id(void) {
+    return current_worker;
+}
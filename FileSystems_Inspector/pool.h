@@ -0,0 +1,44 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+
+typedef void (*PoolTaskFn)(void *arg, int worker);
+
+typedef struct {
+    PoolTaskFn fn;
+    void *arg;
+} PoolTask;
+
+// Cola doble de cada hilo: el dueño saca por el final (LIFO) y los demás roban por el principio
+typedef struct {
+    PoolTask *items;
+    size_t head, tail, cap;     // Posiciones crecientes; índice real = pos % cap
+    pthread_mutex_t lock;
+} PoolDeque;
+
+// Pool de hilos con robo de trabajo
+typedef struct {
+    int nthreads;
+    pthread_t *threads;
+    PoolDeque *deques;          // Una cola por hilo
+    pthread_mutex_t lock;       // Protege el sueño de los hilos y la espera de pool_wait
+    pthread_cond_t work_cond;   // Hay tareas nuevas o hay que parar
+    pthread_cond_t idle_cond;   // No quedan tareas pendientes
+    long queued;                // Tareas encoladas sin empezar (atómico)
+    long outstanding;           // Tareas encoladas o en ejecución (atómico)
+    int sleepers;               // Hilos dormidos esperando trabajo (atómico)
+    unsigned next_deque;        // Reparto de tareas enviadas desde fuera del pool
+    int stop;
+} Pool;
+
+
+Pool *pool_create(int nthreads);
+void pool_submit(Pool *pool, PoolTaskFn fn, void *arg);
+void pool_wait(Pool *pool);
+void pool_destroy(Pool *pool);
+int pool_worker_id(void);
+
+#endif
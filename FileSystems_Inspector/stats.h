@@ -0,0 +1,63 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+
+// Contadores de --stats
+enum {
+    STAT_READS,                 // Lecturas a la imagen (pread, io_uring o copy_file_range)
+    STAT_READ_BYTES,
+    STAT_SEEKS,                 // Lecturas que no empiezan donde acabó la anterior del mismo hilo
+    STAT_VIEWS,                 // Accesos a la imagen proyectada, sin llamada al sistema
+    STAT_VIEW_BYTES,
+    STAT_FAT_LOOKUPS,           // Saltos de cadena resueltos desde la FAT en memoria
+    STAT_OUT_BYTES,             // Bytes escritos a la salida (árbol, listados y volcados de ficheros)
+    STAT_COUNTERS
+};
+
+// Tiempos medidos: las cuatro fases y, dentro de ellas, cada directorio, inodo y lectura
+enum {
+    TIMER_DETECT,               // Reconocer el sistema de archivos
+    TIMER_METADATA,             // Cargar descriptores de grupo o la FAT
+    TIMER_TRAVERSAL,            // Recorrido completo del árbol
+    TIMER_OUTPUT,               // Escrituras de la salida
+    TIMER_DIRECTORY,            // Un directorio del recorrido
+    TIMER_INODE,                // Un read_inode
+    TIMER_READ,                 // Una lectura de la imagen
+    STAT_TIMERS
+};
+
+// Con FSI_STATS sin definir (make STATS=0) las macros desaparecen y --stats/--trace fallan
+#ifdef FSI_STATS
+extern int stats_on;
+
+uint64_t stats_now(void);
+void stats_add(int counter, uint64_t n);
+void stats_time(int timer, uint64_t start_ns);
+void stats_read(uint64_t offset, uint64_t len, uint64_t start_ns);
+void stats_copy(uint64_t offset, uint64_t len, uint64_t start_ns);
+
+#define STATS_ADD(counter, n) do { if (stats_on) stats_add((counter), (n)); } while (0)
+#define STATS_START(t) uint64_t t = stats_on ? stats_now() : 0
+#define STATS_STAMP(lvalue) ((lvalue) = stats_on ? stats_now() : 0)
+#define STATS_TIME(timer, t) do { if (stats_on) stats_time((timer), (t)); } while (0)
+#define STATS_READ(offset, len, t) do { if (stats_on) stats_read((offset), (len), (t)); } while (0)
+#define STATS_COPY(offset, len, t) do { if (stats_on) stats_copy((offset), (len), (t)); } while (0)
+#define STATS_WRITE(len, t) do { if (stats_on) { stats_add(STAT_OUT_BYTES, (len)); stats_time(TIMER_OUTPUT, (t)); } } while (0)
+#else
+#define STATS_ADD(counter, n) do { } while (0)
+#define STATS_START(t) do { } while (0)
+#define STATS_STAMP(lvalue) do { } while (0)
+#define STATS_TIME(timer, t) do { } while (0)
+#define STATS_READ(offset, len, t) do { } while (0)
+#define STATS_COPY(offset, len, t) do { } while (0)
+#define STATS_WRITE(len, t) do { (void)(len); } while (0)
+#endif
+
+int stats_enable(int summary, const char *trace_path);
+int stats_finish(FILE *out);
+
+#endif
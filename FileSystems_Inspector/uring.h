@@ -0,0 +1,30 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+
+// Anillo de io_uring usado directamente con las llamadas al sistema (sin liburing)
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned queued;        // Peticiones preparadas y aún no enviadas al kernel
+    unsigned inflight;      // Peticiones preparadas cuya finalización no se ha sacado
+} Uring;
+
+
+int uring_init(Uring *ring, unsigned depth);
+void uring_free(Uring *ring);
+int uring_prep_read(Uring *ring, int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data);
+int uring_submit(Uring *ring);
+int uring_wait(Uring *ring, uint64_t *user_data, int *res);
+
+#endif
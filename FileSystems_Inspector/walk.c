@@ -0,0 +1,189 @@
+#include "walk.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------------------------------------
+// --------- Funciones Privadas -----------
+// ----------------------------------------
+
+static WalkNode *new_node(Walk *walk, uint64_t key, int depth) {
+    WalkNode *node = calloc(1, sizeof(WalkNode));
+    if (!node) return NULL;
+    node->walk = walk;
+    node->key = key;
+    node->depth = depth;
+    return node;
+}
+
+static void free_node(WalkNode *node) {
+    free(node->text);
+    free(node->segs);
+    free(node);
+}
+
+static void walk_task(void *arg, int worker) {
+    WalkNode *node = arg;
+    Walk *walk = node->walk;
+
+    // Con el límite de líneas ya alcanzado, el resto de directorios no se leen
+    if (!walk_stopped(walk)) {
+        STATS_START(t);
+        walk->visit(walk, node, worker);
+        STATS_TIME(TIMER_DIRECTORY, t);
+    }
+
+    pthread_mutex_lock(&walk->lock);
+    node->done = 1;
+    pthread_cond_broadcast(&walk->done_cond);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+// Escribe texto de un nodo respetando el límite de líneas; al llegar a él para el recorrido
+static void emit_text(Walk *walk, const char *s, size_t len, OutWriter *out) {
+    if (walk->max_lines <= 0) {
+        out_write(out, s, len);
+        return;
+    }
+
+    size_t end = 0;
+    while (end < len && walk->lines < walk->max_lines) {
+        const char *nl = memchr(s + end, '\n', len - end);
+        if (!nl) {
+            end = len;
+            break;
+        }
+        end = nl - s + 1;
+        walk->lines++;
+    }
+    out_write(out, s, end);
+    if (walk->lines >= walk->max_lines) __atomic_store_n(&walk->stop, 1, __ATOMIC_RELAXED);
+}
+
+// Emite la salida de node en preorden: su texto intercalado con la de cada hijo.
+// Solo espera al nodo que toca, así la salida fluye mientras el resto se recorre.
+// Con finish, cada nodo se cierra después de sus hijos (la salida sale de abajo arriba)
+static void emit_node(Walk *walk, WalkNode *node, OutWriter *out) {
+    pthread_mutex_lock(&walk->lock);
+    while (!node->done) pthread_cond_wait(&walk->done_cond, &walk->lock);
+    pthread_mutex_unlock(&walk->lock);
+
+    size_t pos = 0;
+    for (size_t i = 0; i < node->nsegs; i++) {
+        emit_text(walk, node->text + pos, node->segs[i].text_end - pos, out);
+        pos = node->segs[i].text_end;
+        emit_node(walk, node->segs[i].child, out);
+    }
+    emit_text(walk, node->text + pos, node->len - pos, out);
+    if (walk->finish) walk->finish(walk, node, out);
+    free_node(node);
+}
+
+static int run_walk(Walk *walk, int jobs, uint64_t root_key, int root_depth, void *root_data, OutWriter *out) {
+    walk->lines = 0;
+    walk->stop = 0;
+    pthread_mutex_init(&walk->lock, NULL);
+    pthread_cond_init(&walk->done_cond, NULL);
+
+    walk->pool = pool_create(jobs);
+    WalkNode *root = walk->pool ? new_node(walk, root_key, root_depth) : NULL;
+    if (!root) {
+        perror("No se pudo iniciar el recorrido paralelo");
+        pool_destroy(walk->pool);
+        return -1;
+    }
+    root->data = root_data;
+
+    STATS_START(t);
+    pool_submit(walk->pool, walk_task, root);
+    emit_node(walk, root, out);
+    STATS_TIME(TIMER_TRAVERSAL, t);
+
+    pool_destroy(walk->pool);
+    pthread_mutex_destroy(&walk->lock);
+    pthread_cond_destroy(&walk->done_cond);
+    return 0;
+}
+
+// ----------------------------------------
+// --------- Funciones Publicas -----------
+// ----------------------------------------
+
+// Recorre el árbol desde root_key con jobs hilos y emite la salida en el mismo orden
+// que el recorrido secuencial en profundidad
+int walk_run(int jobs, WalkVisitFn visit, void *ctx, uint64_t root_key, int root_depth, OutWriter *out) {
+    Walk walk;
+    walk.visit = visit;
+    walk.finish = NULL;
+    walk.ctx = ctx;
+    walk.max_lines = 0;
+    return run_walk(&walk, jobs, root_key, root_depth, NULL, out);
+}
+
+// Recorrido en postorden: visit procesa cada directorio en paralelo y finish lo cierra
+// en el hilo que escribe, después de sus hijos, para sumar cada subárbol en su padre.
+// Con max_lines > 0 se escriben como mucho esas líneas y el recorrido para al llegar
+int walk_run_postorder(int jobs, WalkVisitFn visit, WalkFinishFn finish, void *ctx,
+                       uint64_t root_key, void *root_data, long max_lines, OutWriter *out) {
+    Walk walk;
+    walk.visit = visit;
+    walk.finish = finish;
+    walk.ctx = ctx;
+    walk.max_lines = max_lines;
+    return run_walk(&walk, jobs, root_key, 0, root_data, out);
+}
+
+// Reserva el hueco de un subdirectorio en la salida del padre y lo encola
+WalkNode *walk_child(Walk *walk, WalkNode *parent, uint64_t key, int depth) {
+    return walk_child_data(walk, parent, key, depth, NULL);
+}
+
+// Como walk_child, con los datos del hijo ya asignados antes de encolarlo
+WalkNode *walk_child_data(Walk *walk, WalkNode *parent, uint64_t key, int depth, void *data) {
+    if (parent->nsegs == parent->segcap) {
+        size_t cap = parent->segcap ? parent->segcap * 2 : 8;
+        WalkSegment *segs = realloc(parent->segs, cap * sizeof(WalkSegment));
+        if (!segs) return NULL;
+        parent->segs = segs;
+        parent->segcap = cap;
+    }
+
+    WalkNode *child = new_node(walk, key, depth);
+    if (!child) return NULL;
+    child->parent = parent;
+    child->data = data;
+    parent->segs[parent->nsegs].text_end = parent->len;
+    parent->segs[parent->nsegs].child = child;
+    parent->nsegs++;
+
+    pool_submit(walk->pool, walk_task, child);
+    return child;
+}
+
+// Indica si el recorrido ya alcanzó su límite (los visitantes pueden dejar de leer)
+int walk_stopped(Walk *walk) {
+    return __atomic_load_n(&walk->stop, __ATOMIC_RELAXED);
+}
+
+void walk_append(WalkNode *node, const char *s, size_t len) {
+    if (node->len + len > node->cap) {
+        size_t cap = node->cap ? node->cap : 256;
+        while (cap < node->len + len) cap *= 2;
+        char *text = realloc(node->text, cap);
+        if (!text) return;
+        node->text = text;
+        node->cap = cap;
+    }
+    memcpy(node->text + node->len, s, len);
+    node->len += len;
+}
+
+void walk_indent(WalkNode *node, int depth) {
+    while (depth > 0) {
+        size_t len;
+        const char *prefix = indent_prefix(depth, &len);
+        walk_append(node, prefix, len);
+        depth -= INDENT_LEVELS;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "out.h"
+
+
+typedef struct Walk Walk;
+typedef struct WalkNode WalkNode;
+
+// Procesa un directorio: escribe sus líneas en node y crea un hijo por subdirectorio
+typedef void (*WalkVisitFn)(Walk *walk, WalkNode *node, int worker);
+
+// Cierra un nodo en postorden, ya cerrados todos sus hijos (sumas de subárboles)
+typedef void (*WalkFinishFn)(Walk *walk, WalkNode *node, OutWriter *out);
+
+// Punto de la salida del padre en el que se intercala la salida de un hijo
+typedef struct {
+    size_t text_end;
+    WalkNode *child;
+} WalkSegment;
+
+// Directorio pendiente de recorrer y su salida, que se emite en preorden
+struct WalkNode {
+    Walk *walk;
+    WalkNode *parent;
+    uint64_t key;               // Inodo o cluster del directorio
+    int depth;
+    void *data;                 // Datos del recorrido para este directorio (los libera finish)
+    char *text;
+    size_t len, cap;
+    WalkSegment *segs;
+    size_t nsegs, segcap;
+    int done;
+};
+
+// Recorrido paralelo: los directorios son tareas del pool y la salida se reensambla en orden
+struct Walk {
+    Pool *pool;
+    WalkVisitFn visit;
+    WalkFinishFn finish;        // NULL salvo en recorridos en postorden
+    void *ctx;                  // Contexto del sistema de archivos
+    long max_lines;             // Líneas que se emiten como mucho (0 = sin límite)
+    long lines;                 // Líneas ya emitidas (solo el hilo que escribe)
+    int stop;                   // Límite alcanzado: no se visitan más directorios (atómico)
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+};
+
+
+int walk_run(int jobs, WalkVisitFn visit, void *ctx, uint64_t root_key, int root_depth, OutWriter *out);
+int walk_run_postorder(int jobs, WalkVisitFn visit, WalkFinishFn finish, void *ctx,
+                       uint64_t root_key, void *root_data, long max_lines, OutWriter *out);
+int walk_stopped(Walk *walk);
+WalkNode *walk_child(Walk *walk, WalkNode *parent, uint64_t key, int depth);
+WalkNode *walk_child_data(Walk *walk, WalkNode *parent, uint64_t key, int depth, void *data);
+void walk_append(WalkNode *node, const char *s, size_t len);
+void walk_indent(WalkNode *node, int depth);
+
+#endif